@@ -0,0 +1 @@
+../motors/clocksync.h
\ No newline at end of file
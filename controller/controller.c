@@ -4,36 +4,182 @@
 #include "naj.h"
 #include "timer.h"
 #include "interrupts.h"
+#include "gpio_interrupts.h"
 #include "ringbuffer.h"
+#include "routing.h"
+#include "song.h"
 
-#define MOTOR_NUM 8
+#define MOTOR_NUM 16 // Logical voices per motor board - above NAJ_MOTORS, motors alternate between pitches (see naj.h)
 #define MIDI_MODE 0 // 0 = live, 1 = file
+#define MIDI_INPUT MIDI_INPUT_GPIO // MIDI_INPUT_GPIO or MIDI_INPUT_UART (see midi.h)
+#define CONSOLE_INPUT (MIDI_INPUT != MIDI_INPUT_UART) // The UART input takes the console's receive pin, leaving it output only
+#define NAJ_BENCH_BYTES 4096
+#define NAJ_SNAPSHOT_PERIOD 250000 // Microseconds between full motor state snapshots
+#define VOICE_SLICE_US 20000 // How long a shared motor plays each of its voices before switching
 
-static unsigned char motor_array[MOTOR_NUM];
+// Voices of every motor board on the bus, as one pool (see `midi.c` for how they map to boards)
+static unsigned char motor_array[MOTOR_NUM * NAJ_MAX_BOARDS];
+static unsigned int motor_count;
+
+// Print the motor state after every MIDI event - off by default, as the print blocks the loop for
+// every number in it (toggled with 'm' on the console)
+static unsigned int show_motor_state;
 
 static void print_motor_state() {
     printf("Motors: ");
-    for(int i = 0; i < MOTOR_NUM; i++) {
+    for(unsigned int i = 0; i < motor_count; i++) {
         printf("%d ", motor_array[i]);
     }
     printf("\n");
 }
 
+static void naj_benchmark(void) {
+    // Stream bytes the receivers ignore (anything but a packet start) and time how long the bus takes
+    naj_flush();
+    unsigned int start = timer_get_ticks();
+
+    for (int i = 0; i < NAJ_BENCH_BYTES; i++) {
+        // Keep the queue topped up: a byte that finds it full is tried again
+        while (!naj_write_byte(0)) {}
+    }
+    naj_flush();
+
+    unsigned int elapsed = timer_get_ticks() - start;
+    unsigned int rate = (unsigned long long) NAJ_BENCH_BYTES * 1000000 / elapsed;
+    printf("NAJ: %d bytes in %d us = %d bytes/s (ack timeouts %d)\n", NAJ_BENCH_BYTES, elapsed, rate, naj_tx_ack_timeouts());
+}
+
+static int hex_value(int ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+static void read_routing_preset(void) {
+    // Typed as: r<preset><channel for motor 0><channel for motor 1>...<enter>
+    // Channels are single hex digits, '-' for a motor that follows no channel
+    unsigned int preset = hex_value(uart_getchar());
+    unsigned char channels[ROUTING_MAX_MOTORS];
+    unsigned int count = 0;
+
+    while (1) {
+        int ch = uart_getchar();
+        if (ch == '\r' || ch == '\n') break;
+        if (count == ROUTING_MAX_MOTORS) continue;
+        channels[count++] = (ch == '-') ? ROUTING_NONE : hex_value(ch);
+    }
+
+    if (!routing_store(preset, channels, count)) {
+        printf("Bad routing preset\n");
+        return;
+    }
+    midi_select_routing(preset);
+}
+
+static void handle_uart_command(int ch) {
+    // Single-character debug commands typed on the console
+    if (ch == 'j') {
+        // Ask the motor board to print its step jitter statistics
+        struct naj_frame_t frame;
+        naj_frame_begin(&frame);
+        naj_frame_add(&frame, NAJ_CMD_JITTER_DUMP, NULL, 0);
+        if (!naj_frame_send(&frame)) printf("NAJ tx queue full - try again\n");
+    } else if (ch == 'n') {
+        // Print NAJ transmit queue statistics
+        printf("NAJ tx: depth %d max %d overflows %d\n", naj_tx_depth(), naj_tx_max_depth(), naj_tx_overflows());
+    } else if (ch == 'b') {
+        // Measure NAJ bus throughput
+        naj_benchmark();
+    } else if (ch == 'v') {
+        // Print voice allocation statistics
+        midi_print_voice_stats();
+    } else if (ch == 'm') {
+        // Print the motor state now, and after every MIDI event from here on - or stop
+        show_motor_state = !show_motor_state;
+        if (show_motor_state) print_motor_state();
+    } else if (ch >= '0' && ch <= '3') {
+        // Choose the voice stealing policy (VOICES_STEAL_NONE ... VOICES_STEAL_CLOSEST)
+        midi_set_steal_policy(ch - '0');
+        printf("Steal policy %c\n", ch);
+    } else if (ch == 'p') {
+        // Select a file mode routing preset: p<digit>
+        midi_select_routing(uart_getchar() - '0');
+    } else if (ch == 'r') {
+        // Store and select a file mode routing preset
+        read_routing_preset();
+    } else if (ch == 'u') {
+        // Receive a MIDI file (see song.h for the format) and play it
+        if (song_upload()) song_start();
+    } else if (ch == 'g') {
+        // Play the loaded song from the start
+        song_start();
+    } else if (ch == 'x') {
+        // Stop the song
+        song_stop();
+    }
+}
+
 void main(void)
 {
     interrupts_init();
+    gpio_interrupts_init();
     uart_init();
-    midi_init(motor_array, MOTOR_NUM, MIDI_MODE);
     naj_init_write();
 
-    naj_write_byte(0x19);
-
+    // Handshake is clocked out by the transmit interrupt, so interrupts must be on first
     interrupts_global_enable();
 
+    naj_send_handshake();
+
+    // Find the motor boards - the voice pool grows with each one
+    unsigned int boards = naj_enumerate();
+    motor_count = MOTOR_NUM * boards;
+    printf("%d motor board(s), %d voices\n", boards, motor_count);
+    midi_init(motor_array, motor_count, MIDI_MODE, MIDI_INPUT);
+    if (!CONSOLE_INPUT) printf("MIDI input on the console's receive pin: console commands and song upload are off\n");
+
+    // Tell the motor board how fast to alternate between voices sharing a motor
+    struct naj_frame_t frame;
+    unsigned char slice[2] = {VOICE_SLICE_US & 0xFF, VOICE_SLICE_US >> 8};
+    naj_frame_begin(&frame);
+    naj_frame_add(&frame, NAJ_CMD_SLICE, slice, 2);
+    while (!naj_frame_send(&frame)) {}
+
+    // A song linked into the program starts playing straight away
+    if (song_init()) song_start();
+
+    unsigned int last_snapshot = timer_get_ticks();
+    unsigned int last_sync = timer_get_ticks();
     while(1) {
+        if (CONSOLE_INPUT && uart_haschar()) handle_uart_command(uart_getchar());
+
+        // Keep the other boards' clocks locked to ours
+        if (timer_get_ticks() - last_sync >= NAJ_SYNC_PERIOD) {
+            naj_send_sync();
+            last_sync = timer_get_ticks();
+        }
+        naj_poll_write();
+
+        // Periodically resend the full motor state so readers recover from lost frames
+        if (timer_get_ticks() - last_snapshot >= NAJ_SNAPSHOT_PERIOD) {
+            midi_send_snapshot(motor_array, motor_count);
+            last_snapshot = timer_get_ticks();
+        }
+
+        // Songs played from memory are dispatched ahead of time, alongside any live input
+        song_poll(motor_array, motor_count);
+
+        // Wait until there is data - once the input goes quiet, send the updates batched so far
+        // (the notes of a chord arrive back to back and end up in one frame)
+        if (!midi_has_data()) {
+            midi_flush_motors();
+            continue;
+        }
+
         struct midi_event_t event = midi_read_event();
-        midi_update_motors(event, motor_array, MOTOR_NUM);
-        print_motor_state();
+        midi_update_motors(event, motor_array, motor_count);
+        if (show_motor_state) print_motor_state();
     }
 
     uart_putchar(EOT);
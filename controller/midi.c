@@ -1,180 +1,320 @@
 #include "midi.h"
+#include "ringbuffer.h"
 #include "gpio.h"
 #include "printf.h"
 #include "timer.h"
 #include "naj.h"
 #include "gpio_interrupts.h"
 #include "gpio_extra.h"
+#include "interrupts.h"
+#include "midiparse.h"
+#include "midirx.h"
+#include "pl011.h"
 #include "uart.h"
+#include "voices.h"
+#include "routing.h"
+#include "motorq.h"
 
 #define MIDI_PIN GPIO_PIN4
-#define BAUD 31250
-#define DELAY (1000000 / BAUD)
+#define MIDI_UART_RX_PIN GPIO_PIN15
 
-static void midi_read_byte_handler(unsigned int pc, void *aux_data);
+// Reference clock of the PL011 UART as configured by the firmware (`init_uart_clock` in config.txt)
+#define MIDI_UART_CLOCK 3000000
+
+// Largest motor pool a snapshot covers
+#define MOTOR_POOL_MAX VOICES_MAX
+
+static void midi_edge_handler(unsigned int pc, void *aux_data);
+static void midi_edge_pending(void);
+static void midi_uart_handler(unsigned int pc, void *aux_data);
+static void update_motors(struct midi_event_t event, unsigned char* motor_array, unsigned int size, const unsigned int *deadline);
 
 static rb_t *midi_seq_queue;
 static unsigned int midi_mode;
+static unsigned int midi_input;
+static struct midirx_t midi_rx;
+static struct midi_parser_t midi_parser;
+
+// Live mode: which motor plays which key
+static struct voices_t live_voices;
 
-void midi_init(unsigned char* motor_array, unsigned int size, unsigned int mode) {
+// Motor state passed to `midi_init`, so routing changes can silence the motors they reassign
+static unsigned char *midi_motors;
+static unsigned int midi_motor_count;
+
+// Motor updates waiting to be sent to each board, so updates that arrive together share one frame
+static struct motorq_t motor_queue;
+
+static void send_motor_frame(struct naj_frame_t *frame, void *aux) {
+    // Motor updates must not be lost: a frame that finds the transmit queue full waits for room,
+    // which the transmit interrupt makes a byte at a time, and goes in whole
+    while (!naj_frame_send(frame)) {}
+}
+
+static void midi_init_gpio(void) {
     gpio_set_input(MIDI_PIN);
     gpio_set_pullup(MIDI_PIN);
 
+    midirx_init(&midi_rx);
+
+    // Interrupt on every edge - the receiver decodes bytes from the time between edges
+    // GPIO interrupts must have already been initialized by the main program
+    gpio_enable_event_detection(MIDI_PIN, GPIO_DETECT_FALLING_EDGE);
+    gpio_enable_event_detection(MIDI_PIN, GPIO_DETECT_RISING_EDGE);
+    gpio_interrupts_register_handler(MIDI_PIN, midi_edge_handler, midi_seq_queue);
+    gpio_interrupts_enable();
+
+    // The NAJ transmit interrupts take an edge that is waiting before their own work, so it is
+    // stamped late by at most the rest of one of them
+    naj_set_tx_hook(midi_edge_pending);
+}
+
+static void midi_init_uart(void) {
+    // Route PL011 RXD to GPIO15, taking over the console's receive pin: the mini UART reads nothing
+    // from here on, so the console is output only (GPIO14, mini UART TXD, keeps working)
+    gpio_set_function(MIDI_UART_RX_PIN, GPIO_FUNC_ALT0);
+    gpio_set_pullup(MIDI_UART_RX_PIN);
+
+    pl011_init(PL011_BASE, MIDI_UART_CLOCK, MIDIRX_BAUD);
+
+    interrupts_register_handler(INTERRUPTS_VC_UART, midi_uart_handler, midi_seq_queue);
+    interrupts_enable_source(INTERRUPTS_VC_UART);
+}
+
+void midi_init(unsigned char* motor_array, unsigned int size, unsigned int mode, unsigned int input) {
     // Turn all motors "off"
     for(unsigned int i = 0; i < size; i++) {
         motor_array[i] = MIDI_MOTOR_OFF;
     }
 
     midi_seq_queue = rb_new();
+    midi_parser_init(&midi_parser);
+    motorq_init(&motor_queue, naj_board_count(), send_motor_frame, NULL);
+    voices_init(&live_voices, size, NAJ_MOTORS * naj_board_count(), MIDI_STEAL_POLICY);
+    routing_init(MIDI_ROUTING_PRESET);
+    midi_motors = motor_array;
+    midi_motor_count = size;
 
-    gpio_interrupts_init();
-    gpio_enable_event_detection(MIDI_PIN, GPIO_DETECT_FALLING_EDGE);
-    gpio_interrupts_register_handler(MIDI_PIN, midi_read_byte_handler, midi_seq_queue);
-    gpio_interrupts_enable();
+    midi_input = input;
+    if (input == MIDI_INPUT_UART) {
+        midi_init_uart();
+    } else {
+        midi_init_gpio();
+    }
 
     midi_mode = mode;
 
     printf("Midi initialized!\n");
 }
 
-void midi_read_byte_handler(unsigned int pc, void *aux_data) {
-    // ! This probably prevents a race condition... but it works!
-    timer_delay_us(1);
+static void midi_enqueue_byte(rb_t *rb, unsigned char seq) {
+    rb_enqueue(rb, seq);
+}
 
-    unsigned int seq = 0;
-    for(int i = 0; i < 10; i++) {
-        int val = gpio_read(MIDI_PIN);
-        if(i != 0 && i != 9) {
-            seq |= (val << (i - 1));
-        }
-        if(i < 9) timer_delay_us(DELAY); // Skip delay for last bit to not mess up timing
-    }
+static void midi_uart_byte(unsigned char seq, void *aux_data) {
+    midi_enqueue_byte((rb_t*) aux_data, seq);
+}
+
+void midi_uart_handler(unsigned int pc, void *aux_data) {
+    // The hardware has already deserialized the bytes - just move them out of the FIFO
+    pl011_drain_rx(PL011_BASE, midi_uart_byte, aux_data);
+}
 
-    rb_t *rb = (rb_t*) aux_data;
-    if(seq != MIDI_STATUS_ON) rb_enqueue(rb, seq);
+void midi_edge_handler(unsigned int pc, void *aux_data) {
+    // Timestamp the edge and hand it to the receiver - returns within a few microseconds
+    unsigned int now = timer_get_ticks();
 
+    // Clear before reading the level so an edge during this handler raises a new event
     gpio_clear_event(MIDI_PIN);
+
+    unsigned char seq;
+    if (midirx_edge(&midi_rx, now, gpio_read(MIDI_PIN), &seq)) {
+        midi_enqueue_byte((rb_t*) aux_data, seq);
+    }
+}
+
+static void midi_edge_pending(void) {
+    if (gpio_check_event(MIDI_PIN)) midi_edge_handler(0, midi_seq_queue);
+}
+
+static void midi_poll_receiver(void) {
+    if (midi_input != MIDI_INPUT_GPIO) return;
+
+    // A byte ending in high bits has no edge after it, so finish it once its stop bit has passed
+    interrupts_global_disable();
+
+    unsigned char seq;
+    if (midirx_poll(&midi_rx, timer_get_ticks(), &seq)) {
+        midi_enqueue_byte(midi_seq_queue, seq);
+    }
+
+    interrupts_global_enable();
+}
+
+unsigned char midi_has_data(void) {
+    midi_poll_receiver();
+    return !rb_empty(midi_seq_queue);
 }
 
 struct midi_event_t midi_read_event(void) {
 
     struct midi_event_t event;
-    int bytes_recieved = 0;
 
     while(1) {
         // Wait until there is data
-        if(rb_empty(midi_seq_queue)) continue;
+        if(!midi_has_data()) continue;
 
         // Recieve one byte at a time
         int data;
         rb_dequeue(midi_seq_queue, &data);
-        printf("%x\n", data);
-        bytes_recieved++;
-
-        // Assign data to correct field in struct
-        if(bytes_recieved == 1) {
-            unsigned int action = ((unsigned int) data) >> 4;
-            unsigned int channel = ((unsigned int) data) & 0xF;
-
-            if(action == MIDI_NOTE_ON || action == MIDI_NOTE_OFF) {
-                event.action = action;
-            } else {
-                // Skip event if trying to read file
-                if(midi_mode == 1) {
-                        bytes_recieved = 0;
-                        continue;
-                }
-
-                event.action = MIDI_ACTION_OTHER; // ! This is questionable
-            }
 
-            event.channel = channel;
-        } else if(bytes_recieved == 2) {
-            if(event.action == MIDI_NOTE_ON || event.action == MIDI_NOTE_OFF) {
-                event.key = data & 0x7F;
-            } else {
-                event.key = MIDI_MOTOR_OFF; // ! Also questionable
-            }
-        } else if(bytes_recieved == 3) {
-            if(event.action == MIDI_NOTE_ON || event.action == MIDI_NOTE_OFF) {
-                event.velocity = data & 0x7F;
-            } else {
-                event.velocity = MIDI_MOTOR_OFF; // ! Watch out
-            }
-            return event;
-        }
+        if(!midi_parser_feed(&midi_parser, data, &event)) continue;
+
+        // Keep-alive messages carry no information
+        if(event.action == MIDI_SYSTEM && (MIDI_SYSTEM << 4 | event.channel) == MIDI_STATUS_ON) continue;
+
+        return event;
     }
 }
 
+static void queue_motor_update(unsigned char motor, unsigned char key, const unsigned int *deadline) {
+    // Key is piano indexed, or MIDI_MOTOR_OFF
+    // `deadline` is the shared time of the event the update belongs to, or NULL for straight away -
+    // every update of one event gets the same one, so they share a NOTES_AT header on each board
+    if (deadline) {
+        motorq_note_at(&motor_queue, motor, key, *deadline);
+    } else {
+        motorq_note(&motor_queue, motor, key);
+    }
+}
+
+static void queue_motor_bend(unsigned char motor, unsigned char lsb, unsigned char msb) {
+    // Bends take effect as soon as they arrive (even in file mode), gliding the note that is sounding
+    motorq_bend(&motor_queue, motor, lsb, msb);
+}
+
+void midi_flush_motors(void) {
+    motorq_flush(&motor_queue);
+}
+
+void midi_send_snapshot(unsigned char* motor_array, unsigned int size) {
+    unsigned char keys[MOTOR_POOL_MAX];
+    if (size > MOTOR_POOL_MAX) size = MOTOR_POOL_MAX;
+    for (unsigned int i = 0; i < size; i++) {
+        keys[i] = (motor_array[i] == MIDI_MOTOR_OFF) ? MIDI_MOTOR_OFF : motor_array[i] - MIDI_PIANO_OFFSET;
+    }
+    motorq_snapshot(&motor_queue, keys, size);
+}
+
 void midi_update_motors(struct midi_event_t event, unsigned char* motor_array, unsigned int size) {
+    if(midi_mode == 1) {
+        // Songs are not interactive, so trade a little latency for every board starting the note together
+        // One deadline for the whole event, however many motors it fans out to
+        midi_update_motors_at(event, motor_array, size, naj_time() + MIDI_FILE_LOOKAHEAD);
+        return;
+    }
+
+    update_motors(event, motor_array, size, NULL);
+}
+
+void midi_update_motors_at(struct midi_event_t event, unsigned char* motor_array, unsigned int size, unsigned int time) {
+    update_motors(event, motor_array, size, &time);
+}
+
+static void update_motors(struct midi_event_t event, unsigned char* motor_array, unsigned int size, const unsigned int *deadline) {
+
+    // Routing changes can arrive in the song itself, ahead of the notes they apply to
+    if(event.action == MIDI_SYSTEM && (event.action << 4 | event.channel) == MIDI_SYSEX) {
+        midi_handle_sysex(midi_parser.sysex, event.key);
+        return;
+    }
+
+    if(event.action == MIDI_PITCH_BEND && midi_mode == 0) {
+        // Live mode voices are not tied to channels, so the bend applies to all of them
+        queue_motor_bend(NAJ_ALL_MOTORS, event.key, event.velocity);
+        return;
+    }
 
     if(midi_mode == 0) {
-        // Note on: Search array for empty motor
+        // Note on: Get a motor from the voice allocator (free, same key retriggered, or stolen)
         if(event.action == MIDI_NOTE_ON && event.velocity > 0) {
-            for(unsigned char i = 0; i < size; i++) {
-                if(motor_array[i] == MIDI_MOTOR_OFF) {
-                    // Replace note
-                    motor_array[i] = event.key;
-
-                    // Send updated state to motors: Key (piano indexed), Motor
-                    naj_write_byte(NAJ_START_PACKET);
-                    naj_write_byte(event.key - MIDI_PIANO_OFFSET);
-                    naj_write_byte(i);
-                    break;
-                }
+            unsigned char stolen_key;
+            unsigned char motor = voices_note_on(&live_voices, event.key, event.velocity, &stolen_key);
+            if(motor < size) {
+                // A stolen motor is simply retuned - no need to turn it off first
+                motor_array[motor] = event.key;
+
+                // Send updated state to motors: Motor, Key (piano indexed)
+                queue_motor_update(motor, event.key - MIDI_PIANO_OFFSET, deadline);
             }
         } else if(event.action == MIDI_NOTE_OFF || (event.action == MIDI_NOTE_ON && event.velocity == 0)) {
-            // Note off: Search array for given note
-            for(unsigned char i = 0; i < size; i++) {
-                if(motor_array[i] == event.key) {
-                    // Replace note, send udpated state through NAJ protocol, abort
-                    motor_array[i] = MIDI_MOTOR_OFF;
-
-                    // Send updated state to motors: OFF (0xFF), Motor
-                    naj_write_byte(NAJ_START_PACKET);
-                    naj_write_byte(MIDI_MOTOR_OFF);
-                    naj_write_byte(i);
-                    break;
-                }
+            // Note off: Only if the key still owns its motor (it may have been stolen since)
+            unsigned char motor = voices_note_off(&live_voices, event.key);
+            if(motor < size) {
+                motor_array[motor] = MIDI_MOTOR_OFF;
+
+                // Send updated state to motors: Motor, OFF (0xFF)
+                queue_motor_update(motor, MIDI_MOTOR_OFF, deadline);
             }
         }
     } else {
-        // Map channel to motor (default)
-        // int motors_to_channel[] = {0, 1, 2, 3, 4, 5, 6, 7};
+        // Fan the event out to every motor following its channel in the selected routing preset
+        unsigned int motors = routing_motors(event.channel);
+        while(motors) {
+            unsigned int i = __builtin_ctz(motors);
+            motors &= motors - 1;
+            if(i >= size) break;
 
-        // Megalovaia (Simple)
-        int motors_to_channel[] = {0, 0, 0, 0, 1, 1, 1, 1};
+            if(event.action == MIDI_PITCH_BEND) {
+                queue_motor_bend(i, event.key, event.velocity);
+            } else if(event.action == MIDI_NOTE_ON && event.velocity > 0) {
+                motor_array[i] = event.key;
+                queue_motor_update(i, event.key - MIDI_PIANO_OFFSET, deadline);
+            } else if(event.action == MIDI_NOTE_OFF || event.action == MIDI_NOTE_ON) {
+                motor_array[i] = MIDI_MOTOR_OFF;
+                queue_motor_update(i, MIDI_MOTOR_OFF, deadline);
+            }
+        }
+    }
+}
 
-        // Megalovaia (Complicated)
-        // int motors_to_channel[] = {0, 0, 2, 2, 6, 6, 1, 3};
+void midi_set_steal_policy(unsigned int policy) {
+    voices_set_policy(&live_voices, policy);
+}
 
-        // Never Gonna Give You Up
-        // int motors_to_channel[] = {0, 1, 3, 3, 3, 4, 4, 4};
+void midi_print_voice_stats(void) {
+    printf("Voices: policy %d notes %d steals %d drops %d retriggers %d\n", live_voices.policy,
+           live_voices.notes, live_voices.steals, live_voices.drops, live_voices.retriggers);
+}
 
-        // Wii Channel Theme
-        // int motors_to_channel[] = {0, 0, 0, 0, 1, 1, 1, 1};
+void midi_set_motor_at(unsigned int motor, unsigned char key, unsigned int time) {
+    if(motor >= midi_motor_count) return;
 
-        if(event.action == MIDI_NOTE_ON && event.channel < 8) {
-            for(int i = 0; i < 8; i++) {
-                if(motors_to_channel[i] == event.channel) {
-                    motor_array[i] = event.key;
-                    naj_write_byte(NAJ_START_PACKET);
-                    naj_write_byte(event.key - MIDI_PIANO_OFFSET);
-                    naj_write_byte(i);
-                }
-            }
-            
-        } else if(event.action == MIDI_NOTE_OFF && event.channel < 8) {
-            for(int i = 0; i < 8; i++) {
-                if(motors_to_channel[i] == event.channel) {
-                    motor_array[i] = event.key;
-                    naj_write_byte(NAJ_START_PACKET);
-                    naj_write_byte(MIDI_MOTOR_OFF);
-                    naj_write_byte(i);
-                }
-            }
-        }
+    midi_motors[motor] = (key == MIDI_MOTOR_OFF) ? MIDI_MOTOR_OFF : key + MIDI_PIANO_OFFSET;
+    queue_motor_update(motor, key, &time);
+}
+
+void midi_handle_sysex(const unsigned char *data, unsigned int len) {
+    if(routing_handle_sysex(data, len)) midi_select_routing(routing_selected());
+}
+
+void midi_all_off(void) {
+    voices_all_off(&live_voices);
+
+    for(unsigned int i = 0; i < midi_motor_count; i++) {
+        if(midi_motors[i] == MIDI_MOTOR_OFF) continue;
+        midi_motors[i] = MIDI_MOTOR_OFF;
+        queue_motor_update(i, MIDI_MOTOR_OFF, NULL);
     }
+    // Centre every bend too, so the next notes start in tune
+    queue_motor_bend(NAJ_ALL_MOTORS, 0x00, 0x40);
+    midi_flush_motors();
+}
+
+void midi_select_routing(unsigned int preset) {
+    if(!routing_select(preset)) return;
 
-    // TODO Can probably unify Naj protocol code
+    // Notes started under the old routing would never get their note off - silence them
+    if(midi_mode == 1) midi_all_off();
+    routing_print();
 }
@@ -1,39 +1,87 @@
 #ifndef _MIDI_H
+#define _MIDI_H
 
-#include "ringbuffer.h"
+#include "voices.h"
 
 /* Definitions for motor tracking */
 #define MIDI_MOTOR_OFF 0xFF
-#define NAJ_START_PACKET 0xEE
+
+/* Definitions for MIDI input backends */
+#define MIDI_INPUT_GPIO 0 // Bit-banged on GPIO4, decoded from edge timestamps
+#define MIDI_INPUT_UART 1 // PL011 hardware UART receiving on GPIO15 - the console's receive pin, so the console is
+                          // output only: no commands, no song upload (`controller.c` stops reading it)
 
 /* Definitions for MIDI messages */
 #define MIDI_STATUS_ON 0xFE // Status indicator sent by modern MIDI devices at a regular to show line is still valid
-#define MIDI_NOTE_ON 0x9 // 0b1001cccc
 #define MIDI_NOTE_OFF 0x8 // 0b1000cccc
+#define MIDI_NOTE_ON 0x9 // 0b1001cccc
+#define MIDI_KEY_PRESSURE 0xA // 0b1010cccc
+#define MIDI_CONTROL_CHANGE 0xB // 0b1011cccc
+#define MIDI_PROGRAM_CHANGE 0xC // 0b1100cccc (1 data byte)
+#define MIDI_CHANNEL_PRESSURE 0xD // 0b1101cccc (1 data byte)
+#define MIDI_PITCH_BEND 0xE // 0b1110cccc (key = LSB, velocity = MSB)
+#define MIDI_SYSTEM 0xF // 0b1111xxxx (channel field holds the low nibble of the status byte)
 #define MIDI_ACTION_OTHER 0
 #define MIDI_PIANO_OFFSET 21 // Offset maps Midi key indices to piano key indices
+#define MIDI_STEAL_POLICY VOICES_STEAL_OLDEST // Live mode voice stealing policy when every motor is busy (see voices.h)
+#define MIDI_ROUTING_PRESET 1 // File mode channel to motor routing used at startup (see routing.c)
+#define MIDI_FILE_LOOKAHEAD 5000 // In file mode, notes are scheduled this many microseconds ahead on the shared timebase
 
 /* Enum for recognized midi actions */
 // enum midi_actions_t { MIDI_ACTION_ON, MIDI_ACTION_OFF, MIDI_ACTION_OTHER };
 
 /* Struct defining form of a "midi event" */
+/* Key and velocity hold the first and second data bytes for messages other than notes (0 if absent) */
 struct midi_event_t {
-    unsigned int action;
-    unsigned int channel;
-    unsigned int key;
-    unsigned int velocity;
+    unsigned char action;
+    unsigned char channel;
+    unsigned char key;
+    unsigned char velocity;
 };
 
-/* Initializes midi module (for consistency) */
-void midi_init(unsigned char* motor_array, unsigned int size, unsigned int mode);
+/* Initializes midi module (for consistency), reading from the given input backend */
+void midi_init(unsigned char* motor_array, unsigned int size, unsigned int mode, unsigned int input);
+
+/* Returns 1 if midi bytes are waiting to be read, 0 otherwise */
+unsigned char midi_has_data(void);
 
 /**
- * Compiles several midi sequences into an event type.
- * Blocking: Waits until falling edge detected before returning valid event (will try again if 0xFE or invalid event)
+ * Compiles several midi sequences into an event type (see midiparse.h).
+ * Blocking: Waits until a complete message has been received (active sensing 0xFE is skipped)
 **/
 struct midi_event_t midi_read_event(void);
 
 /* Takes a midi event input and changes the state of the motors appropriately */
+/* Updates are batched into one NAJ frame until `midi_flush_motors` is called (or the frame fills up) */
 void midi_update_motors(struct midi_event_t event, unsigned char* motor_array, unsigned int size);
 
+/* Same as `midi_update_motors`, but the motors change at shared time `time` (see `naj_time`) */
+void midi_update_motors_at(struct midi_event_t event, unsigned char* motor_array, unsigned int size, unsigned int time);
+
+/* Sets one motor to a piano key index (or MIDI_MOTOR_OFF) at shared time `time`, bypassing routing and allocation */
+/* Batched like `midi_update_motors` */
+void midi_set_motor_at(unsigned int motor, unsigned char key, unsigned int time);
+
+/* Applies a SysEx payload of `len` bytes (between 0xF0 and 0xF7), as `midi_update_motors` does for live input */
+void midi_handle_sysex(const unsigned char *data, unsigned int len);
+
+/* Turns every motor off */
+void midi_all_off(void);
+
+/* Sends the motor updates batched by `midi_update_motors` */
+void midi_flush_motors(void);
+
+/* Changes which playing note gives up its motor when a live note arrives and every motor is busy */
+void midi_set_steal_policy(unsigned int policy);
+
+/* Prints the live mode voice allocation statistics (notes, steals, drops, retriggers) */
+void midi_print_voice_stats(void);
+
+/* Switches the file mode channel to motor routing to another preset (see routing.h) */
+/* Motors playing under the old routing are turned off */
+void midi_select_routing(unsigned int preset);
+
+/* Sends the full state of every motor, so readers recover from any lost frames */
+void midi_send_snapshot(unsigned char* motor_array, unsigned int size);
+
 #endif
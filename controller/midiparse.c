@@ -0,0 +1,110 @@
+// This file implements the streaming MIDI parser as defined in `midiparse.h`
+#include "midiparse.h"
+
+#define STATUS_SYSEX_START 0xF0
+#define STATUS_SYSEX_END 0xF7
+#define STATUS_REALTIME 0xF8 // 0xF8-0xFF are single byte realtime messages
+
+// Number of data bytes for each channel message, indexed by the status high nibble - 8
+static const unsigned char channel_data_len[8] = {
+    2, // 0x8 Note off
+    2, // 0x9 Note on
+    2, // 0xA Polyphonic key pressure
+    2, // 0xB Control change
+    1, // 0xC Program change
+    1, // 0xD Channel pressure
+    2, // 0xE Pitch bend
+    0, // 0xF System messages (see below)
+};
+
+// Number of data bytes for each system common message, indexed by the status low nibble (0xF0-0xF7)
+static const unsigned char system_data_len[8] = {
+    0, // 0xF0 SysEx start (handled separately)
+    1, // 0xF1 MTC quarter frame
+    2, // 0xF2 Song position
+    1, // 0xF3 Song select
+    0, // 0xF4 Undefined
+    0, // 0xF5 Undefined
+    0, // 0xF6 Tune request
+    0, // 0xF7 SysEx end (handled separately)
+};
+
+static void make_event(struct midi_event_t *event, unsigned char status, unsigned char data1, unsigned char data2) {
+    event->action = status >> 4;
+    event->channel = status & 0xF;
+    event->key = data1;
+    event->velocity = data2;
+}
+
+void midi_parser_init(struct midi_parser_t *parser) {
+    parser->status = 0;
+    parser->needed = 0;
+    parser->count = 0;
+    parser->in_sysex = 0;
+    parser->sysex_len = 0;
+}
+
+int midi_parser_feed(struct midi_parser_t *parser, unsigned char byte, struct midi_event_t *event) {
+    // Realtime bytes may appear anywhere and do not disturb the message being assembled
+    if (byte >= STATUS_REALTIME) {
+        make_event(event, byte, 0, 0);
+        return 1;
+    }
+
+    if (byte & 0x80) {
+        // Any status byte ends a SysEx message (0xF7 normally, but devices may omit it)
+        int sysex_done = parser->in_sysex && byte == STATUS_SYSEX_END && parser->sysex_len <= MIDI_SYSEX_MAX;
+        parser->in_sysex = 0;
+        parser->count = 0;
+
+        if (byte < 0xF0) {
+            // Channel message - becomes the running status
+            parser->status = byte;
+            parser->needed = channel_data_len[(byte >> 4) - 8];
+            return 0;
+        }
+
+        // System common messages cancel running status
+        parser->status = 0;
+
+        if (byte == STATUS_SYSEX_START) {
+            parser->in_sysex = 1;
+            parser->sysex_len = 0;
+            return 0;
+        }
+        if (byte == STATUS_SYSEX_END) {
+            if (!sysex_done) return 0;
+            make_event(event, MIDI_SYSEX, parser->sysex_len, 0);
+            return 1;
+        }
+
+        parser->needed = system_data_len[byte & 0x7];
+        if (parser->needed == 0) {
+            make_event(event, byte, 0, 0);
+            return 1;
+        }
+
+        // Keep the status only until its data bytes arrive
+        parser->status = byte;
+        return 0;
+    }
+
+    // Data byte - collected inside SysEx (until there is no more room), skipped when there is no status
+    if (parser->in_sysex) {
+        if (parser->sysex_len < MIDI_SYSEX_MAX) parser->sysex[parser->sysex_len] = byte;
+        if (parser->sysex_len <= MIDI_SYSEX_MAX) parser->sysex_len++;
+        return 0;
+    }
+    if (parser->status == 0) return 0;
+
+    parser->data[parser->count++] = byte;
+    if (parser->count < parser->needed) return 0;
+
+    make_event(event, parser->status, parser->data[0], (parser->needed == 2) ? parser->data[1] : 0);
+    parser->count = 0;
+
+    // Running status only applies to channel messages
+    if (parser->status >= 0xF0) parser->status = 0;
+
+    return 1;
+}
@@ -0,0 +1,38 @@
+// This file defines a streaming MIDI byte parser
+// Bytes are fed in one at a time and complete messages come out as `midi_event_t`s
+// Handles running status, 1- and 2-byte channel messages, system common messages,
+// realtime bytes interleaved anywhere (even mid-message) and SysEx
+// SysEx messages up to MIDI_SYSEX_MAX bytes are collected and reported as one event once their
+// 0xF7 end byte arrives; longer ones (or ones cut short by another status byte) are skipped
+// The parser state is a few dozen bytes and nothing is allocated
+
+#ifndef _MIDIPARSE_H
+#define _MIDIPARSE_H
+
+#include "midi.h"
+
+// Longest SysEx payload (bytes between 0xF0 and 0xF7) that is collected
+#define MIDI_SYSEX_MAX 48
+
+// Status byte reported in a completed SysEx event (action MIDI_SYSTEM, channel 0)
+// The event's key holds the payload length, and the payload is in the parser's `sysex` array
+#define MIDI_SYSEX 0xF0
+
+struct midi_parser_t {
+    unsigned char status;   // Current (running) status byte, 0 if none
+    unsigned char needed;   // Data bytes the current status takes
+    unsigned char count;    // Data bytes collected so far
+    unsigned char in_sysex; // 1 while inside a SysEx message
+    unsigned char data[2];
+    unsigned char sysex_len; // SysEx bytes collected so far (MIDI_SYSEX_MAX + 1 once too long)
+    unsigned char sysex[MIDI_SYSEX_MAX];
+};
+
+// Reset parser state (no running status)
+void midi_parser_init(struct midi_parser_t *parser);
+
+// Feed one byte from the wire
+// Returns 1 and fills in `*event` if the byte completed a message, 0 otherwise
+int midi_parser_feed(struct midi_parser_t *parser, unsigned char byte, struct midi_event_t *event);
+
+#endif
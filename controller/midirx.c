@@ -0,0 +1,76 @@
+// This file implements the incremental MIDI receiver as defined in `midirx.h`
+#include "midirx.h"
+
+// Set frame bits [from, to) to the given level
+static void fill_bits(struct midirx_t *rx, unsigned int from, unsigned int to, unsigned int level) {
+    if (to > MIDIRX_FRAME_BITS) to = MIDIRX_FRAME_BITS;
+    if (from >= to) return;
+
+    if (level) rx->frame |= (1 << to) - (1 << from);
+    rx->next_bit = to;
+}
+
+// Check start/stop bits and extract the data byte
+static int finish_frame(struct midirx_t *rx, unsigned char *byte) {
+    rx->in_frame = 0;
+
+    unsigned int start_bit = rx->frame & 1;
+    unsigned int stop_bit = (rx->frame >> (MIDIRX_FRAME_BITS - 1)) & 1;
+    if (start_bit != 0 || stop_bit != 1) {
+        rx->errors++;
+        return 0;
+    }
+
+    *byte = (rx->frame >> 1) & 0xFF;
+    return 1;
+}
+
+static void begin_frame(struct midirx_t *rx, unsigned int time) {
+    rx->in_frame = 1;
+    rx->start_time = time;
+    rx->next_bit = 0;
+    rx->frame = 0;
+}
+
+void midirx_init(struct midirx_t *rx) {
+    rx->in_frame = 0;
+    rx->start_time = 0;
+    rx->next_bit = 0;
+    rx->level = 1;
+    rx->frame = 0;
+    rx->errors = 0;
+}
+
+int midirx_edge(struct midirx_t *rx, unsigned int time, unsigned int level, unsigned char *byte) {
+    int completed = 0;
+
+    if (rx->in_frame) {
+        // Edges fall on bit boundaries - round to the nearest one
+        unsigned int bit = (time - rx->start_time + MIDIRX_BIT_US / 2) / MIDIRX_BIT_US;
+
+        // The line held its previous level for every bit up to this edge
+        fill_bits(rx, rx->next_bit, bit, rx->level);
+        rx->level = level;
+
+        // Edge inside the frame - nothing more to do until the next one
+        if (bit < MIDIRX_FRAME_BITS) return 0;
+
+        // Edge after the stop bit: the frame is complete, and this edge may be the next start bit
+        completed = finish_frame(rx, byte);
+    }
+
+    rx->level = level;
+    if (level == 0) begin_frame(rx, time);
+
+    return completed;
+}
+
+int midirx_poll(struct midirx_t *rx, unsigned int now, unsigned char *byte) {
+    if (!rx->in_frame) return 0;
+
+    // Wait until the middle of the stop bit, after which no edge can change this frame
+    if (now - rx->start_time < MIDIRX_FRAME_BITS * MIDIRX_BIT_US - MIDIRX_BIT_US / 2) return 0;
+
+    fill_bits(rx, rx->next_bit, MIDIRX_FRAME_BITS, rx->level);
+    return finish_frame(rx, byte);
+}
@@ -0,0 +1,36 @@
+// This file defines an incremental receiver for bit-banged MIDI (31250 baud, 8N1)
+// Instead of busy-waiting through a frame, the receiver is fed the timestamp and new level
+// of every edge on the MIDI line and reconstructs bytes from the time between edges
+// Each call does a constant amount of work, so it can run inside a GPIO interrupt
+
+#ifndef _MIDIRX_H
+#define _MIDIRX_H
+
+#define MIDIRX_BAUD 31250
+#define MIDIRX_BIT_US (1000000 / MIDIRX_BAUD) // 32us per bit
+#define MIDIRX_FRAME_BITS 10                  // Start bit, 8 data bits (LSB first), stop bit
+
+// Receiver state - one per MIDI line
+struct midirx_t {
+    unsigned int in_frame;   // 1 while between a start bit and its stop bit
+    unsigned int start_time; // Tick of the falling edge that began the current frame
+    unsigned int next_bit;   // Index of the first frame bit whose level is not yet known
+    unsigned int level;      // Line level since the last edge
+    unsigned int frame;      // Frame bits collected so far (bit 0 = start bit)
+    unsigned int errors;     // Frames dropped because of a bad start or stop bit
+};
+
+// Reset receiver state (line is assumed idle/high)
+void midirx_init(struct midirx_t *rx);
+
+// Feed one edge: the line changed to `level` at tick `time`
+// Returns 1 and stores the byte in `*byte` if this edge completed a frame, 0 otherwise
+// An edge can both complete one frame and start the next, so back-to-back bytes are handled
+int midirx_edge(struct midirx_t *rx, unsigned int time, unsigned int level, unsigned char *byte);
+
+// Call periodically with the current tick
+// Completes a frame whose last data bits and stop bit are all high (no edge marks its end)
+// Returns 1 and stores the byte in `*byte` if a frame completed, 0 otherwise
+int midirx_poll(struct midirx_t *rx, unsigned int now, unsigned char *byte);
+
+#endif
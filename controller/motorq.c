@@ -0,0 +1,84 @@
+// This file implements the motor update queue as defined in `motorq.h`
+#include "motorq.h"
+
+static void start_frame(struct motorq_t *queue, unsigned int board) {
+    naj_frame_begin(&queue->frames[board]);
+    queue->frames[board].addr = board;
+}
+
+static void flush_board(struct motorq_t *queue, unsigned int board) {
+    if (queue->frames[board].len == 0) return;
+
+    queue->send(&queue->frames[board], queue->aux);
+    start_frame(queue, board);
+}
+
+void motorq_init(struct motorq_t *queue, unsigned int boards, void (*send)(struct naj_frame_t *frame, void *aux), void *aux) {
+    queue->boards = (boards >= 1 && boards <= NAJ_MAX_BOARDS) ? boards : 1;
+    queue->send = send;
+    queue->aux = aux;
+    for (unsigned int board = 0; board < NAJ_MAX_BOARDS; board++) {
+        start_frame(queue, board);
+    }
+}
+
+void motorq_note(struct motorq_t *queue, unsigned int motor, unsigned char key) {
+    unsigned int board = naj_pool_board(motor, queue->boards);
+    unsigned char voice = naj_pool_voice(motor, queue->boards);
+    if (!naj_frame_add_note(&queue->frames[board], voice, key)) {
+        flush_board(queue, board);
+        naj_frame_add_note(&queue->frames[board], voice, key);
+    }
+}
+
+void motorq_note_at(struct motorq_t *queue, unsigned int motor, unsigned char key, unsigned int deadline) {
+    unsigned int board = naj_pool_board(motor, queue->boards);
+    unsigned char voice = naj_pool_voice(motor, queue->boards);
+    if (!naj_frame_add_note_at(&queue->frames[board], deadline, voice, key)) {
+        flush_board(queue, board);
+        naj_frame_add_note_at(&queue->frames[board], deadline, voice, key);
+    }
+}
+
+static void board_bend(struct motorq_t *queue, unsigned int board, unsigned char voice, unsigned char lsb, unsigned char msb) {
+    unsigned char args[3] = { voice, lsb, msb };
+    if (!naj_frame_add(&queue->frames[board], NAJ_CMD_BEND, args, 3)) {
+        flush_board(queue, board);
+        naj_frame_add(&queue->frames[board], NAJ_CMD_BEND, args, 3);
+    }
+}
+
+void motorq_bend(struct motorq_t *queue, unsigned int motor, unsigned char lsb, unsigned char msb) {
+    if (motor != NAJ_ALL_MOTORS) {
+        board_bend(queue, naj_pool_board(motor, queue->boards), naj_pool_voice(motor, queue->boards), lsb, msb);
+        return;
+    }
+    for (unsigned int board = 0; board < queue->boards; board++) {
+        board_bend(queue, board, NAJ_ALL_MOTORS, lsb, msb);
+    }
+}
+
+void motorq_flush(struct motorq_t *queue) {
+    for (unsigned int board = 0; board < queue->boards; board++) {
+        flush_board(queue, board);
+    }
+}
+
+void motorq_snapshot(struct motorq_t *queue, const unsigned char *keys, unsigned int size) {
+    motorq_flush(queue);
+
+    // One snapshot per board, listing its voices in order
+    for (unsigned int board = 0; board < queue->boards; board++) {
+        unsigned char board_keys[NAJ_MAX_PAYLOAD - 2];
+        unsigned int count = 0;
+        for (unsigned int i = board; i < size && count < sizeof(board_keys); i += queue->boards) {
+            board_keys[count++] = keys[i];
+        }
+
+        struct naj_frame_t frame;
+        naj_frame_begin(&frame);
+        frame.addr = board;
+        naj_frame_add(&frame, NAJ_CMD_SNAPSHOT, board_keys, count);
+        queue->send(&frame, queue->aux);
+    }
+}
@@ -0,0 +1,41 @@
+// This file defines the queue of motor updates that `midi.c` batches into frames for the motor boards
+// Everything here is pure computation on memory - finished frames are handed to a callback to be
+// sent - so it can be tested on the host
+//
+// Motors are numbered across the whole pool (see `najframe.h`): each update goes into the frame of the
+// board that plays the motor, as that board's voice. A board's frame is sent when it fills up or
+// when the queue is flushed, so the updates that arrive together share one frame per board
+
+#ifndef _MOTORQ_H
+#define _MOTORQ_H
+
+#include "najframe.h"
+
+struct motorq_t {
+    struct naj_frame_t frames[NAJ_MAX_BOARDS]; // Frame being built for each board
+    unsigned int boards;
+    void (*send)(struct naj_frame_t *frame, void *aux);
+    void *aux;
+};
+
+// Start a queue for `boards` boards, sending each finished frame with `send`
+void motorq_init(struct motorq_t *queue, unsigned int boards, void (*send)(struct naj_frame_t *frame, void *aux), void *aux);
+
+// Set pool motor `motor` to piano key `key` (or NAJ_NOTE_OFF) as soon as its frame arrives
+void motorq_note(struct motorq_t *queue, unsigned int motor, unsigned char key);
+
+// Set pool motor `motor` to piano key `key` (or NAJ_NOTE_OFF) at shared time `deadline`
+// Updates for the same deadline share one NOTES_AT header in each board's frame
+void motorq_note_at(struct motorq_t *queue, unsigned int motor, unsigned char key, unsigned int deadline);
+
+// Bend pool motor `motor` (or every motor, for NAJ_ALL_MOTORS) by a 14-bit MIDI pitch bend
+void motorq_bend(struct motorq_t *queue, unsigned int motor, unsigned char lsb, unsigned char msb);
+
+// Send every board's frame that has updates in it
+void motorq_flush(struct motorq_t *queue);
+
+// Send the keys of pool motors 0 to `size` - 1 (piano key indices or NAJ_NOTE_OFF), one snapshot per board
+// Anything queued is sent first, so the snapshot is not older than a pending update
+void motorq_snapshot(struct motorq_t *queue, const unsigned char *keys, unsigned int size);
+
+#endif
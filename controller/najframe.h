@@ -0,0 +1 @@
+../motors/najframe.h
\ No newline at end of file
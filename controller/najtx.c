@@ -0,0 +1 @@
+../motors/najtx.c
\ No newline at end of file
@@ -0,0 +1 @@
+../motors/najtx.h
\ No newline at end of file
@@ -0,0 +1,57 @@
+// This file implements the PL011 receive driver as defined in `pl011.h`
+#include "pl011.h"
+
+// Reading DR pops a byte from the RX FIFO, which a plain struct in memory cannot do by itself
+// (`tools/pl011test` defines PL011_READ_DR to a function that models the FIFO)
+#ifdef PL011_READ_DR
+unsigned int PL011_READ_DR(volatile struct pl011_regs_t *regs);
+#else
+#define PL011_READ_DR(regs) ((regs)->dr)
+#endif
+
+static unsigned int rx_errors;
+
+void pl011_init(volatile struct pl011_regs_t *regs, unsigned int clock_hz, unsigned int baud) {
+    // Disable the UART while it is being configured
+    regs->cr = 0;
+    while (regs->fr & PL011_FR_BUSY) {}
+
+    // Baud divisor is clock / (16 * baud), stored as a 16.6 fixed point number
+    unsigned int divisor = (clock_hz * 4 + baud / 2) / baud;
+    regs->ibrd = divisor >> 6;
+    regs->fbrd = divisor & 0x3F;
+
+    // 8 data bits, no parity, 1 stop bit, FIFOs on (writing LCRH latches the divisors)
+    regs->lcrh = PL011_LCRH_WLEN8 | PL011_LCRH_FEN;
+
+    // Interrupt when the RX FIFO is 1/8 full, or when bytes sit in it for 32 bit times
+    regs->ifls = 0;
+    regs->icr = PL011_INT_ALL;
+    regs->imsc = PL011_INT_RX | PL011_INT_RT;
+
+    rx_errors = 0;
+    regs->cr = PL011_CR_UARTEN | PL011_CR_RXE;
+}
+
+unsigned int pl011_drain_rx(volatile struct pl011_regs_t *regs, pl011_rx_fn_t fn, void *aux_data) {
+    unsigned int count = 0;
+
+    while (!(regs->fr & PL011_FR_RXFE)) {
+        unsigned int data = PL011_READ_DR(regs);
+
+        if (data & PL011_DR_ERRORS) {
+            rx_errors++;
+            continue;
+        }
+
+        fn(data & 0xFF, aux_data);
+        count++;
+    }
+
+    regs->icr = PL011_INT_RX | PL011_INT_RT;
+    return count;
+}
+
+unsigned int pl011_rx_errors(void) {
+    return rx_errors;
+}
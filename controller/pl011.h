@@ -0,0 +1,56 @@
+// This file defines a minimal receive-only driver for the Pi's PL011 UART
+// The driver only touches the UART through the register bank pointer it is given,
+// so it can be pointed at a plain struct in memory instead of the real peripheral (see `tools/pl011test`)
+
+#ifndef _PL011_H
+#define _PL011_H
+
+// PL011 register layout (BCM2835 peripherals manual, section 13.4)
+struct pl011_regs_t {
+    unsigned int dr;          // 0x00 Data register (bits 8-11 are per-byte error flags)
+    unsigned int rsrecr;      // 0x04 Receive status / error clear
+    unsigned int reserved0[4];
+    unsigned int fr;          // 0x18 Flag register
+    unsigned int reserved1;
+    unsigned int ilpr;        // 0x20 (unused)
+    unsigned int ibrd;        // 0x24 Integer baud rate divisor
+    unsigned int fbrd;        // 0x28 Fractional baud rate divisor
+    unsigned int lcrh;        // 0x2C Line control
+    unsigned int cr;          // 0x30 Control
+    unsigned int ifls;        // 0x34 Interrupt FIFO level select
+    unsigned int imsc;        // 0x38 Interrupt mask set/clear
+    unsigned int ris;         // 0x3C Raw interrupt status
+    unsigned int mis;         // 0x40 Masked interrupt status
+    unsigned int icr;         // 0x44 Interrupt clear
+};
+
+#define PL011_BASE ((volatile struct pl011_regs_t *)0x20201000)
+
+// Register bits used by the driver
+#define PL011_DR_ERRORS  (0xF << 8) // Overrun, break, parity and framing error flags
+#define PL011_FR_BUSY    (1 << 3)
+#define PL011_FR_RXFE    (1 << 4)   // Receive FIFO empty
+#define PL011_LCRH_FEN   (1 << 4)   // Enable FIFOs
+#define PL011_LCRH_WLEN8 (3 << 5)   // 8 data bits
+#define PL011_CR_UARTEN  (1 << 0)
+#define PL011_CR_RXE     (1 << 9)
+#define PL011_INT_RX     (1 << 4)   // Receive FIFO reached its trigger level
+#define PL011_INT_RT     (1 << 6)   // Receive timeout (FIFO not empty and line idle)
+#define PL011_INT_ALL    0x7FF
+
+// Called for every byte received without errors
+typedef void (*pl011_rx_fn_t)(unsigned char byte, void *aux_data);
+
+// Configure the UART for 8N1 reception at `baud`, with the RX FIFO and RX interrupts enabled
+// `clock_hz` is the UART reference clock (UARTCLK) set by the firmware
+void pl011_init(volatile struct pl011_regs_t *regs, unsigned int clock_hz, unsigned int baud);
+
+// Empty the RX FIFO, calling `fn` for every good byte, and clear the RX interrupts
+// Intended to be called from the UART interrupt handler
+// Returns the number of bytes passed to `fn`
+unsigned int pl011_drain_rx(volatile struct pl011_regs_t *regs, pl011_rx_fn_t fn, void *aux_data);
+
+// Returns the number of bytes dropped because of framing, parity, break or overrun errors
+unsigned int pl011_rx_errors(void);
+
+#endif
@@ -0,0 +1,87 @@
+// This file implements the channel to motor routing as defined in `routing.h`
+#include "routing.h"
+#include "printf.h"
+
+static unsigned char presets[ROUTING_PRESETS][ROUTING_MAX_MOTORS];
+static unsigned int selected;
+
+// Masks compiled from the selected preset
+static unsigned int channel_motors[ROUTING_CHANNELS];
+
+// Arrangements for the songs we play, one channel per motor (unlisted motors stay off)
+static const unsigned char builtin_presets[][8] = {
+    {0, 1, 2, 3, 4, 5, 6, 7}, // Default - one motor per channel
+    {0, 0, 0, 0, 1, 1, 1, 1}, // Megalovaia (Simple), also Wii Channel Theme
+    {0, 0, 2, 2, 6, 6, 1, 3}, // Megalovaia (Complicated)
+    {0, 1, 3, 3, 3, 4, 4, 4}, // Never Gonna Give You Up
+};
+
+#define NUM_BUILTIN (sizeof(builtin_presets) / sizeof(builtin_presets[0]))
+
+static void compile(void) {
+    for (unsigned int c = 0; c < ROUTING_CHANNELS; c++) {
+        channel_motors[c] = 0;
+    }
+
+    for (unsigned int m = 0; m < ROUTING_MAX_MOTORS; m++) {
+        unsigned char channel = presets[selected][m];
+        if (channel < ROUTING_CHANNELS) channel_motors[channel] |= 1u << m;
+    }
+}
+
+void routing_init(unsigned int preset) {
+    for (unsigned int p = 0; p < ROUTING_PRESETS; p++) {
+        if (p < NUM_BUILTIN) routing_store(p, builtin_presets[p], sizeof(builtin_presets[p]));
+        else routing_store(p, builtin_presets[0], sizeof(builtin_presets[0]));
+    }
+
+    selected = (preset < ROUTING_PRESETS) ? preset : 0;
+    compile();
+}
+
+int routing_store(unsigned int preset, const unsigned char *motor_channels, unsigned int count) {
+    if (preset >= ROUTING_PRESETS) return 0;
+
+    for (unsigned int m = 0; m < ROUTING_MAX_MOTORS; m++) {
+        unsigned char channel = (m < count) ? motor_channels[m] : ROUTING_NONE;
+        presets[preset][m] = (channel < ROUTING_CHANNELS) ? channel : ROUTING_NONE;
+    }
+
+    if (preset == selected) compile();
+    return 1;
+}
+
+int routing_select(unsigned int preset) {
+    if (preset >= ROUTING_PRESETS) return 0;
+
+    selected = preset;
+    compile();
+    return 1;
+}
+
+unsigned int routing_selected(void) {
+    return selected;
+}
+
+unsigned int routing_motors(unsigned int channel) {
+    return (channel < ROUTING_CHANNELS) ? channel_motors[channel] : 0;
+}
+
+int routing_handle_sysex(const unsigned char *data, unsigned int len) {
+    if (len < 3 || data[0] != ROUTING_SYSEX_ID) return 0;
+
+    if (data[1] == ROUTING_SYSEX_STORE) {
+        return routing_store(data[2], &data[3], len - 3) && data[2] == selected;
+    } else if (data[1] == ROUTING_SYSEX_SELECT) {
+        return routing_select(data[2]);
+    }
+    return 0;
+}
+
+void routing_print(void) {
+    printf("Routing preset %d:", selected);
+    for (unsigned int m = 0; m < ROUTING_MAX_MOTORS; m++) {
+        if (presets[selected][m] < ROUTING_CHANNELS) printf(" %d:%d", m, presets[selected][m]);
+    }
+    printf("\n");
+}
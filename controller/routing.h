@@ -0,0 +1,55 @@
+// This file defines the channel to motor routing used in file mode
+// A routing table says which MIDI channel each motor follows; several tables are kept as presets
+// The selected preset is compiled into one bitmask of motors per channel, so fanning an event
+// out to its motors is a single lookup
+// Presets can be replaced at runtime (SysEx or console) so a new song does not need a rebuild
+
+#ifndef _ROUTING_H
+#define _ROUTING_H
+
+// Number of presets kept
+#define ROUTING_PRESETS 8
+
+// Number of MIDI channels
+#define ROUTING_CHANNELS 16
+
+// Most motors (logical voices) a table can route - one bit each in the channel masks
+#define ROUTING_MAX_MOTORS 32
+
+// Channel value for a motor that follows no channel
+#define ROUTING_NONE 0x7F
+
+// SysEx messages understood by `routing_handle_sysex` (payload between 0xF0 and 0xF7):
+//     7D 01 <preset> <channel for motor 0> <channel for motor 1> ...   store a preset
+//     7D 02 <preset>                                                  select a preset
+// 0x7D is the manufacturer ID reserved for non-commercial use; channels are 0-15 or ROUTING_NONE
+#define ROUTING_SYSEX_ID 0x7D
+#define ROUTING_SYSEX_STORE 0x01
+#define ROUTING_SYSEX_SELECT 0x02
+
+// Load the built-in presets and select `preset`
+void routing_init(unsigned int preset);
+
+// Replace a preset with a table of `count` motor channels (motors past `count` follow no channel)
+// Recompiles the masks if the preset is selected
+// Returns 1 on success, 0 if the preset number is out of range
+int routing_store(unsigned int preset, const unsigned char *motor_channels, unsigned int count);
+
+// Make `preset` the active routing
+// Returns 1 on success, 0 if the preset number is out of range
+int routing_select(unsigned int preset);
+
+// Number of the selected preset
+unsigned int routing_selected(void);
+
+// Bitmask of the motors following `channel` in the selected preset (bit m = motor m)
+unsigned int routing_motors(unsigned int channel);
+
+// Apply a SysEx payload if it is a routing message
+// Returns 1 if the selected routing may have changed, 0 otherwise
+int routing_handle_sysex(const unsigned char *data, unsigned int len);
+
+// Print the selected preset over UART
+void routing_print(void);
+
+#endif
@@ -0,0 +1,216 @@
+// This file implements the Standard MIDI File reader as defined in `smf.h`
+#include "smf.h"
+#include "midiparse.h"
+
+#define SMF_DEFAULT_TEMPO 500000 // 120 beats per minute
+
+#define META_EVENT 0xFF
+#define META_TEMPO 0x51
+#define META_END_OF_TRACK 0x2F
+#define SYSEX_EVENT 0xF0
+#define SYSEX_ESCAPE 0xF7
+
+static unsigned int read_u32(const unsigned char *p) {
+    return ((unsigned int) p[0] << 24) | ((unsigned int) p[1] << 16) | ((unsigned int) p[2] << 8) | p[3];
+}
+
+static unsigned int read_u16(const unsigned char *p) {
+    return (p[0] << 8) | p[1];
+}
+
+// Variable length quantity (7 bits per byte, most significant first, high bit = more to come)
+static unsigned int read_vlq(struct smf_track_t *track) {
+    unsigned int value = 0;
+    for (int i = 0; i < 4 && track->pos < track->end; i++) {
+        unsigned char byte = *track->pos++;
+        value = (value << 7) | (byte & 0x7F);
+        if (!(byte & 0x80)) return value;
+    }
+    return value;
+}
+
+// Read the delta time in front of the track's next event
+static void read_delta(struct smf_track_t *track) {
+    if (track->pos >= track->end) {
+        track->done = 1;
+        return;
+    }
+    track->next_tick += read_vlq(track);
+}
+
+// Skip `len` bytes, ending the track if that runs off its end
+static void skip(struct smf_track_t *track, unsigned int len) {
+    if (len > (unsigned int)(track->end - track->pos)) track->pos = track->end;
+    else track->pos += len;
+}
+
+// Time since the last tempo change, in units of 1 / `unit_ticks` microseconds
+// 64-bit product - a long stretch at a high resolution overflows 32 bits
+static unsigned long long scaled_since_tempo(const struct smf_t *smf, unsigned int tick) {
+    return (unsigned long long)(tick - smf->tempo_tick) * smf->tempo + smf->tempo_rem;
+}
+
+static unsigned int tick_to_time(const struct smf_t *smf, unsigned int tick) {
+    return smf->tempo_time + scaled_since_tempo(smf, tick) / smf->unit_ticks;
+}
+
+static void set_tempo(struct smf_t *smf, unsigned int tick, unsigned int tempo) {
+    if (smf->smpte || tempo == 0) return;
+
+    // Re-anchor the tempo map here so later times are computed from this change
+    unsigned long long scaled = scaled_since_tempo(smf, tick);
+    smf->tempo_time += scaled / smf->unit_ticks;
+    smf->tempo_rem = scaled % smf->unit_ticks;
+    smf->tempo_tick = tick;
+    smf->tempo = tempo;
+}
+
+void smf_rewind(struct smf_t *smf) {
+    // Track chunks follow the header, each "MTrk" <length> <events>
+    const unsigned char *p = smf->data + 8 + read_u32(smf->data + 4);
+    const unsigned char *end = smf->data + smf->len;
+
+    for (unsigned int t = 0; t < smf->num_tracks; t++) {
+        struct smf_track_t *track = &smf->tracks[t];
+        track->next_tick = 0;
+        track->status = 0;
+
+        if (end - p < 8) {
+            track->pos = track->end = end;
+            track->done = 1;
+            continue;
+        }
+
+        unsigned int len = read_u32(p + 4);
+        if (len > (unsigned int)(end - p - 8)) len = end - p - 8;
+
+        track->pos = p + 8;
+        track->end = p + 8 + len;
+        track->done = 0;
+        read_delta(track);
+        p = track->end;
+    }
+
+    if (smf->smpte) {
+        // Frames per second (stored negated) times ticks per frame = ticks per second
+        unsigned int fps = 256 - (smf->division >> 8);
+        smf->tempo = 1000000;
+        smf->unit_ticks = fps * (smf->division & 0xFF);
+    } else {
+        smf->tempo = SMF_DEFAULT_TEMPO;
+        smf->unit_ticks = smf->division;
+    }
+    smf->tempo_tick = 0;
+    smf->tempo_time = 0;
+    smf->tempo_rem = 0;
+}
+
+int smf_open(struct smf_t *smf, const unsigned char *data, unsigned int len) {
+    if (len < 14 || data[0] != 'M' || data[1] != 'T' || data[2] != 'h' || data[3] != 'd') return 0;
+    if (read_u32(data + 4) < 6 || 8 + read_u32(data + 4) > len) return 0;
+
+    smf->data = data;
+    smf->len = len;
+    smf->format = read_u16(data + 8);
+    smf->num_tracks = read_u16(data + 10);
+    smf->division = read_u16(data + 12);
+    smf->smpte = (smf->division & 0x8000) != 0;
+
+    // Format 2 tracks are independent songs, not parts to be merged
+    if (smf->format > 1 || smf->num_tracks == 0 || smf->num_tracks > SMF_MAX_TRACKS) return 0;
+    if (smf->division == 0 || (smf->smpte && (smf->division & 0xFF) == 0)) return 0;
+
+    smf_rewind(smf);
+    return 1;
+}
+
+// Data bytes taken by each channel message, indexed by the status high nibble - 8
+static const unsigned char channel_data_len[8] = {2, 2, 2, 2, 1, 1, 2, 0};
+
+int smf_next(struct smf_t *smf, struct midi_event_t *event, unsigned int *time) {
+    while (1) {
+        // Merge: the track whose next event comes first (earlier tracks win ties, as in the file)
+        struct smf_track_t *track = 0;
+        for (unsigned int t = 0; t < smf->num_tracks; t++) {
+            struct smf_track_t *candidate = &smf->tracks[t];
+            if (candidate->done) continue;
+            if (!track || (int)(candidate->next_tick - track->next_tick) < 0) track = candidate;
+        }
+        if (!track) return 0;
+
+        unsigned int tick = track->next_tick;
+        if (track->pos >= track->end) {
+            track->done = 1;
+            continue;
+        }
+
+        unsigned char status = *track->pos;
+        if (status & 0x80) {
+            track->pos++;
+        } else {
+            // Running status - data byte follows straight on
+            status = track->status;
+        }
+
+        if (status == META_EVENT) {
+            // Meta and SysEx events cancel running status - a data byte after one has no status to use
+            track->status = 0;
+            if (track->pos >= track->end) {
+                track->done = 1;
+                continue;
+            }
+            unsigned char type = *track->pos++;
+            unsigned int len = read_vlq(track);
+            if (type == META_TEMPO && len == 3 && track->end - track->pos >= 3) {
+                set_tempo(smf, tick, (track->pos[0] << 16) | (track->pos[1] << 8) | track->pos[2]);
+            }
+            skip(track, len);
+            if (type == META_END_OF_TRACK) track->done = 1;
+            else read_delta(track);
+            continue;
+        }
+
+        if (status == SYSEX_EVENT || status == SYSEX_ESCAPE) {
+            track->status = 0;
+            unsigned int len = read_vlq(track);
+            const unsigned char *payload = track->pos;
+            int complete = status == SYSEX_EVENT && len >= 1 && len - 1 <= MIDI_SYSEX_MAX &&
+                           len <= (unsigned int)(track->end - payload) && payload[len - 1] == SYSEX_ESCAPE;
+            skip(track, len);
+            read_delta(track);
+            if (!complete) continue;
+
+            // The routing messages travel in the song as SysEx, so pass the payload on without its 0xF7
+            event->action = MIDI_SYSTEM;
+            event->channel = MIDI_SYSEX & 0xF;
+            event->key = len - 1;
+            event->velocity = 0;
+            smf->sysex = payload;
+            *time = tick_to_time(smf, tick);
+            return 1;
+        }
+
+        if (status < 0x80 || status >= 0xF0) {
+            // No running status to use, or a system message that cannot appear in a file - give up on the track
+            track->done = 1;
+            continue;
+        }
+
+        track->status = status;
+        unsigned int needed = channel_data_len[(status >> 4) - 8];
+        if (track->end - track->pos < needed) {
+            track->done = 1;
+            continue;
+        }
+
+        event->action = status >> 4;
+        event->channel = status & 0xF;
+        event->key = track->pos[0];
+        event->velocity = (needed == 2) ? track->pos[1] : 0;
+        track->pos += needed;
+        read_delta(track);
+
+        *time = tick_to_time(smf, tick);
+        return 1;
+    }
+}
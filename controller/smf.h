@@ -0,0 +1,60 @@
+// This file defines a Standard MIDI File (format 0 and 1) reader
+// The file is read in place: every track keeps a pointer to its next event, and events are
+// merged across tracks one at a time in time order, so nothing is expanded into RAM
+// Event times follow the tempo map with integer math; the fraction of a microsecond left over at
+// each tempo change is carried forward, so rounding never accumulates over a song
+
+#ifndef _SMF_H
+#define _SMF_H
+
+#include "midi.h"
+
+// Most tracks a file may have
+#define SMF_MAX_TRACKS 16
+
+struct smf_track_t {
+    const unsigned char *pos;   // Next byte of the track
+    const unsigned char *end;
+    unsigned int next_tick;     // Absolute tick of the next event
+    unsigned char status;       // Running status
+    unsigned char done;
+};
+
+struct smf_t {
+    const unsigned char *data;
+    unsigned int len;
+    unsigned int format;
+    unsigned int num_tracks;
+    unsigned int division;      // Header time division: ticks per quarter note, or SMPTE frame rate and ticks per frame
+    unsigned int smpte;         // 1 if timing is in SMPTE frames (tempo changes are ignored)
+    unsigned int unit_ticks;    // Ticks per `tempo` microseconds (ticks per quarter note, or per second for SMPTE)
+    struct smf_track_t tracks[SMF_MAX_TRACKS];
+
+    // Tempo map position: the tempo in effect since `tempo_tick`, which was at
+    // `tempo_time` + `tempo_rem` / `unit_ticks` microseconds
+    unsigned int tempo;         // Microseconds per quarter note
+    unsigned int tempo_tick;
+    unsigned int tempo_time;
+    unsigned int tempo_rem;
+
+    const unsigned char *sysex; // Payload of the SysEx event last returned, in the file
+};
+
+// Check the header and start reading a file from the beginning
+// `data` must stay valid while the file is being read
+// Returns 1 on success, 0 if it is not a format 0 or 1 SMF (or has more than SMF_MAX_TRACKS tracks)
+int smf_open(struct smf_t *smf, const unsigned char *data, unsigned int len);
+
+// Go back to the start of the file
+void smf_rewind(struct smf_t *smf);
+
+// Get the next channel message or SysEx of the song, in time order across all tracks
+// A SysEx message comes out as the live parser reports one (see `midiparse.h`): MIDI_SYSTEM, channel 0,
+// the payload length between 0xF0 and 0xF7 as the key, the payload at `smf->sysex` - as long as it is
+// complete in one event and at most MIDI_SYSEX_MAX bytes
+// Tempo changes are applied along the way; other meta events and 0xF7 escapes are skipped
+// Returns 1 and fills in `*event` and `*time` (microseconds from the start of the song),
+// or 0 once every track has ended
+int smf_next(struct smf_t *smf, struct midi_event_t *event, unsigned int *time);
+
+#endif
@@ -0,0 +1,136 @@
+// This file implements the on-board song player as defined in `song.h`
+#include "song.h"
+#include "midi.h"
+#include "midiparse.h"
+#include "naj.h"
+#include "printf.h"
+#include "smf.h"
+#include "stream.h"
+#include "timer.h"
+#include "uart.h"
+
+#ifdef SONG_LINKED
+// Defined by songdata.S from the file given as SONG to make
+extern const unsigned char song_data[];
+extern const unsigned int song_size;
+#endif
+
+static unsigned char upload_buffer[SONG_UPLOAD_MAX];
+
+static struct smf_t song;
+static struct stream_t song_stream;
+static unsigned int is_stream;
+static unsigned int loaded;
+static unsigned int playing;
+
+// Shared time of the start of the song, and the next event waiting to be dispatched
+static unsigned int start_time;
+static struct midi_event_t next_event;
+static unsigned char next_motor; // Streams only - the event is a motor and key
+static unsigned char next_key;
+static unsigned int next_time;
+
+int song_init(void) {
+    loaded = 0;
+    playing = 0;
+
+#ifdef SONG_LINKED
+    return song_load(song_data, song_size);
+#else
+    return 0;
+#endif
+}
+
+int song_load(const unsigned char *data, unsigned int len) {
+    song_stop();
+
+    is_stream = stream_detect(data, len);
+    if (is_stream) {
+        loaded = stream_open(&song_stream, data, len);
+        if (loaded) printf("Song: stream of %d events for %d motors\n", song_stream.events, song_stream.motors);
+    } else {
+        loaded = smf_open(&song, data, len);
+        if (loaded) printf("Song: format %d, %d tracks, division %d\n", song.format, song.num_tracks, song.division);
+    }
+
+    if (!loaded) printf("Song: not a playable MIDI file or stream\n");
+    return loaded;
+}
+
+// Next byte of an upload, or -1 if none comes within SONG_UPLOAD_TIMEOUT
+static int upload_getchar(void) {
+    unsigned int start = timer_get_ticks();
+    while (!uart_haschar()) {
+        if (timer_get_ticks() - start >= SONG_UPLOAD_TIMEOUT) return -1;
+    }
+    return uart_getchar();
+}
+
+int song_upload(void) {
+    unsigned int len = 0;
+    for (int i = 0; i < 4; i++) {
+        int ch = upload_getchar();
+        if (ch < 0) {
+            printf("Song: upload timed out waiting for the length\n");
+            return 0;
+        }
+        len |= ch << (8 * i);
+    }
+
+    if (len > SONG_UPLOAD_MAX) {
+        printf("Song: %d bytes is too big (max %d)\n", len, SONG_UPLOAD_MAX);
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < len; i++) {
+        int ch = upload_getchar();
+        if (ch < 0) {
+            printf("Song: upload timed out after %d of %d bytes\n", i, len);
+            return 0;
+        }
+        upload_buffer[i] = ch;
+    }
+    return song_load(upload_buffer, len);
+}
+
+static void fetch_next_event(void) {
+    if (is_stream) playing = stream_next(&song_stream, &next_motor, &next_key, &next_time);
+    else playing = smf_next(&song, &next_event, &next_time);
+    if (!playing) printf("Song: finished\n");
+}
+
+void song_start(void) {
+    if (!loaded) return;
+    if (playing) song_stop();
+
+    if (is_stream) stream_rewind(&song_stream);
+    else smf_rewind(&song);
+    start_time = naj_time() + SONG_LOOKAHEAD;
+    fetch_next_event();
+}
+
+void song_stop(void) {
+    if (!playing) return;
+
+    playing = 0;
+    midi_all_off();
+}
+
+int song_playing(void) {
+    return playing;
+}
+
+void song_poll(unsigned char *motor_array, unsigned int size) {
+    if (!playing) return;
+
+    unsigned int dispatched = 0;
+    while (playing && (int)(start_time + next_time - naj_time()) <= SONG_LOOKAHEAD) {
+        if (is_stream) midi_set_motor_at(next_motor, next_key, start_time + next_time);
+        else if (next_event.action == MIDI_SYSTEM && next_event.channel == (MIDI_SYSEX & 0xF)) midi_handle_sysex(song.sysex, next_event.key);
+        else midi_update_motors_at(next_event, motor_array, size, start_time + next_time);
+        dispatched = 1;
+        fetch_next_event();
+    }
+
+    if (dispatched) midi_flush_motors();
+}
@@ -0,0 +1,45 @@
+// This file defines the on-board song player
+// Plays a Standard MIDI File, or a motor event stream made by `tools/arranger` (see stream.h),
+// linked into the program (build with `make SONG=path/to/song.mid`) or uploaded over the
+// console UART, with no computer needed while it plays
+// MIDI files go through the usual routing or voice allocation; streams set the motors directly
+// Events are handed to `midi_update_motors_at` a little ahead of time with their exact shared
+// time, so the motor board starts every note from its timer interrupt
+
+#ifndef _SONG_H
+#define _SONG_H
+
+// Events are dispatched this many microseconds before they are due
+#define SONG_LOOKAHEAD 5000
+
+// Largest file that can be uploaded over UART
+#define SONG_UPLOAD_MAX 65536
+
+// Microseconds an upload waits for its next byte before giving up
+#define SONG_UPLOAD_TIMEOUT 2000000
+
+// Load the linked song, if there is one
+// Returns 1 if a song is ready to play, 0 otherwise
+int song_init(void);
+
+// Load a song from memory (which must stay valid while it plays)
+// Returns 1 on success, 0 if the data is not a playable SMF or stream
+int song_load(const unsigned char *data, unsigned int len);
+
+// Receive a song over the console UART: 4 byte little endian length, then the file
+// Returns 1 on success, 0 if it was too big, stopped for SONG_UPLOAD_TIMEOUT, or is not a playable SMF or stream
+int song_upload(void);
+
+// Start playing the loaded song from the beginning
+void song_start(void);
+
+// Stop playing and turn every motor off
+void song_stop(void);
+
+// Returns 1 while a song is playing
+int song_playing(void);
+
+// Dispatch every event due within the lookahead - call often from the main loop
+void song_poll(unsigned char *motor_array, unsigned int size);
+
+#endif
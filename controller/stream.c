@@ -0,0 +1,44 @@
+// This file implements the motor event stream reader as defined in `stream.h`
+#include "stream.h"
+
+int stream_detect(const unsigned char *data, unsigned int len) {
+    return len >= STREAM_HEADER_SIZE && data[0] == 'M' && data[1] == 'S' && data[2] == 'T' && data[3] == 'R';
+}
+
+int stream_open(struct stream_t *stream, const unsigned char *data, unsigned int len) {
+    if (!stream_detect(data, len) || data[4] != STREAM_VERSION) return 0;
+
+    stream->data = data;
+    stream->end = data + len;
+    stream->motors = data[5];
+    stream->events = data[8] | (data[9] << 8) | (data[10] << 16) | ((unsigned int) data[11] << 24);
+    stream_rewind(stream);
+    return 1;
+}
+
+void stream_rewind(struct stream_t *stream) {
+    stream->pos = stream->data + STREAM_HEADER_SIZE;
+    stream->time = 0;
+}
+
+int stream_next(struct stream_t *stream, unsigned char *motor, unsigned char *key, unsigned int *time) {
+    unsigned int delta = 0;
+    unsigned int shift = 0;
+
+    while (1) {
+        if (stream->pos >= stream->end || shift > 28) return 0;
+        unsigned char byte = *stream->pos++;
+        delta |= (byte & 0x7F) << shift;
+        shift += 7;
+        if (!(byte & 0x80)) break;
+    }
+
+    if (stream->end - stream->pos < 2) return 0;
+    *motor = stream->pos[0];
+    *key = stream->pos[1];
+    stream->pos += 2;
+
+    stream->time += delta;
+    *time = stream->time;
+    return 1;
+}
@@ -0,0 +1,42 @@
+// This file defines the precomputed motor event stream played by the controller
+// Streams are made offline by `tools/arranger` from a MIDI file: every note already has its motor,
+// so playing one takes no allocation decisions at all
+//
+// Format (all multi-byte header fields little endian):
+//     header: 'M' 'S' 'T' 'R' | version | motors | 0 | 0 | event count (4 bytes)
+//     events: delta time (variable length, see below) | motor | key
+// The delta time is the microseconds since the previous event, 7 bits per byte, least significant
+// group first, high bit set on every byte but the last; key is a piano key index (0 = A0) or
+// STREAM_KEY_OFF
+
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#define STREAM_VERSION 1
+#define STREAM_HEADER_SIZE 12
+#define STREAM_KEY_OFF 0xFF
+
+struct stream_t {
+    const unsigned char *data;
+    const unsigned char *pos;
+    const unsigned char *end;
+    unsigned int motors;
+    unsigned int events;
+    unsigned int time;  // Time of the last event read, in microseconds from the start
+};
+
+// Returns 1 if `data` starts with a stream header
+int stream_detect(const unsigned char *data, unsigned int len);
+
+// Check the header and start reading a stream from the beginning
+// Returns 1 on success, 0 if it is not a stream of this version
+int stream_open(struct stream_t *stream, const unsigned char *data, unsigned int len);
+
+// Go back to the start of the stream
+void stream_rewind(struct stream_t *stream);
+
+// Read the next event
+// Returns 1 and fills in `*motor`, `*key` and `*time` (microseconds from the start), or 0 at the end
+int stream_next(struct stream_t *stream, unsigned char *motor, unsigned char *key, unsigned int *time);
+
+#endif
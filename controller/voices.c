@@ -0,0 +1,150 @@
+// This file implements the voice allocator as defined in `voices.h`
+#include "voices.h"
+
+static void list_append(struct voices_t *voices, unsigned char voice) {
+    voices->older[voice] = voices->newest;
+    voices->newer[voice] = VOICES_NONE;
+
+    if (voices->newest == VOICES_NONE) voices->oldest = voice;
+    else voices->newer[voices->newest] = voice;
+    voices->newest = voice;
+}
+
+static void list_remove(struct voices_t *voices, unsigned char voice) {
+    unsigned char older = voices->older[voice];
+    unsigned char newer = voices->newer[voice];
+
+    if (older == VOICES_NONE) voices->oldest = newer;
+    else voices->newer[older] = newer;
+
+    if (newer == VOICES_NONE) voices->newest = older;
+    else voices->older[newer] = older;
+}
+
+void voices_init(struct voices_t *voices, unsigned int count, unsigned int motors, unsigned int policy) {
+    voices->count = (count > VOICES_MAX) ? VOICES_MAX : count;
+    voices->motors = (motors == 0 || motors > voices->count) ? voices->count : motors;
+    voices->policy = policy;
+
+    for (unsigned int key = 0; key < VOICES_KEYS; key++) {
+        voices->key_to_voice[key] = VOICES_NONE;
+    }
+
+    // Stack the free list so voice 0 is handed out first
+    voices->free_count = voices->count;
+    for (unsigned int i = 0; i < voices->count; i++) {
+        voices->free_list[i] = voices->count - 1 - i;
+        voices->voice_key[i] = VOICES_NONE;
+        voices->motor_notes[i] = 0;
+    }
+
+    voices->oldest = VOICES_NONE;
+    voices->newest = VOICES_NONE;
+
+    voices->notes = 0;
+    voices->steals = 0;
+    voices->drops = 0;
+    voices->retriggers = 0;
+}
+
+void voices_set_policy(struct voices_t *voices, unsigned int policy) {
+    voices->policy = policy;
+}
+
+// Take the free voice on the motor playing the fewest notes, most recently freed among equals
+// The search stops at the first voice on an idle motor, which without time-sharing is the first one
+static unsigned char take_free(struct voices_t *voices) {
+    unsigned int best = voices->free_count - 1;
+    unsigned int best_notes = voices->motor_notes[voices->free_list[best] % voices->motors];
+    for (unsigned int i = best; i-- > 0 && best_notes > 0;) {
+        unsigned int notes = voices->motor_notes[voices->free_list[i] % voices->motors];
+        if (notes < best_notes) {
+            best = i;
+            best_notes = notes;
+        }
+    }
+
+    // Fill the hole with the top of the stack
+    unsigned char voice = voices->free_list[best];
+    voices->free_list[best] = voices->free_list[--voices->free_count];
+    voices->motor_notes[voice % voices->motors]++;
+    return voice;
+}
+
+// Pick the sounding voice to steal for `key`, or VOICES_NONE if the policy does not steal
+// Oldest is the head of the list; the other policies look at every voice (at most VOICES_MAX),
+// walking oldest first so ties go to the voice that has sounded longest
+static unsigned char pick_victim(const struct voices_t *voices, unsigned char key) {
+    if (voices->policy == VOICES_STEAL_OLDEST) return voices->oldest;
+    if (voices->policy != VOICES_STEAL_QUIETEST && voices->policy != VOICES_STEAL_CLOSEST) return VOICES_NONE;
+
+    unsigned char best = VOICES_NONE;
+    int best_score = 0;
+    for (unsigned char v = voices->oldest; v != VOICES_NONE; v = voices->newer[v]) {
+        int score;
+        if (voices->policy == VOICES_STEAL_QUIETEST) {
+            score = voices->voice_velocity[v];
+        } else {
+            score = voices->voice_key[v] - key;
+            if (score < 0) score = -score;
+        }
+
+        if (best == VOICES_NONE || score < best_score) {
+            best = v;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+unsigned char voices_note_on(struct voices_t *voices, unsigned char key, unsigned char velocity, unsigned char *stolen_key) {
+    *stolen_key = VOICES_NONE;
+    if (key >= VOICES_KEYS) return VOICES_NONE;
+    voices->notes++;
+
+    unsigned char voice = voices->key_to_voice[key];
+    if (voice != VOICES_NONE) {
+        // Key pressed again before its note-off - restart it on the same voice
+        voices->retriggers++;
+        list_remove(voices, voice);
+    } else if (voices->free_count > 0) {
+        voice = take_free(voices);
+    } else {
+        voice = pick_victim(voices, key);
+        if (voice == VOICES_NONE) {
+            voices->drops++;
+            return VOICES_NONE;
+        }
+
+        voices->steals++;
+        *stolen_key = voices->voice_key[voice];
+        voices->key_to_voice[*stolen_key] = VOICES_NONE;
+        list_remove(voices, voice);
+    }
+
+    voices->key_to_voice[key] = voice;
+    voices->voice_key[voice] = key;
+    voices->voice_velocity[voice] = velocity;
+    list_append(voices, voice);
+    return voice;
+}
+
+unsigned char voices_note_off(struct voices_t *voices, unsigned char key) {
+    if (key >= VOICES_KEYS) return VOICES_NONE;
+
+    unsigned char voice = voices->key_to_voice[key];
+    if (voice == VOICES_NONE) return VOICES_NONE;
+
+    voices->key_to_voice[key] = VOICES_NONE;
+    voices->voice_key[voice] = VOICES_NONE;
+    list_remove(voices, voice);
+    voices->free_list[voices->free_count++] = voice;
+    voices->motor_notes[voice % voices->motors]--;
+    return voice;
+}
+
+void voices_all_off(struct voices_t *voices) {
+    while (voices->oldest != VOICES_NONE) {
+        voices_note_off(voices, voices->voice_key[voices->oldest]);
+    }
+}
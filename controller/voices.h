@@ -0,0 +1,80 @@
+// This file defines the voice allocator used to assign live notes to motors
+// Each motor (or time-shared slot of a motor) is one voice. Free voices sit on a free list, sounding voices are kept in the order
+// they started, and a 128-entry table maps every MIDI key to the voice playing it
+// so note-off takes constant time, and note-on too unless motors are time-shared
+// Voices that time-share a motor play in turns, so a new note goes to a free voice on the motor
+// playing the fewest notes: a shared slot is only used once every motor is busy
+// When every voice is busy, a new note steals one according to the stealing policy
+// The state is a few hundred bytes and nothing is allocated
+
+#ifndef _VOICES_H
+#define _VOICES_H
+
+// Maximum number of voices the allocator can manage (one per motor, or per time slot of a motor,
+// across every motor board on the bus)
+#define VOICES_MAX 128
+
+// Returned when no voice is involved
+#define VOICES_NONE 0xFF
+
+// Number of MIDI keys
+#define VOICES_KEYS 128
+
+// Voice stealing policies - which sounding voice to give to a new note when none are free
+#define VOICES_STEAL_NONE 0     // Drop the new note
+#define VOICES_STEAL_OLDEST 1   // Voice that started longest ago
+#define VOICES_STEAL_QUIETEST 2 // Voice with the lowest velocity (oldest among equals)
+#define VOICES_STEAL_CLOSEST 3  // Voice playing the key nearest the new one (keeps lines moving smoothly)
+
+struct voices_t {
+    unsigned char count;
+    unsigned char policy;
+
+    unsigned char key_to_voice[VOICES_KEYS]; // Voice playing each key, or VOICES_NONE
+    unsigned char voice_key[VOICES_MAX];     // Key played by each voice, or VOICES_NONE
+    unsigned char voice_velocity[VOICES_MAX];
+
+    // Free voices, used as a stack
+    unsigned char free_list[VOICES_MAX];
+    unsigned char free_count;
+
+    // Physical motors: voice v plays on motor v % motors, in turn with the other voices there
+    unsigned char motors;
+    unsigned char motor_notes[VOICES_MAX];   // Sounding voices on each motor
+
+    // Sounding voices in the order they started (doubly linked, oldest first)
+    unsigned char older[VOICES_MAX];
+    unsigned char newer[VOICES_MAX];
+    unsigned char oldest;
+    unsigned char newest;
+
+    // Statistics
+    unsigned int notes;
+    unsigned int steals;
+    unsigned int drops;
+    unsigned int retriggers;
+};
+
+// Reset the allocator with `count` free voices (at most VOICES_MAX) on `motors` physical motors, and
+// a stealing policy
+// Voice v plays on motor v % `motors` (0, or `count` or more, for a motor of its own per voice)
+void voices_init(struct voices_t *voices, unsigned int count, unsigned int motors, unsigned int policy);
+
+// Change the stealing policy without disturbing the sounding notes
+void voices_set_policy(struct voices_t *voices, unsigned int policy);
+
+// Start a note
+// Returns the voice that should play `key`, or VOICES_NONE if the note was dropped
+// A key that is already sounding keeps its voice (retrigger) instead of taking a second one
+// If a voice was stolen, `*stolen_key` is set to the key it stopped playing, otherwise VOICES_NONE
+unsigned char voices_note_on(struct voices_t *voices, unsigned char key, unsigned char velocity, unsigned char *stolen_key);
+
+// Release a note
+// Returns the voice that was playing `key` (now free), or VOICES_NONE if the key was not sounding
+// (it may have been stolen or dropped)
+unsigned char voices_note_off(struct voices_t *voices, unsigned char key);
+
+// Release every note
+void voices_all_off(struct voices_t *voices);
+
+#endif
@@ -0,0 +1,67 @@
+// This file implements the fill and copy kernels as defined in `blit.h`
+#include "blit.h"
+
+// Two pixels, stored with one doubleword access (may alias the pixels it covers)
+typedef unsigned long long pair_t __attribute__((may_alias));
+
+#define PAIR_ALIGNED(p) (((unsigned long) (p) & (sizeof(pair_t) - 1)) == 0)
+
+static void fill_row(unsigned int *dst, unsigned int n, unsigned int color) {
+    if (n > 0 && !PAIR_ALIGNED(dst)) {
+        *dst++ = color;
+        n--;
+    }
+
+    pair_t pair = ((pair_t) color << 32) | color;
+    pair_t *p = (pair_t *) dst;
+    for (; n >= 8; n -= 8) {
+        p[0] = pair;
+        p[1] = pair;
+        p[2] = pair;
+        p[3] = pair;
+        p += 4;
+    }
+    for (; n >= 2; n -= 2) {
+        *p++ = pair;
+    }
+    if (n > 0) *(unsigned int *) p = color;
+}
+
+static void copy_row(unsigned int *dst, const unsigned int *src, unsigned int n) {
+    if (PAIR_ALIGNED(dst) != PAIR_ALIGNED(src)) {
+        while (n-- > 0) *dst++ = *src++;
+        return;
+    }
+    if (n > 0 && !PAIR_ALIGNED(dst)) {
+        *dst++ = *src++;
+        n--;
+    }
+
+    pair_t *p = (pair_t *) dst;
+    const pair_t *q = (const pair_t *) src;
+    for (; n >= 8; n -= 8) {
+        p[0] = q[0];
+        p[1] = q[1];
+        p[2] = q[2];
+        p[3] = q[3];
+        p += 4;
+        q += 4;
+    }
+    for (; n >= 2; n -= 2) {
+        *p++ = *q++;
+    }
+    if (n > 0) *(unsigned int *) p = *(const unsigned int *) q;
+}
+
+void blit_fill(unsigned int *dst, unsigned int pitch, unsigned int w, unsigned int h, unsigned int color) {
+    for (unsigned int i = 0; i < h; i++) {
+        fill_row(dst + i * pitch, w, color);
+    }
+}
+
+void blit_copy(unsigned int *dst, unsigned int dst_pitch, const unsigned int *src, unsigned int src_pitch,
+               unsigned int w, unsigned int h) {
+    for (unsigned int i = 0; i < h; i++) {
+        copy_row(dst + i * dst_pitch, src + i * src_pitch, w);
+    }
+}
@@ -0,0 +1,19 @@
+// This file defines the fill and copy kernels used to draw the visualizer's keyboard and notes
+// Pixels are 32 bits; the kernels store two at a time as 64-bit doublewords (the ARM1176 has no NEON,
+// but moves a doubleword per STRD/LDRD), with one single pixel at either end of a row that is not
+// doubleword aligned
+// Everything here is pure computation on memory, so it can be tested and timed on the host
+// Nothing is clipped - the caller keeps every rectangle inside both buffers
+
+#ifndef _BLIT_H
+#define _BLIT_H
+
+// Fill a `w` by `h` rectangle starting at `dst` (rows `pitch` pixels apart) with `color`
+void blit_fill(unsigned int *dst, unsigned int pitch, unsigned int w, unsigned int h, unsigned int color);
+
+// Copy a `w` by `h` rectangle from `src` (rows `src_pitch` pixels apart) to `dst` (rows `dst_pitch` apart)
+// Rows that are aligned differently in the two buffers are copied a pixel at a time
+void blit_copy(unsigned int *dst, unsigned int dst_pitch, const unsigned int *src, unsigned int src_pitch,
+               unsigned int w, unsigned int h);
+
+#endif
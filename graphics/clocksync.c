@@ -0,0 +1 @@
+../motors/clocksync.c
\ No newline at end of file
@@ -9,11 +9,26 @@
 #include "malloc.h"
 #include "naj.h"
 #include "interrupts.h"
+#include "scroll.h"
+#include "panfb.h"
+#include "blit.h"
 
 
-#define NUM_MOTORS 8
+#define NUM_MOTORS (NAJ_MAX_VOICES * NAJ_MAX_BOARDS) // One entry per voice of the whole pool, coloured by the motor that plays it
 #define MOTOR_OFF 0xff
 #define FRAME_DURATION 10000
+#define NUM_KEYS 88
+
+// Set to 0 to clear and redraw the whole screen every frame instead of repainting only what changed
+#define INCREMENTAL_DRAW 1
+
+// Set to 1 to scroll the notes by panning a framebuffer twice the screen's width and height (see `scroll.h`),
+// drawing only the rows newly exposed under the keyboard each frame - overrides INCREMENTAL_DRAW
+#define PANNED_SCROLL 0
+
+// Set to 1 to print frame drawing times once every FRAME_LOG_PERIOD frames
+#define FRAME_LOG 1
+#define FRAME_LOG_PERIOD 100
 
 const int DEPTH = 4;
 const int display_scaler = 10; 
@@ -23,161 +38,557 @@ const int height = 100;
 const int key_height = 4 * display_scaler; 
 const int key_width  = 1 * display_scaler; 
 
-const int box_height = 1 * display_scaler;
 const int box_width  = key_width;
 
 const color_t colors[] = {GL_RED, GL_ORANGE, GL_YELLOW, GL_GREEN, GL_CYAN, GL_MAGENTA, GL_PURPLE, GL_SILVER};
 
-int motor_notes[100][NUM_MOTORS];
+// The keyboard is drawn once, at start up, into off-screen sprites - bare, and with every key pressed
+// in each voice colour - and keys are copied from them a row at a time (see `blit.h`) rather than drawn
+color_t *idle_keyboard;
+color_t *pressed_keyboards[NAJ_MOTORS];
+const color_t *key_sprites[NUM_KEYS]; // Sprite each key is showing
 
-void color_boxs(int *arr, int row) {
-    for (int i = 0; i < 8; i++) {
-        int index = arr[i]; 
-        // color keys based on index
-        if (index >= 0 && index <= 87 && index != MOTOR_OFF) {
-            int box_x = index * display_scaler;
-            int box_y = key_height + ((row - 1) * display_scaler);
-            gl_draw_rect(box_x, box_y, box_width, box_height, colors[i]);
+// Rows of note history drawn falling below the keyboard, each FRAME_DURATION long (96 fill the screen)
+#define SCROLL_ROWS 96
+
+// Depth of the note area below the keyboard, in shared time
+#define SCROLL_DEPTH (SCROLL_ROWS * FRAME_DURATION)
+
+// Notes are kept as spans - one per note played - and each is drawn as a single rectangle whose
+// length is the note's duration, so drawing costs one call per visible note however long it is held
+#define MAX_SPANS 512
+#define NO_SPAN 0xFFFF
+
+struct note_span_t {
+    unsigned int start; // Shared time the note started
+    unsigned int end;   // Shared time the note ended (if it is no longer open)
+    unsigned char key;
+    unsigned char voice;
+    unsigned char open; // Still sounding
+    short drawn_top;    // Rectangle at the last frame (top == bottom when it was not visible)
+    short drawn_bottom;
+};
+
+// Ring of spans in the order they started; the oldest are dropped once they have scrolled off
+struct note_span_t spans[MAX_SPANS];
+unsigned int span_head;  // Where the next span goes
+unsigned int span_count;
+
+// Current state: the key each voice is playing (or MOTOR_OFF), and its open span (or NO_SPAN)
+unsigned char voice_notes[NUM_MOTORS];
+unsigned short voice_spans[NUM_MOTORS];
+
+// Damage tracking for the incremental renderer
+// Every change to the picture is recorded as a vertical interval of one key's column, once for each
+// of the two framebuffer pages, since each page still shows the picture from two frames back
+// Each column keeps a few disjoint intervals - more are merged into the nearest
+#define DAMAGE_SLOTS 4
+
+struct damage_t {
+    unsigned int count;
+    short top[DAMAGE_SLOTS];
+    short bottom[DAMAGE_SLOTS];
+};
+
+struct damage_t damage[2][NUM_KEYS];
+unsigned int draw_page; // Page being drawn (the one not on screen)
+
+// Colour each key is showing (pressed in its voice's colour, or the bare piano key)
+color_t key_colors[NUM_KEYS];
+color_t drawn_key_colors[NUM_KEYS];
+
+void damage_page(struct damage_t *d, int top, int bottom) {
+    // Absorb every interval the new one touches, then make room by merging if the column is full
+    unsigned int i = 0;
+    while (i < d->count) {
+        if (top <= d->bottom[i] && bottom >= d->top[i]) {
+            if (d->top[i] < top) top = d->top[i];
+            if (d->bottom[i] > bottom) bottom = d->bottom[i];
+            d->count--;
+            d->top[i] = d->top[d->count];
+            d->bottom[i] = d->bottom[d->count];
+            i = 0;
+            continue;
         }
+        i++;
     }
-}
 
-void color_piano() {
-    int ten_counter = 0; 
-    for (int r = 0; r < 3; r++) {
-        gl_draw_rect(ten_counter, 0, key_width, key_height, (r % 2 == 0) ? GL_WHITE : GL_BLACK);
-        ten_counter += key_width;  
-    }
-    for (int i = 0; i < 7; i++) {
-        for (int j = 0; j < 5; j++) {
-            gl_draw_rect(ten_counter, 0, key_width, key_height, (j % 2 == 0) ? GL_WHITE : GL_BLACK); 
-            ten_counter += key_width;  
+    if (d->count == DAMAGE_SLOTS) {
+        // Merge with the nearest interval - repaints a little more, never less
+        unsigned int nearest = 0;
+        int nearest_gap = 0x7FFF;
+        for (i = 0; i < d->count; i++) {
+            int gap = (d->top[i] > bottom) ? d->top[i] - bottom : top - d->bottom[i];
+            if (gap < nearest_gap) {
+                nearest_gap = gap;
+                nearest = i;
+            }
         }
-        for (int k = 0; k < 7; k++) {
-            gl_draw_rect(ten_counter, 0, key_width, key_height, (k % 2 == 0) ? GL_WHITE : GL_BLACK); 
-            ten_counter += key_width;  
+        if (d->top[nearest] < top) top = d->top[nearest];
+        if (d->bottom[nearest] > bottom) bottom = d->bottom[nearest];
+        d->count--;
+        d->top[nearest] = d->top[d->count];
+        d->bottom[nearest] = d->bottom[d->count];
+        damage_page(d, top, bottom);
+        return;
+    }
+
+    d->top[d->count] = top;
+    d->bottom[d->count] = bottom;
+    d->count++;
+}
+
+void damage_add(int key, int top, int bottom) {
+    if (bottom <= top) return;
+    damage_page(&damage[0][key], top, bottom);
+    damage_page(&damage[1][key], top, bottom);
+}
+
+void damage_span_change(int key, int old_top, int old_bottom, int top, int bottom) {
+    // Only the difference between the old and new rectangles changes: usually a strip at each end
+    if (old_top == top && old_bottom == bottom) return;
+    if (old_bottom <= old_top || bottom <= top || old_bottom <= top || bottom <= old_top) {
+        damage_add(key, old_top, old_bottom);
+        damage_add(key, top, bottom);
+        return;
+    }
+    damage_add(key, (old_top < top) ? old_top : top, (old_top < top) ? top : old_top);
+    damage_add(key, (old_bottom < bottom) ? old_bottom : bottom, (old_bottom < bottom) ? bottom : old_bottom);
+}
+
+void drop_old_spans(unsigned int now) {
+    // Oldest spans go once they have ended and scrolled out of view
+    while (span_count > 0) {
+        struct note_span_t *span = &spans[(span_head + MAX_SPANS - span_count) % MAX_SPANS];
+        if (span->open || (int)(now - span->end) < SCROLL_DEPTH) break;
+        span_count--;
+    }
+}
+
+unsigned int voice_color(unsigned int voice) {
+    // Index into `colors` of a pool voice: the motor that plays it on its board
+    return naj_pool_voice(voice, naj_board_count()) % NAJ_MOTORS;
+}
+
+void set_voice_note(unsigned char voice, unsigned char key, unsigned int time) {
+    // Close the span of the note the voice was playing and open one for its new note
+    if (voice >= NUM_MOTORS || voice_notes[voice] == key) return;
+
+    unsigned short open = voice_spans[voice];
+    if (open != NO_SPAN) {
+        spans[open].end = time;
+        spans[open].open = 0;
+        voice_spans[voice] = NO_SPAN;
+    }
+
+    voice_notes[voice] = key;
+    if (key > 87) return;
+
+    // A full ring overwrites its oldest span, which may still be open
+    if (span_count == MAX_SPANS) {
+        struct note_span_t *oldest = &spans[span_head];
+        if (oldest->open && voice_spans[oldest->voice] == span_head) voice_spans[oldest->voice] = NO_SPAN;
+        damage_add(oldest->key, oldest->drawn_top, oldest->drawn_bottom);
+        span_count--;
+    }
+
+    struct note_span_t *span = &spans[span_head];
+    span->start = time;
+    span->key = key;
+    span->voice = voice;
+    span->open = 1;
+    span->drawn_top = 0;
+    span->drawn_bottom = 0;
+    voice_spans[voice] = span_head;
+    span_head = (span_head + 1) % MAX_SPANS;
+    span_count++;
+}
+
+struct note_span_t *span_at(unsigned int i) {
+    // Span `i` of the ring, oldest first
+    return &spans[(span_head + MAX_SPANS - span_count + i) % MAX_SPANS];
+}
+
+int span_rect(const struct note_span_t *span, unsigned int now, int *top, int *bottom) {
+    // Rectangle of a span at time `now`: its bottom edge is where it started, scrolled down by its age,
+    // and its top edge where it ended (the keyboard for notes still sounding)
+    // Returns 0 if none of it is in view
+    int age_start = now - span->start;
+    int age_end = span->open ? 0 : (int)(now - span->end);
+    *top = *bottom = 0;
+    if (age_start <= 0 || age_end >= SCROLL_DEPTH) return 0;
+
+    if (age_end < 0) age_end = 0;
+    if (age_start > SCROLL_DEPTH) age_start = SCROLL_DEPTH;
+    *top = key_height + age_end * display_scaler / FRAME_DURATION;
+    *bottom = key_height + age_start * display_scaler / FRAME_DURATION;
+    return *bottom > *top;
+}
+
+void color_spans(unsigned int now) {
+    // One rectangle per visible span
+    for (unsigned int i = 0; i < span_count; i++) {
+        struct note_span_t *span = span_at(i);
+        int top, bottom;
+        if (span_rect(span, now, &top, &bottom)) {
+            gl_draw_rect(span->key * display_scaler, top, box_width, bottom - top, colors[voice_color(span->voice)]);
         }
     }
-    gl_draw_rect(ten_counter, 0, key_width, key_height, GL_WHITE);
-    ten_counter += key_width; 
 }
 
-void color_keys(int *arr) {
-    for (int i = 0; i < 8; i++) {
+void color_piano() {
+    // The bare keyboard, copied from its sprite
+    unsigned int pitch = fb_get_pitch() / sizeof(color_t);
+    blit_copy(fb_get_draw_buffer(), pitch, idle_keyboard, NUM_KEYS * key_width, NUM_KEYS * key_width, key_height);
+}
+
+void draw_key(int key, const color_t *sprite, int top, int bottom) {
+    // Copy rows `top` to `bottom` of a key from a keyboard sprite to the page being drawn
+    unsigned int pitch = fb_get_pitch() / sizeof(color_t);
+    color_t *page = fb_get_draw_buffer();
+    blit_copy(page + top * pitch + key * key_width, pitch, sprite + top * NUM_KEYS * key_width + key * key_width,
+              NUM_KEYS * key_width, key_width, bottom - top);
+}
+
+void color_keys(unsigned char *arr) {
+    for (int i = 0; i < NUM_MOTORS; i++) {
         int index = arr[i]; 
         // color keys based on index
         if (index >= 0 && index <= 87 && index != MOTOR_OFF) {
-            int key_x = index * display_scaler; // x-cor of pressed key 
-            int key_y = 0 * display_scaler;     // y-cor of pressed key
+            // color pressed key from the sprite of its voice's colour
+            draw_key(index, pressed_keyboards[voice_color(i)], 0, key_height);
+        }
+    }
+}
+
+color_t piano_color(int key) {
+    // Colour of a key with nothing playing, as drawn into the bare keyboard sprite
+    if (key < 3) return (key % 2 == 0) ? GL_WHITE : GL_BLACK;
+    int pos = (key - 3) % 12;
+    if (pos < 5) return (pos % 2 == 0) ? GL_WHITE : GL_BLACK;
+    return ((pos - 5) % 2 == 0) ? GL_WHITE : GL_BLACK;
+}
 
-            // color/uncolor pressed key red depending on indicator
-            gl_draw_rect(key_x, key_y, key_width, key_height, colors[i]);
+void update_key_colors(void) {
+    // Pressed keys - a key played by several voices shows the last one, as `color_keys` draws it
+    for (int key = 0; key < NUM_KEYS; key++) {
+        key_colors[key] = piano_color(key);
+        key_sprites[key] = idle_keyboard;
+    }
+    for (int i = 0; i < NUM_MOTORS; i++) {
+        if (voice_notes[i] < NUM_KEYS) {
+            key_colors[voice_notes[i]] = colors[voice_color(i)];
+            key_sprites[voice_notes[i]] = pressed_keyboards[voice_color(i)];
         }
     }
 }
 
-static void handle_naj_byte(void){
-    // Helper function to read and process a byte being received over naj
-    static unsigned int bytes_received = 0;
-    static unsigned char note_num;
-    static unsigned char motor_num;
+void build_sprites(void) {
+    // Draw the bare keyboard, and one keyboard with every key pressed for each voice colour
+    unsigned int pitch = NUM_KEYS * key_width;
+    idle_keyboard = malloc(pitch * key_height * sizeof(color_t));
+    assert(idle_keyboard);
+    for (int key = 0; key < NUM_KEYS; key++) {
+        blit_fill(idle_keyboard + key * key_width, pitch, key_width, key_height, piano_color(key));
+    }
+
+    for (int i = 0; i < NAJ_MOTORS; i++) {
+        pressed_keyboards[i] = malloc(pitch * key_height * sizeof(color_t));
+        assert(pressed_keyboards[i]);
+        blit_fill(pressed_keyboards[i], pitch, pitch, key_height, colors[i]);
+    }
+}
+
+void update_damage(unsigned int now) {
+    // Compare the picture at `now` with the last frame's and record what changed
+    for (unsigned int i = 0; i < span_count; i++) {
+        struct note_span_t *span = span_at(i);
+        int top, bottom;
+        span_rect(span, now, &top, &bottom);
+        damage_span_change(span->key, span->drawn_top, span->drawn_bottom, top, bottom);
+        span->drawn_top = top;
+        span->drawn_bottom = bottom;
+    }
+
+    update_key_colors();
+    for (int key = 0; key < NUM_KEYS; key++) {
+        if (key_colors[key] != drawn_key_colors[key]) damage_add(key, 0, key_height);
+        drawn_key_colors[key] = key_colors[key];
+    }
+}
 
-    unsigned char data = naj_read_byte();
+// Spans of each key, in ring order, rebuilt every frame so a damaged column only looks at its own spans
+unsigned short key_first_span[NUM_KEYS];
+unsigned short next_span[MAX_SPANS];
 
-    // Byte 0 - note number
-    if (bytes_received == 0) {
-        if (data != 0xee) {
-            return; 
-        }
-        bytes_received++;
-        return; 
+void repaint_column(int key, int top, int bottom) {
+    // Repaint part of one key's column: the key itself, then the background and every span crossing it
+    int x = key * display_scaler;
+    if (top < key_height) {
+        int key_bottom = (bottom < key_height) ? bottom : key_height;
+        draw_key(key, key_sprites[key], top, key_bottom);
+        top = key_height;
     }
+    if (bottom <= top) return;
 
-    if (bytes_received == 1) {
-        printf("Note: %02x", data);
-        note_num = data;
-        bytes_received++;
-        return;
+    gl_draw_rect(x, top, key_width, bottom - top, GL_BLACK);
+    for (unsigned short i = key_first_span[key]; i != NO_SPAN; i = next_span[i]) {
+        int span_top = (spans[i].drawn_top > top) ? spans[i].drawn_top : top;
+        int span_bottom = (spans[i].drawn_bottom < bottom) ? spans[i].drawn_bottom : bottom;
+        if (span_bottom > span_top) {
+            gl_draw_rect(x, span_top, box_width, span_bottom - span_top, colors[voice_color(spans[i].voice)]);
+        }
     }
+}
 
-    // Byte 1 - data
-    if (bytes_received == 2) {
-        motor_num = data;
-        printf("     motor: %02x\n", data);
+void repaint_damage(void) {
+    // Bucket the spans by key (walking newest first so each list ends up oldest first)
+    memset(key_first_span, 0xFF, sizeof(key_first_span));
+    for (unsigned int i = span_count; i > 0; i--) {
+        unsigned short index = (span_head + MAX_SPANS - span_count + i - 1) % MAX_SPANS;
+        next_span[index] = key_first_span[spans[index].key];
+        key_first_span[spans[index].key] = index;
+    }
 
-        // Packet is now complete - update motor accordingly
-        if (motor_num < NUM_MOTORS) {
-            motor_notes[0][motor_num] = note_num;
+    for (int key = 0; key < NUM_KEYS; key++) {
+        struct damage_t *d = &damage[draw_page][key];
+        for (unsigned int i = 0; i < d->count; i++) {
+            repaint_column(key, d->top[i], d->bottom[i]);
         }
+        d->count = 0;
+    }
+}
+
+void damage_all(void) {
+    // Both pages repaint every column in full
+    for (int key = 0; key < NUM_KEYS; key++) {
+        damage_add(key, 0, height * display_scaler);
+    }
+}
+
+// Microseconds from a pan to the display showing it - the firmware takes the offset up at the next
+// refresh - before the page it moved off may be drawn into
+#define PAN_SETTLE_US 17000
+
+// Panned scrolling: the note ring, and where its window goes when the display can't be panned
+struct scroll_t scroll;
+unsigned int *scroll_screen; // Framebuffer the window is copied to, or 0 when panning
+unsigned int scroll_screen_pitch;
+unsigned int scrolled_until; // Shared time up to which the ring has been drawn (a multiple of FRAME_DURATION)
+unsigned int panned_at;      // Tick of the last pan
+int pan_failed;              // The firmware refused a pan - copy the window from then on
+
+void scroll_start(void) {
+    // Pan a virtual framebuffer if the firmware gives one, otherwise draw off screen and copy the window
+    unsigned int pitch;
+    void *base = pan_failed ? 0 : panfb_init(width * display_scaler, height * display_scaler, &pitch);
+    scroll_screen = 0;
+    if (!base) {
+        printf("Panning not available - copying the window instead\n");
+        pitch = width * display_scaler * sizeof(color_t);
+        base = malloc(2 * height * display_scaler * pitch);
+        assert(base);
+        gl_init(width * display_scaler, height * display_scaler, FB_SINGLEBUFFER);
+        scroll_screen = fb_get_draw_buffer();
+        scroll_screen_pitch = fb_get_pitch();
+    }
+
+    // Panning draws into the page off screen, starting with the second
+    scroll_init(&scroll, base, pitch, width * display_scaler, height * display_scaler, key_height, scroll_screen ? 1 : 2);
+    scroll_fill(&scroll, 0, 0, width * display_scaler, height * display_scaler, GL_BLACK);
+    scrolled_until = naj_time() - naj_time() % FRAME_DURATION;
+    panned_at = timer_get_ticks() - PAN_SETTLE_US;
+}
+
+void draw_slot(unsigned int slot_start, int y) {
+    // Draw the FRAME_DURATION of shared time from `slot_start` as the band of rows at `y`, with the
+    // newest time at the top, the same way `span_rect` places it
+    unsigned int slot_end = slot_start + FRAME_DURATION;
+    scroll_fill(&scroll, 0, y, width * display_scaler, display_scaler, GL_BLACK);
+
+    for (unsigned int i = 0; i < span_count; i++) {
+        struct note_span_t *span = span_at(i);
+        if ((int)(span->start - slot_end) >= 0) continue;
+        if (!span->open && (int)(span->end - slot_start) <= 0) continue;
+
+        int from = ((int)(span->start - slot_start) > 0) ? (int)(span->start - slot_start) : 0;
+        int to = (!span->open && (int)(span->end - slot_end) < 0) ? (int)(span->end - slot_start) : FRAME_DURATION;
+        int top = y + (FRAME_DURATION - to) * display_scaler / FRAME_DURATION;
+        int bottom = y + (FRAME_DURATION - from) * display_scaler / FRAME_DURATION;
+        scroll_fill(&scroll, span->key * display_scaler, top, box_width, bottom - top, colors[voice_color(span->voice)]);
+    }
+}
+
+void draw_panned(unsigned int now) {
+    // The page drawn into was on screen until the last pan - wait until the display has moved off it
+    // (the slots elapsed meanwhile are drawn next time, so this only lowers the frame rate to the display's)
+    if (!scroll_screen && timer_get_ticks() - panned_at < PAN_SETTLE_US) return;
+
+    // Scroll down by the whole slots elapsed since the last frame and draw just those under the keyboard
+    // (a frame late by more than the screen's depth redraws all of it)
+    unsigned int slot_end = now - now % FRAME_DURATION;
+    unsigned int slots = (slot_end - scrolled_until) / FRAME_DURATION;
+    if (slots > SCROLL_ROWS) slots = SCROLL_ROWS;
+    scrolled_until = slot_end;
+
+    scroll_advance(&scroll, slots * display_scaler);
+    for (unsigned int i = 0; i < slots; i++) {
+        draw_slot(slot_end - (i + 1) * FRAME_DURATION, key_height + i * display_scaler);
+    }
+    drop_old_spans(now);
 
-        bytes_received = 0;
+    // The keyboard moves with the window, so it is drawn again at the window's new top
+    update_key_colors();
+    for (int key = 0; key < NUM_KEYS; key++) {
+        scroll_blit(&scroll, key * key_width, 0, key_width, key_height, key_sprites[key] + key * key_width,
+                    NUM_KEYS * key_width);
+    }
+
+    // The rows just drawn are all off screen until this point
+    if (scroll_screen) {
+        scroll_copy(&scroll, scroll_screen, scroll_screen_pitch);
+    } else if (panfb_pan(scroll.page * scroll.width, scroll.top)) {
+        scroll_flip(&scroll);
+        panned_at = timer_get_ticks();
+    } else {
+        // Start again over a copied window, redrawing the whole screen from the spans still held
+        printf("Panning failed - copying the window instead\n");
+        pan_failed = 1;
+        scroll_start();
+        scrolled_until -= SCROLL_DEPTH;
+        draw_panned(now);
+    }
+}
+
+static void handle_naj_frame(const struct naj_frame_t *frame) {
+    // Helper function to apply every command in a frame received over naj
+    // Frames for every board arrive here, numbered by that board's voices - map them back to the pool
+    unsigned int boards = naj_board_count();
+    unsigned int board = (frame->addr < boards) ? frame->addr : 0;
+    unsigned int pos = 0;
+    struct naj_cmd_t cmd;
+
+    while (naj_frame_next(frame, &pos, &cmd)) {
+        if (cmd.type == NAJ_CMD_NOTES) {
+            for (int i = 0; i + 1 < cmd.nargs; i += 2) {
+                unsigned int motor_num = naj_pool_motor(board, cmd.args[i], boards);
+                if (motor_num < NUM_MOTORS) {
+                    set_voice_note(motor_num, cmd.args[i + 1], naj_time());
+                }
+            }
+        } else if (cmd.type == NAJ_CMD_NOTES_AT && cmd.nargs >= 4) {
+            // Deadlines are a few milliseconds out - the keys light up now, and the spans start on time
+            unsigned int time = naj_read_u32(cmd.args);
+            for (int i = 4; i + 1 < cmd.nargs; i += 2) {
+                unsigned int motor_num = naj_pool_motor(board, cmd.args[i], boards);
+                if (motor_num < NUM_MOTORS) set_voice_note(motor_num, cmd.args[i + 1], time);
+            }
+        } else if (cmd.type == NAJ_CMD_SNAPSHOT) {
+            for (int i = 0; i < cmd.nargs; i++) {
+                unsigned int motor_num = naj_pool_motor(board, i, boards);
+                if (motor_num < NUM_MOTORS) set_voice_note(motor_num, cmd.args[i], naj_time());
+            }
+        }
     }
 }
 
-void draw_frame(int time_step) { 
-    // 2d array to keep track of pressed keys - max of 8 keys being played at once
-    if (time_step == 0) {
-        color_keys(&motor_notes[0][0]);
-        return; 
+void draw_frame(unsigned int now) {
+    if (PANNED_SCROLL) {
+        draw_panned(now);
+        return;
     }
-    else {
-        color_keys(&motor_notes[0][0]);
-        for (int i = 1; i <= (time_step + 1); i++) {
-            color_boxs(&motor_notes[i][0], i);
-        } 
+
+    if (INCREMENTAL_DRAW) {
+        // Repaint just what changed since this page was last on screen
+        update_damage(now);
+        drop_old_spans(now);
+        repaint_damage();
+        return;
     }
+
+    // Whole screen: keyboard, pressed keys, then every note still in view
+    gl_clear(GL_BLACK);
+    color_piano();
+    drop_old_spans(now);
+    color_keys(voice_notes);
+    color_spans(now);
 }
 
 void main(void)
 {
     interrupts_init();
     naj_init_read(); 
+    naj_listen_all();
     interrupts_global_enable(); 
     uart_init();
     timer_init();
     printf("Executing main() in graphics.c\n");
 
     // Set all motors to not playing (OxFF)
-    for (int r = 0; r < 100; r++) {
-        for (int c = 0; c < NUM_MOTORS; c++) {
-            motor_notes[r][c] = MOTOR_OFF;
-        }
-    }
+    memset(voice_notes, MOTOR_OFF, sizeof(voice_notes));
+    memset(voice_spans, 0xFF, sizeof(voice_spans));
+    span_head = 0;
+    span_count = 0;
+    build_sprites();
 
     gl_init(width * display_scaler, height * display_scaler, FB_DOUBLEBUFFER);
     gl_clear(GL_BLUE);
     gl_swap_buffer();
 
     printf("Waiting for host...\n"); 
-    while (1) {
-        if (naj_has_data() && naj_read_byte() == 0x19) {
-            break;
-        }
-    }
+    naj_wait_handshake();
     printf("Host connected\n"); 
 
-    int time_step = 0; 
-    while (1) {
-        unsigned int start = timer_get_ticks();
-
+    if (PANNED_SCROLL) {
+        scroll_start();
+    } else {
+        // Start both pages black (the margin right of the keys is never repainted), with everything damaged
         gl_clear(GL_BLACK);
-        color_piano();
-        draw_frame(time_step);
         gl_swap_buffer();
-        time_step++; 
+        gl_clear(GL_BLACK);
+        draw_page = 0;
+        damage_all();
+    }
 
-        for (int r = 99; r >= 1; r--) {
-            for (int c = 0; c < NUM_MOTORS; c++)
-            {
-                motor_notes[r][c] = motor_notes[r - 1][c];
+    unsigned int frame_count = 0;
+    unsigned int frame_total = 0;
+    unsigned int frame_max = 0;
+
+    // Frames start on multiples of FRAME_DURATION in shared time, so the scroll stays in step with the motors
+    unsigned int next_frame = naj_time() - naj_time() % FRAME_DURATION + FRAME_DURATION;
+    while (1) {
+        unsigned int start = timer_get_ticks();
+        draw_frame(naj_time());
+        unsigned int elapsed = timer_get_ticks() - start;
+        if (!PANNED_SCROLL) {
+            gl_swap_buffer();
+            draw_page = !draw_page;
+        }
+
+        if (FRAME_LOG) {
+            frame_total += elapsed;
+            if (elapsed > frame_max) frame_max = elapsed;
+            if (++frame_count == FRAME_LOG_PERIOD) {
+                printf("Frame: %s mean %d us max %d us, %d spans\n",
+                       PANNED_SCROLL ? "panned" : INCREMENTAL_DRAW ? "incremental" : "full",
+                       frame_total / frame_count, frame_max, span_count);
+                frame_count = 0;
+                frame_total = 0;
+                frame_max = 0;
             }
         }
 
-        while (naj_has_data()) {
-            handle_naj_byte();
-        }        
+        struct naj_frame_t frame;
+        while (naj_read_frame(&frame)) {
+            handle_naj_frame(&frame);
+        }
 
-        while (timer_get_ticks() - start < FRAME_DURATION) {}
+        while ((int)(naj_time() - next_frame) < 0) {}
+        next_frame += FRAME_DURATION;
+        if ((int)(naj_time() - next_frame) >= 0) {
+            // Fell a whole frame behind - pick up at the next boundary rather than rushing to catch up
+            next_frame = naj_time() - naj_time() % FRAME_DURATION + FRAME_DURATION;
+        }
     }
 
     printf("Completed main() in graphics.c\n");
@@ -0,0 +1 @@
+../motors/najframe.c
\ No newline at end of file
@@ -0,0 +1,77 @@
+// This file implements the panned framebuffer as defined in `panfb.h`
+#include "panfb.h"
+#include "mailbox.h"
+
+// Framebuffer request, laid out as the firmware reads it from the framebuffer mailbox channel
+struct panfb_config_t {
+    unsigned int width;          // Size of the screen
+    unsigned int height;
+    unsigned int virtual_width;  // Size of the framebuffer behind it
+    unsigned int virtual_height;
+    unsigned int pitch;          // Bytes per row (filled in by the firmware)
+    unsigned int bit_depth;
+    unsigned int x_offset;       // Position of the screen in the virtual framebuffer
+    unsigned int y_offset;
+    unsigned int framebuffer;    // Bus address of the framebuffer (filled in by the firmware)
+    unsigned int total_bytes;
+};
+
+// The firmware gives back a bus address - the ARM sees the same memory with the top bits clear
+#define BUS_TO_ARM(addr) ((addr) & 0x3FFFFFFF)
+
+// Property channel message that sets just the virtual offset, leaving the framebuffer where it is
+// (the framebuffer channel would take a whole new request, and may answer it with a new framebuffer)
+#define PROPERTY_REQUEST 0x00000000
+#define PROPERTY_SUCCESS 0x80000000
+#define TAG_SET_VIRTUAL_OFFSET 0x00048009
+
+struct panfb_offset_t {
+    unsigned int size;           // Bytes in the whole message
+    unsigned int code;           // PROPERTY_REQUEST, then PROPERTY_SUCCESS from the firmware
+    unsigned int tag;
+    unsigned int value_size;     // Bytes of value: x and y
+    unsigned int value_code;     // 0, then bit 31 and the response length from the firmware
+    unsigned int x;              // Offset asked for, then the one set
+    unsigned int y;
+    unsigned int end;            // 0: no more tags
+};
+
+static volatile struct panfb_config_t config __attribute__((aligned(16)));
+static volatile struct panfb_offset_t offset __attribute__((aligned(16)));
+
+void *panfb_init(unsigned int width, unsigned int height, unsigned int *pitch) {
+    config.width = width;
+    config.height = height;
+    config.virtual_width = 2 * width;
+    config.virtual_height = 2 * height;
+    config.bit_depth = 32;
+    config.x_offset = 0;
+    config.y_offset = 0;
+    config.pitch = 0;
+    config.framebuffer = 0;
+    config.total_bytes = 0;
+
+    if (!mailbox_request(MAILBOX_FRAMEBUFFER, (unsigned int) &config)) return 0;
+    if (config.framebuffer == 0 || config.virtual_width != 2 * width || config.virtual_height != 2 * height ||
+        config.pitch < 2 * width * 4) return 0;
+
+    *pitch = config.pitch;
+    return (void *) BUS_TO_ARM(config.framebuffer);
+}
+
+int panfb_pan(unsigned int x, unsigned int y) {
+    offset.size = sizeof(offset);
+    offset.code = PROPERTY_REQUEST;
+    offset.tag = TAG_SET_VIRTUAL_OFFSET;
+    offset.value_size = 8;
+    offset.value_code = 0;
+    offset.x = x;
+    offset.y = y;
+    offset.end = 0;
+
+    mailbox_write(MAILBOX_TAGS_ARM_TO_VC, (unsigned int) &offset);
+    mailbox_read(MAILBOX_TAGS_ARM_TO_VC);
+
+    // The firmware answers with the offset it set, which is clamped to the virtual framebuffer
+    return offset.code == PROPERTY_SUCCESS && offset.x == x && offset.y == y;
+}
@@ -0,0 +1,21 @@
+// This file defines the panned framebuffer used by the scrolling display mode (see `scroll.h`)
+// The firmware is asked for a virtual framebuffer twice the width and twice the height of the screen,
+// and the screen is moved over it by changing the virtual offset - nothing is copied to scroll the
+// picture. The two halves side by side are the pages of `scroll.h`: one is drawn while the other is shown
+// This replaces the libpi framebuffer, so `gl` must not be used once it is set up
+
+#ifndef _PANFB_H
+#define _PANFB_H
+
+// Set up a `width` by `height` screen of 32-bit pixels over a 2 * `width` by 2 * `height` virtual framebuffer
+// Returns the first row of the virtual framebuffer and sets `pitch` to the bytes between rows,
+// or returns 0 if the firmware did not give a framebuffer of that shape
+void *panfb_init(unsigned int width, unsigned int height, unsigned int *pitch);
+
+// Show the screen-sized window of the virtual framebuffer whose top left is at (`x`, `y`)
+// The firmware takes the new offset up at the display's next refresh, so until then the old window
+// may still be on screen
+// Returns 1 if the firmware accepted the offset, 0 if not
+int panfb_pan(unsigned int x, unsigned int y);
+
+#endif
@@ -0,0 +1,104 @@
+// This file implements the scrolling note ring as defined in `scroll.h`
+#include "scroll.h"
+#include "blit.h"
+
+// Row `row` of the page drawn into
+static unsigned int *buffer_row(const struct scroll_t *scroll, unsigned int row) {
+    return scroll->base + row * scroll->pitch + scroll->page * scroll->width;
+}
+
+// The window never reaches past the second copy, so each row's twin is `height` rows up or down
+static unsigned int twin_row(const struct scroll_t *scroll, unsigned int row) {
+    return (row < scroll->height) ? row + scroll->height : row - scroll->height;
+}
+
+// Clip a rectangle of the window to it, returning 0 if nothing is left
+static int clip(const struct scroll_t *scroll, int *x, int *y, int *w, int *h) {
+    if (*x < 0) { *w += *x; *x = 0; }
+    if (*y < 0) { *h += *y; *y = 0; }
+    if (*x + *w > (int) scroll->width) *w = scroll->width - *x;
+    if (*y + *h > (int) scroll->height) *h = scroll->height - *y;
+    return *w > 0 && *h > 0;
+}
+
+// Bring the page drawn into up to date with the other, before anything changes in it
+static void catch_up(struct scroll_t *scroll) {
+    const unsigned int *other = scroll->base + (!scroll->page) * scroll->width;
+    for (unsigned int i = 0; i < scroll->behind; i++) {
+        unsigned int row = scroll->behind_top + i;
+        blit_copy(buffer_row(scroll, row), 0, other + row * scroll->pitch, 0, scroll->width, 1);
+        row = twin_row(scroll, row);
+        blit_copy(buffer_row(scroll, row), 0, other + row * scroll->pitch, 0, scroll->width, 1);
+    }
+    scroll->behind = 0;
+}
+
+// Rows from the top of the window down to the bottom of a rectangle drawn there
+static void mark_drawn(struct scroll_t *scroll, int y, int h) {
+    if ((unsigned int) (y + h) > scroll->drawn) scroll->drawn = y + h;
+}
+
+void scroll_init(struct scroll_t *scroll, void *base, unsigned int pitch_bytes,
+                 unsigned int width, unsigned int height, unsigned int strip, unsigned int pages) {
+    scroll->base = base;
+    scroll->pitch = pitch_bytes / sizeof(unsigned int);
+    scroll->width = width;
+    scroll->height = height;
+    scroll->strip = strip;
+    scroll->top = 0;
+    scroll->pages = pages;
+    scroll->page = pages - 1;
+    scroll->drawn = 0;
+    scroll->behind_top = 0;
+    scroll->behind = 0;
+}
+
+void scroll_fill(struct scroll_t *scroll, int x, int y, int w, int h, unsigned int color) {
+    if (!clip(scroll, &x, &y, &w, &h)) return;
+    catch_up(scroll);
+    mark_drawn(scroll, y, h);
+
+    for (int i = 0; i < h; i++) {
+        unsigned int row = scroll->top + y + i;
+        blit_fill(buffer_row(scroll, row) + x, 0, w, 1, color);
+        blit_fill(buffer_row(scroll, twin_row(scroll, row)) + x, 0, w, 1, color);
+    }
+}
+
+void scroll_blit(struct scroll_t *scroll, int x, int y, int w, int h, const unsigned int *src, unsigned int src_pitch) {
+    int from_x = x, from_y = y;
+    if (!clip(scroll, &x, &y, &w, &h)) return;
+    src += (y - from_y) * src_pitch + (x - from_x);
+    catch_up(scroll);
+    mark_drawn(scroll, y, h);
+
+    for (int i = 0; i < h; i++) {
+        unsigned int row = scroll->top + y + i;
+        blit_copy(buffer_row(scroll, row) + x, 0, src + i * src_pitch, 0, w, 1);
+        blit_copy(buffer_row(scroll, twin_row(scroll, row)) + x, 0, src + i * src_pitch, 0, w, 1);
+    }
+}
+
+void scroll_advance(struct scroll_t *scroll, unsigned int rows) {
+    catch_up(scroll);
+    scroll->top = (scroll->top + scroll->height - rows % scroll->height) % scroll->height;
+
+    // Rows drawn since the last flip move down the window with the picture
+    if (scroll->drawn) scroll->drawn = (rows < scroll->height - scroll->drawn) ? scroll->drawn + rows : scroll->height;
+}
+
+void scroll_flip(struct scroll_t *scroll) {
+    if (scroll->pages < 2) return;
+
+    // Only what was drawn since the last flip differs - the rows the window covered then
+    catch_up(scroll);
+    scroll->page = !scroll->page;
+    scroll->behind_top = scroll->top;
+    scroll->behind = scroll->drawn;
+    scroll->drawn = 0;
+}
+
+void scroll_copy(const struct scroll_t *scroll, void *screen, unsigned int pitch_bytes) {
+    blit_copy(screen, pitch_bytes / sizeof(unsigned int), buffer_row(scroll, scroll->top), scroll->pitch,
+              scroll->width, scroll->height);
+}
@@ -0,0 +1,63 @@
+// This file defines the scrolling note ring used by the panned display mode in `graphics.c`
+// Everything here is pure computation on memory - no hardware is touched - so it can be tested on the host
+//
+// The picture lives in a buffer twice the height of the screen, and the screen shows a window of it
+// that starts at row `top`. Every row drawn is written twice, `height` rows apart, so whatever the
+// window's position it sees whole rows and never has to wrap
+// Scrolling the picture down is then only moving the window up (modulo `height`): the rows already
+// drawn stay where they are, and the caller draws the rows newly exposed under the static strip at
+// the top of the window, and the strip itself, which moves with the window
+// The window is shown either by panning the display onto it (see `panfb.h`) or, where that is not
+// available, by copying it to an ordinary framebuffer with `scroll_copy`
+//
+// Panning moves the window over rows that are on screen: the strip's new place overlaps the rows
+// shown at the top of the old window, so drawing it there before the pan would show on the old one.
+// With two pages side by side, each a whole buffer as above, drawing goes to the page off screen and
+// the display is panned onto it; `scroll_flip` then turns to the other page, which is brought up to
+// date - the rows just drawn, copied across - before anything else is drawn into it
+
+#ifndef _SCROLL_H
+#define _SCROLL_H
+
+struct scroll_t {
+    unsigned int *base;  // First row of the buffer (2 * height rows)
+    unsigned int pitch;  // Pixels from one row of the buffer to the next
+    unsigned int width;  // Size of the window, in pixels
+    unsigned int height;
+    unsigned int strip;  // Rows of the window's static strip
+    unsigned int top;    // Row of the buffer at the top of the window, 0 to height - 1
+
+    unsigned int pages;  // 1, or 2 side by side, `width` pixels apart
+    unsigned int page;   // Page drawn into - with 2, the one off screen
+    unsigned int drawn;  // Rows at the top of the window drawn into `page` since the last flip
+    unsigned int behind_top; // `behind` rows of the buffer from `behind_top` that `page` is still
+    unsigned int behind;     // missing from the other page
+};
+
+// Use the 32-bit pixels at `base` (2 * `height` rows, `pitch_bytes` apart) for a `width` by `height`
+// window whose first `strip` rows are the static strip, in `pages` pages (1 or 2) side by side
+// The buffer is left as it is - fill the whole window to start from a known picture
+// With 2 pages drawing starts in the second, so the first can be on screen
+void scroll_init(struct scroll_t *scroll, void *base, unsigned int pitch_bytes,
+                 unsigned int width, unsigned int height, unsigned int strip, unsigned int pages);
+
+// Fill a rectangle of the window (clipped to it) with `color`, in both copies of the page drawn into
+void scroll_fill(struct scroll_t *scroll, int x, int y, int w, int h, unsigned int color);
+
+// Copy a rectangle of the pixels at `src` (rows `src_pitch` pixels apart) into the window at (`x`, `y`)
+// (clipped to it), in both copies of the page drawn into
+void scroll_blit(struct scroll_t *scroll, int x, int y, int w, int h, const unsigned int *src, unsigned int src_pitch);
+
+// Scroll the picture down by `rows`: the strip and the `rows` rows under it are then stale and
+// must be drawn before the window is shown
+void scroll_advance(struct scroll_t *scroll, unsigned int rows);
+
+// With 2 pages: once the display has been panned onto the window of the page drawn into, turn to the
+// other page. The first call after this that draws or scrolls copies the rows it is missing into it,
+// so the pan must have taken effect by then
+void scroll_flip(struct scroll_t *scroll);
+
+// Copy the window of the page drawn into to the framebuffer at `screen` (rows `pitch_bytes` apart)
+void scroll_copy(const struct scroll_t *scroll, void *screen, unsigned int pitch_bytes);
+
+#endif
@@ -0,0 +1,55 @@
+// This file implements the clock model as defined in `clocksync.h`
+#include "clocksync.h"
+
+void clocksync_init(struct clocksync_t *clock, unsigned int local, unsigned int master) {
+    clock->local = local;
+    clock->master = master;
+    clock->drift = 0;
+    clock->last_error = 0;
+    clock->samples = 0;
+    clock->rejected = 0;
+}
+
+// Drift correction for a signed interval - the product needs 64 bits for intervals over ~1 second
+static int drift_correction(int interval, int drift) {
+    return (int)(((long long) interval * drift) >> CLOCKSYNC_DRIFT_SHIFT);
+}
+
+unsigned int clocksync_to_master(const struct clocksync_t *clock, unsigned int local) {
+    int elapsed = local - clock->local;
+    return clock->master + elapsed + drift_correction(elapsed, clock->drift);
+}
+
+unsigned int clocksync_to_local(const struct clocksync_t *clock, unsigned int master) {
+    // First order inverse of `clocksync_to_master` - exact to well under a microsecond for
+    // any realistic crystal error
+    int elapsed = master - clock->master;
+    return clock->local + elapsed - drift_correction(elapsed, clock->drift);
+}
+
+static int is_glitch(int error) {
+    return error > CLOCKSYNC_MAX_ERROR || error < -CLOCKSYNC_MAX_ERROR;
+}
+
+void clocksync_sample(struct clocksync_t *clock, unsigned int local, unsigned int master) {
+    int error = master - clocksync_to_master(clock, local);
+    int interval = local - clock->local;
+
+    // A single outlier (a delayed interrupt) is dropped, but two in a row mean the model really is off
+    int previous_glitch = is_glitch(clock->last_error);
+    clock->last_error = error;
+    clock->samples++;
+    if (is_glitch(error) && !previous_glitch) {
+        clock->rejected++;
+        return;
+    }
+
+    // The error built up since the reference point is what the rate estimate got wrong over that interval
+    if (interval > 0) {
+        long long rate_error = ((long long) error << CLOCKSYNC_DRIFT_SHIFT) / interval;
+        clock->drift += (int)(rate_error >> CLOCKSYNC_GAIN_SHIFT);
+    }
+
+    clock->local = local;
+    clock->master = master;
+}
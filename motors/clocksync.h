@@ -0,0 +1,44 @@
+// This file defines the clock model used to share one timebase between the boards
+// The host's clock is the master. A reader keeps a reference point (a local tick and the master
+// time at that tick) plus an estimate of how fast the master clock runs relative to its own,
+// and converts between the two with a straight line through the reference point
+// Every new (local, master) sample moves the reference point and nudges the rate estimate
+// This file only does arithmetic, so it can also be built on the host for simulation
+
+#ifndef _CLOCKSYNC_H
+#define _CLOCKSYNC_H
+
+// Rate estimates are stored as (master rate / local rate - 1) in units of 2^-CLOCKSYNC_DRIFT_SHIFT
+// (1 unit is about 0.06 ppm)
+#define CLOCKSYNC_DRIFT_SHIFT 24
+
+// Fraction of each rate error that is applied (1 / 2^CLOCKSYNC_GAIN_SHIFT), to smooth out timestamp noise
+#define CLOCKSYNC_GAIN_SHIFT 1
+
+// Samples further than this from the prediction (in microseconds) are ignored as a glitch,
+// unless the previous sample was too far off as well
+#define CLOCKSYNC_MAX_ERROR 500
+
+struct clocksync_t {
+    unsigned int local;   // Local tick of the reference point
+    unsigned int master;  // Master time at the reference point
+    int drift;            // Rate estimate (see CLOCKSYNC_DRIFT_SHIFT)
+    int last_error;       // Master time minus prediction at the most recent sample, in microseconds
+    unsigned int samples;
+    unsigned int rejected;
+};
+
+// Start the model with the master clock reading `master` at local tick `local`, at the same rate
+void clocksync_init(struct clocksync_t *clock, unsigned int local, unsigned int master);
+
+// Add a sample: the master clock read `master` at local tick `local`
+// Samples must be taken in increasing order of `local`
+void clocksync_sample(struct clocksync_t *clock, unsigned int local, unsigned int master);
+
+// Convert a local tick to master time
+unsigned int clocksync_to_master(const struct clocksync_t *clock, unsigned int local);
+
+// Convert a master time to a local tick
+unsigned int clocksync_to_local(const struct clocksync_t *clock, unsigned int master);
+
+#endif
@@ -0,0 +1,54 @@
+// This file implements the DMA control block generator as defined in `dmacb.h`
+#include "dmacb.h"
+
+#include <stddef.h>
+
+// Bus address of a field of the ring
+#define RING_BUS(field) (ring_bus + (unsigned int) offsetof(struct dmacb_ring_t, field))
+
+static void set_block(struct dmacb_t *block, unsigned int info, unsigned int source, unsigned int dest) {
+    block->info = info;
+    block->source = source;
+    block->dest = dest;
+    block->length = sizeof(unsigned int);
+    block->stride = 0;
+    block->reserved[0] = 0;
+    block->reserved[1] = 0;
+}
+
+void dmacb_build(struct dmacb_ring_t *ring, unsigned int ring_bus, const struct dmacb_targets_t *targets) {
+    unsigned int info = DMACB_TI_NO_WIDE_BURSTS | DMACB_TI_WAIT_RESP;
+    unsigned int count = DMACB_SLOTS * DMACB_PER_SLOT;
+
+    for (unsigned int slot = 0; slot < DMACB_SLOTS; slot++) {
+        unsigned int previous = (slot + DMACB_SLOTS - 1) % DMACB_SLOTS;
+        struct dmacb_t *block = &ring->blocks[slot * DMACB_PER_SLOT];
+
+        set_block(&block[0], info, RING_BUS(pins[previous]), targets->clear);
+        set_block(&block[1], info, RING_BUS(zero), RING_BUS(pins[previous]));
+        set_block(&block[2], info, RING_BUS(pins[slot]), targets->set);
+        set_block(&block[3], info | DMACB_TI_DEST_DREQ | DMACB_TI_PERMAP(DMACB_PERMAP_PWM), RING_BUS(pace), targets->fifo);
+
+        ring->pins[slot] = 0;
+    }
+
+    // Chain every block to the next, and the last back round to the first
+    for (unsigned int i = 0; i < count; i++) {
+        ring->blocks[i].next = RING_BUS(blocks[(i + 1) % count]);
+    }
+
+    ring->zero = 0;
+    ring->pace = 0;
+}
+
+int dmacb_slot_at(unsigned int ring_bus, unsigned int block_bus) {
+    unsigned int offset = block_bus - RING_BUS(blocks);
+    if (offset >= sizeof(((struct dmacb_ring_t *) 0)->blocks)) return -1;
+    return offset / (sizeof(struct dmacb_t) * DMACB_PER_SLOT);
+}
+
+int dmacb_slot_for(unsigned int current, unsigned int now, unsigned int when) {
+    int ahead = (int)(when - now) / DMACB_SLOT_US;
+    if (ahead < DMACB_MIN_AHEAD || ahead >= DMACB_SLOTS - DMACB_MIN_AHEAD) return -1;
+    return (current + ahead) % DMACB_SLOTS;
+}
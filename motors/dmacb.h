@@ -0,0 +1,73 @@
+// This file defines the DMA control block generator used by the DMA step backend (see `dmastep.h`)
+// Everything here is pure computation on memory - no hardware is touched - so it can be tested on the host
+//
+// The buffer is a ring of DMACB_SLOTS time slots, each DMACB_SLOT_US microseconds long, holding one word:
+// the GPIO pins to pulse in that slot. The DMA engine walks a circular chain of control blocks, and
+// in every slot it
+//     1. writes the previous slot's pins to GPCLR0 (ending those pulses, so each pulse lasts one slot)
+//     2. copies a zero over the previous slot's pins (the ring cleans itself as it goes)
+//     3. writes this slot's pins to GPSET0 (starting these pulses)
+//     4. writes a word to the PWM FIFO, which stalls until the PWM has used a word (one slot of time)
+// The CPU only ever ORs pins into slots a little ahead of the DMA engine
+
+#ifndef _DMACB_H
+#define _DMACB_H
+
+// Number of time slots in the ring
+#define DMACB_SLOTS 256
+
+// Length of each time slot (and of each step pulse), in microseconds
+#define DMACB_SLOT_US 4
+
+// Control blocks per time slot
+#define DMACB_PER_SLOT 4
+
+// Pins can't be added to a slot closer than this to the one the DMA engine is executing
+#define DMACB_MIN_AHEAD 2
+
+// Transfer information bits used by the control blocks
+#define DMACB_TI_WAIT_RESP (1 << 3)
+#define DMACB_TI_DEST_DREQ (1 << 6)
+#define DMACB_TI_PERMAP(p) ((p) << 16)
+#define DMACB_TI_NO_WIDE_BURSTS (1 << 26)
+#define DMACB_PERMAP_PWM 5
+
+// One DMA control block, laid out as the DMA engine reads it (must be 32-byte aligned)
+struct dmacb_t {
+    unsigned int info;
+    unsigned int source;
+    unsigned int dest;
+    unsigned int length;
+    unsigned int stride;
+    unsigned int next;
+    unsigned int reserved[2];
+};
+
+// Everything the DMA engine reads and writes, in one block of memory
+struct dmacb_ring_t {
+    struct dmacb_t blocks[DMACB_SLOTS * DMACB_PER_SLOT];
+    unsigned int pins[DMACB_SLOTS]; // GPIO pins pulsed in each slot
+    unsigned int zero;              // Copied over each slot's pins once the DMA engine has passed it
+    unsigned int pace;              // Written to the PWM FIFO to wait for the next slot
+} __attribute__((aligned(32)));
+
+// Bus addresses of the registers the control blocks write to
+struct dmacb_targets_t {
+    unsigned int set;   // GPSET0
+    unsigned int clear; // GPCLR0
+    unsigned int fifo;  // PWM FIFO
+};
+
+// Fill in the control block chain and clear every slot
+// `ring_bus` is the bus address at which the DMA engine sees `ring`
+void dmacb_build(struct dmacb_ring_t *ring, unsigned int ring_bus, const struct dmacb_targets_t *targets);
+
+// Slot whose control blocks are at bus address `block_bus` (as read from the DMA engine), or -1 if
+// the address is not one of the ring's control blocks
+int dmacb_slot_at(unsigned int ring_bus, unsigned int block_bus);
+
+// Slot in which to pulse a step due at tick `when`, given that the DMA engine is executing slot
+// `current` at tick `now`, or -1 if the step is too close (or too far ahead) for the ring
+int dmacb_slot_for(unsigned int current, unsigned int now, unsigned int when);
+
+#endif
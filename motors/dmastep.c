@@ -0,0 +1,94 @@
+// This file implements the DMA step backend as defined in `dmastep.h`
+#include "dmastep.h"
+#include "dmacb.h"
+#include "timer.h"
+
+// Peripheral registers, as seen by the ARM
+#define DMA_BASE 0x20007000
+#define DMA_CS ((volatile unsigned int *)(DMA_BASE + DMASTEP_CHANNEL * 0x100 + 0x00))
+#define DMA_CONBLK_AD ((volatile unsigned int *)(DMA_BASE + DMASTEP_CHANNEL * 0x100 + 0x04))
+#define DMA_ENABLE ((volatile unsigned int *)(DMA_BASE + 0xFF0))
+
+#define PWM_BASE 0x2020C000
+#define PWM_CTL ((volatile unsigned int *)(PWM_BASE + 0x00))
+#define PWM_DMAC ((volatile unsigned int *)(PWM_BASE + 0x08))
+#define PWM_RNG1 ((volatile unsigned int *)(PWM_BASE + 0x10))
+
+#define CM_PWMCTL ((volatile unsigned int *)0x201010A0)
+#define CM_PWMDIV ((volatile unsigned int *)0x201010A4)
+
+// The same registers, as seen by the DMA engine
+#define BUS_GPSET0 0x7E20001C
+#define BUS_GPCLR0 0x7E200028
+#define BUS_PWM_FIFO 0x7E20C018
+
+// The DMA engine sees RAM at this offset (the L2-coherent alias, the same view the ARM has)
+#define BUS_MEMORY 0x40000000
+
+#define CM_PASSWORD 0x5A000000
+#define CM_SRC_PLLD 6
+#define CM_ENAB (1 << 4)
+#define CM_BUSY (1 << 7)
+
+// PLLD runs at 500MHz - divided down to 10MHz, so each PWM range count is 0.1us
+#define PWM_CLOCK_DIVISOR 50
+#define PWM_COUNTS_PER_US 10
+
+#define PWM_CTL_PWEN1 (1 << 0)
+#define PWM_CTL_USEF1 (1 << 5)
+#define PWM_CTL_CLRF1 (1 << 6)
+#define PWM_DMAC_ENAB (1u << 31)
+
+#define DMA_CS_RESET (1u << 31)
+#define DMA_CS_ACTIVE (1 << 0)
+#define DMA_CS_END (1 << 1)
+#define DMA_CS_PRIORITY(p) ((p) << 16)
+#define DMA_CS_PANIC_PRIORITY(p) ((p) << 20)
+#define DMA_CS_WAIT_FOR_WRITES (1 << 28)
+
+static struct dmacb_ring_t ring;
+static unsigned int ring_bus;
+
+static void init_pwm(void) {
+    // Stop the PWM and its clock before changing the clock source
+    *PWM_CTL = 0;
+    *CM_PWMCTL = CM_PASSWORD | CM_SRC_PLLD;
+    while (*CM_PWMCTL & CM_BUSY);
+
+    *CM_PWMDIV = CM_PASSWORD | (PWM_CLOCK_DIVISOR << 12);
+    *CM_PWMCTL = CM_PASSWORD | CM_SRC_PLLD | CM_ENAB;
+
+    // The PWM takes one FIFO word per range, so with DREQ pacing the DMA engine gets one slot per range
+    *PWM_RNG1 = DMACB_SLOT_US * PWM_COUNTS_PER_US;
+    *PWM_DMAC = PWM_DMAC_ENAB | (15 << 8) | 15;
+    *PWM_CTL = PWM_CTL_CLRF1;
+    *PWM_CTL = PWM_CTL_USEF1 | PWM_CTL_PWEN1;
+}
+
+void dmastep_init(void) {
+    ring_bus = BUS_MEMORY | (unsigned int) &ring;
+
+    struct dmacb_targets_t targets = { BUS_GPSET0, BUS_GPCLR0, BUS_PWM_FIFO };
+    dmacb_build(&ring, ring_bus, &targets);
+
+    init_pwm();
+
+    *DMA_ENABLE |= 1 << DMASTEP_CHANNEL;
+    *DMA_CS = DMA_CS_RESET;
+    *DMA_CS = DMA_CS_END;
+    *DMA_CONBLK_AD = ring_bus + (unsigned int) ((char *) ring.blocks - (char *) &ring);
+    *DMA_CS = DMA_CS_WAIT_FOR_WRITES | DMA_CS_PANIC_PRIORITY(8) | DMA_CS_PRIORITY(8) | DMA_CS_ACTIVE;
+}
+
+int dmastep_queue(unsigned int pins, unsigned int when) {
+    // Where the DMA engine is now - read together with the clock, so the two never drift apart
+    int current = dmacb_slot_at(ring_bus, *DMA_CONBLK_AD);
+    unsigned int now = timer_get_ticks();
+    if (current < 0) return 0;
+
+    int slot = dmacb_slot_for(current, now, when);
+    if (slot < 0) return 0;
+
+    ring.pins[slot] |= pins;
+    return 1;
+}
@@ -0,0 +1,27 @@
+// This file defines the DMA step backend for the motor board
+// Instead of pulsing step pins from the timer interrupt, the scheduler runs DMASTEP_LEAD_US ahead of
+// the clock and drops each step into a ring of time slots that the DMA engine plays out to the GPIO
+// registers, paced by the PWM (see `dmacb.h` for the ring itself)
+// Pulses then come out with DMA timing, whatever interrupt latency the naj reader causes, as long
+// as the scheduler stays less than the lead behind
+
+#ifndef _DMASTEP_H
+#define _DMASTEP_H
+
+// How far ahead of the clock the scheduler places steps, in microseconds
+// Must cover the worst interrupt latency, and stay well inside the ring (DMACB_SLOTS * DMACB_SLOT_US)
+#define DMASTEP_LEAD_US 400
+
+// DMA channel used (channels 0-6 are full channels; the firmware uses some of the others)
+#define DMASTEP_CHANNEL 5
+
+// Set up the PWM pacing clock and start the DMA engine playing the (empty) ring
+// Uses the PWM, so PWM audio output is not available at the same time
+void dmastep_init(void);
+
+// Pulse the GPIO pins `pins` (GPSET0 bits) at tick `when`
+// Returns 1 if the pulse was queued, 0 if `when` is too close to now (or too far ahead) for the ring,
+// in which case the caller should pulse the pins itself
+int dmastep_queue(unsigned int pins, unsigned int when);
+
+#endif
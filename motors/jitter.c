@@ -0,0 +1,69 @@
+// This file implements the step-jitter recorder as defined in `jitter.h`
+#include "jitter.h"
+#include "printf.h"
+
+struct jitter_stats_t {
+    unsigned int count;
+    unsigned int max;
+    unsigned int missed;
+    unsigned int buckets[JITTER_BUCKETS];
+    unsigned int switches;
+    unsigned int switch_max;
+};
+
+static struct jitter_stats_t stats[JITTER_MAX_MOTORS];
+
+static unsigned int bucket_for(unsigned int lateness) {
+    // Index of the highest set bit + 1 (0 for on-time steps), using a single CLZ instruction
+    unsigned int bucket = (lateness == 0) ? 0 : 32 - __builtin_clz(lateness);
+    return (bucket < JITTER_BUCKETS) ? bucket : JITTER_BUCKETS - 1;
+}
+
+void jitter_reset(void) {
+    for (int m = 0; m < JITTER_MAX_MOTORS; m++) {
+        stats[m].count = 0;
+        stats[m].max = 0;
+        stats[m].missed = 0;
+        stats[m].switches = 0;
+        stats[m].switch_max = 0;
+        for (int b = 0; b < JITTER_BUCKETS; b++) {
+            stats[m].buckets[b] = 0;
+        }
+    }
+}
+
+void jitter_record(unsigned int motor, unsigned int lateness) {
+    if (motor >= JITTER_MAX_MOTORS) return;
+
+    struct jitter_stats_t *s = &stats[motor];
+    s->count++;
+    s->buckets[bucket_for(lateness)]++;
+    if (lateness > s->max) s->max = lateness;
+}
+
+void jitter_switch(unsigned int motor, unsigned int lateness) {
+    if (motor >= JITTER_MAX_MOTORS) return;
+
+    struct jitter_stats_t *s = &stats[motor];
+    s->switches++;
+    if (lateness > s->switch_max) s->switch_max = lateness;
+}
+
+void jitter_missed(unsigned int motor, unsigned int count) {
+    if (motor >= JITTER_MAX_MOTORS) return;
+
+    stats[motor].missed += count;
+}
+
+void jitter_dump(void) {
+    printf("JITTER BEGIN\n");
+    for (int m = 0; m < JITTER_MAX_MOTORS; m++) {
+        struct jitter_stats_t *s = &stats[m];
+        printf("motor %d count %d max %d missed %d buckets", m, s->count, s->max, s->missed);
+        for (int b = 0; b < JITTER_BUCKETS; b++) {
+            printf(" %d", s->buckets[b]);
+        }
+        printf(" switches %d switch_max %d\n", s->switches, s->switch_max);
+    }
+    printf("JITTER END\n");
+}
@@ -0,0 +1,37 @@
+// This file defines the step-jitter recorder for the motor board
+// For every step pulse the scheduler records how late it fired compared to its deadline
+// Lateness is kept per motor in a log2-bucketed histogram, along with the maximum lateness
+// and the number of whole periods that were skipped because a step came too late
+// Steps that switch a time-shared motor to its next pitch are also counted on their own,
+// so the cost of switching shows up separately from ordinary steps
+
+#ifndef _JITTER_H
+#define _JITTER_H
+
+// Bucket 0 counts steps that were on time, bucket k counts lateness in [2^(k-1), 2^k) microseconds
+// The last bucket also collects everything larger
+#define JITTER_BUCKETS 16
+
+// Maximum number of motors tracked
+#define JITTER_MAX_MOTORS 8
+
+// Clear all recorded statistics
+void jitter_reset(void);
+
+// Record a step that fired `lateness` microseconds after its deadline (safe to call from interrupts)
+void jitter_record(unsigned int motor, unsigned int lateness);
+
+// Record that a step also switched the motor to the next pitch of its time slices (safe to call from interrupts)
+// `lateness` is the time from the step's deadline until the switch was done
+void jitter_switch(unsigned int motor, unsigned int lateness);
+
+// Record that `count` whole step periods were skipped (safe to call from interrupts)
+void jitter_missed(unsigned int motor, unsigned int count);
+
+// Print all statistics over UART, one line per motor, in the format read by `tools/jitter_decode`:
+//     JITTER BEGIN
+//     motor <m> count <n> max <us> missed <k> buckets <b0> ... <b15> switches <s> switch_max <us>
+//     JITTER END
+void jitter_dump(void);
+
+#endif
@@ -7,101 +7,26 @@
 #include "interrupts.h"
 
 #include "naj.h"
-
-#define NUM_MOTORS 8
-
-// Constants defining the pitch to play each note, given in microseconds between each step
-// Mirrors the namec constants (NOTE_C0 etc) defined in notes.h
-// Indices in this array correspond to indices on a physical piano (A0 is index 0 and is the leftmost key)
-const unsigned int note_delays[] = {
-    36364, // A0
-    34317, // A#0/Bb0
-    32394, // B0
-    30581, // C1
-    28860, // C#1/Db1
-    27241, // D1
-    25714, // D#1/Eb1
-    24272, // E1
-    22910, // F1
-    21622, // F#1/Gb1
-    20408, // G1
-    19264, // G#1/Ab1
-    18182, // A1
-    17161, // A#1/Bb1
-    16197, // B1
-    15288, // C2
-    14430, // C#2/Db2
-    13620, // D2
-    12857, // D#2/Eb2
-    12134, // E2
-    11453, // F2
-    10811, // F#2/Gb2
-    10204, // G2
-    9631, // G#2/Ab2
-    9091, // A2
-    8581, // A#2/Bb2
-    8099, // B2
-    7645, // C3
-    3608, // 7216, // C#3/Db3
-    3405, // 6811, // D3
-    3214, // 6428, // D#3/Eb3
-    6068, // E3
-    5727, // F3
-    5405, // F#3/Gb3
-    2551, // 5102, // G3
-    4816, // G#3/Ab3
-    4545, // A3
-    4290, // A#3/Bb3
-    4050, // B3
-    3822, // C4
-    3608, // C#4/Db4
-    3405, // D4
-    3214, // D#4/Eb4
-    3034, // E4
-    2863, // F4
-    2703, // F#4/Gb4
-    2551, // G4
-    2408, // G#4/Ab4
-    2273, // A4
-    2145, // A#4/Bb4
-    2025, // B4
-    1911, // C5
-    1804, // C#5/Db5
-    1703, // D5
-    1607, // D#5/Eb5
-    1517, // E5
-    1432, // F5
-    1351, // F#5/Gb5
-    1276, // G5
-    1204, // G#5/Ab5
-    1136, // A5
-    1073, // A#5/Bb5
-    1012, // B5
-    956, // C6
-    902, // C#6/Db6
-    851, // D6
-    804, // D#6/Eb6
-    758, // E6
-    716, // F6
-    676, // F#6/Gb6
-    638, // G6
-    602, // G#6/Ab6
-    568, // A6
-    536, // A#6/Bb6
-    506, // B6
-    478, // C7
-    451, // C#7/Db7
-    426, // D7
-    402, // D#7/Eb7
-    379, // E7
-    358, // F7
-    338, // F#7/Gb7
-    319, // G7
-    301, // G#7/Ab7
-    284, // A7
-    268, // A#7/Bb7
-    253, // B7
-    239, // C8
+#include "pitch.h"
+#include "sched.h"
+#include "jitter.h"
+#include "dmastep.h"
+
+#define NUM_MOTORS NAJ_MOTORS
+
+// Set to 1 to play step pulses through the DMA engine (see dmastep.h) instead of from the timer interrupt
+#define USE_DMA_STEPS 0
+
+// Logical voices - each motor alternates between the voices assigned to it in short time slices
+#define NUM_VOICES (NUM_MOTORS * SCHED_MAX_SLOTS)
+
+// Keys played an octave up, because these motors resonate (and rattle) at the written pitch
+// Indices correspond to indices on a physical piano (A0 is index 0 and is the leftmost key)
+static const unsigned char octave_up_keys[] = {
+    28, // C#3/Db3
+    29, // D3
+    30, // D#3/Eb3
+    34, // G3
 };
 
 // Store step pins for each motor
@@ -117,73 +42,141 @@ const int step_pins[NUM_MOTORS] = {
 };
 
 
-// Store the delay between pulses for each motor, and whether each motor is playing
-unsigned int motor_delays[NUM_MOTORS] = {
-    NOTE_C2,
-    NOTE_E2,
-    NOTE_G2,
-    NOTE_C3,
-    NOTE_E3,
-    NOTE_G3,
-    NOTE_C4,
-    NOTE_E4
-};    // Microseconds between each step pulse
-
-unsigned int motor_active[NUM_MOTORS];    // 1 = playing, 0 = not playing
-
-// Store the next step time for each motor (the value of `timer_get_ticks` when each motor next needs to step)
-unsigned int next_step_times[NUM_MOTORS];
-
-static void step_motor(unsigned int motor_num) {
-    // Simple helper function to make the desired motor make a single step and update next step time
-    // Pulses that motor's step pin high then low
-    gpio_write(step_pins[motor_num], 1);
-    gpio_write(step_pins[motor_num], 0);
+// GPIO set and clear registers: writing a 1 bit drives that pin high (or low), other pins are untouched
+#define GPSET0 ((volatile unsigned int *)0x2020001C)
+#define GPCLR0 ((volatile unsigned int *)0x20200028)
+
+// Ticks each step pulse is held high - the driver needs about 1us, and waiting for 2 tick changes
+// guarantees at least one full microsecond
+#define STEP_PULSE_TICKS 2
+
+// GPSET0/GPCLR0 bit of each motor's step pin (all step pins are below GPIO 32)
+static unsigned int step_masks[NUM_MOTORS];
+
+static void step_motors(unsigned int motors, unsigned int when) {
+    // Make every motor in `motors` (bit m = motor m) take a single step, all in the same pulse
+    // Called by the scheduler from the timer interrupt when the motors' next steps are due
+    // (or, with DMA steps, DMASTEP_LEAD_US before then)
+    unsigned int pins = 0;
+    while (motors) {
+        pins |= step_masks[__builtin_ctz(motors)];
+        motors &= motors - 1;
+    }
+
+    // A step the ring can no longer take (the scheduler fell behind by more than the lead) is pulsed now
+    if (USE_DMA_STEPS && dmastep_queue(pins, when)) return;
+
+    *GPSET0 = pins;
+    unsigned int start = timer_get_ticks();
+    while (timer_get_ticks() - start < STEP_PULSE_TICKS);
+    *GPCLR0 = pins;
 }
 
-static void handle_naj_byte(void){
-    // Helper function to read and process a byte being received over naj
-    static unsigned int bytes_received = 0;
-    static unsigned char note_num;
-    static unsigned char motor_num;
+// Note currently played by each voice (piano key index, or NAJ_NOTE_OFF)
+static unsigned char voice_notes[NUM_VOICES];
+
+// Pitch bend (centred on 0) and transposition in semitones of each voice
+static int voice_bends[NUM_VOICES];
+static int voice_transposes[NUM_VOICES];
 
-    unsigned char data = naj_read_byte();
+#if PITCH_FRAC_BITS != SCHED_FRAC_BITS
+#error "pitch periods and scheduler periods must use the same fixed point format"
+#endif
 
-    if (bytes_received == 0) {
-        if (data != 0xee) return;
+static unsigned int note_period(unsigned char voice, unsigned char note_num) {
+    // Sentinel value 0xff = turn off, other values = that note's step period with the voice's bend applied
+    if (note_num == NAJ_NOTE_OFF) return 0;
 
-        bytes_received++;
-        return;
+    int transpose = voice_transposes[voice];
+    for (unsigned int i = 0; i < sizeof(octave_up_keys); i++) {
+        if (octave_up_keys[i] == note_num) transpose += 12;
     }
+    return pitch_period(note_num, transpose, voice_bends[voice]);
+}
+
+static void set_motor_note(unsigned char voice, unsigned char note_num) {
+    // Helper function to update one voice - does nothing if the voice already plays that note,
+    // so repeated state snapshots do not restart motors
+    if (voice >= NUM_VOICES || voice_notes[voice] == note_num) return;
+    if (note_num != NAJ_NOTE_OFF && note_num >= PITCH_KEYS) return;
 
-    // Byte 1 - note number
-    if (bytes_received == 1) {
-        printf("Note: %02x", data);
-        note_num = data;
-        bytes_received++;
-        return;
+    sched_set_slot(voice % NUM_MOTORS, voice / NUM_MOTORS, note_period(voice, note_num));
+    voice_notes[voice] = note_num;
+}
+
+static void set_motor_note_at(unsigned int time, unsigned char voice, unsigned char note_num) {
+    // Helper function to update one voice at a shared time - the scheduler applies it from the timer
+    // interrupt, so the note starts on time however late the frame was processed
+    if (voice >= NUM_VOICES) return;
+    if (note_num != NAJ_NOTE_OFF && note_num >= PITCH_KEYS) return;
+
+    sched_at(naj_time_to_ticks(time), voice % NUM_MOTORS, voice / NUM_MOTORS, note_period(voice, note_num));
+
+    // Record the note now so a snapshot arriving before the deadline does not duplicate it
+    voice_notes[voice] = note_num;
+}
+
+static void retune_voice(unsigned char voice) {
+    // Helper function to apply a voice's new bend or transposition to the note it is playing
+    // The note is retuned in place, so a bend glides instead of restarting the note
+    if (voice_notes[voice] == NAJ_NOTE_OFF) return;
+    sched_retune_slot(voice % NUM_MOTORS, voice / NUM_MOTORS, note_period(voice, voice_notes[voice]));
+}
+
+static void set_voice_bend(unsigned char voice, int bend) {
+    // Helper function to bend one voice, or every voice for NAJ_ALL_MOTORS
+    for (int i = 0; i < NUM_VOICES; i++) {
+        if (voice != NAJ_ALL_MOTORS && voice != i) continue;
+        voice_bends[i] = bend;
+        retune_voice(i);
     }
+}
 
-    // Byte 1 - data
-    if (bytes_received == 2) {
-        motor_num = data;
-        printf("     motor: %02x\n", data);
-
-        // Packet is now complete - update motor accordingly
-        if (note_num == 0xff) {
-            // Sentinel value 0xff = turn off specified motor
-            motor_active[motor_num] = 0;
-        } else {
-            // Other values - activte motor and set to desired note delay
-            //if (note_num <= 14) note_num += 12;
-            //note_num += 12;
-
-            motor_delays[motor_num] = note_delays[note_num];
-            next_step_times[motor_num] = timer_get_ticks() + motor_delays[motor_num];
-            motor_active[motor_num] = 1;
-        }
+static void set_voice_transpose(unsigned char voice, int transpose) {
+    // Helper function to transpose one voice, or every voice for NAJ_ALL_MOTORS
+    for (int i = 0; i < NUM_VOICES; i++) {
+        if (voice != NAJ_ALL_MOTORS && voice != i) continue;
+        voice_transposes[i] = transpose;
+        retune_voice(i);
+    }
+}
+
+static void handle_naj_frame(const struct naj_frame_t *frame) {
+    // Helper function to apply every command in a frame received over naj
+    unsigned int pos = 0;
+    struct naj_cmd_t cmd;
 
-        bytes_received = 0;
+    while (naj_frame_next(frame, &pos, &cmd)) {
+        if (cmd.type == NAJ_CMD_NOTES) {
+            for (int i = 0; i + 1 < cmd.nargs; i += 2) {
+                set_motor_note(cmd.args[i], cmd.args[i + 1]);
+            }
+        } else if (cmd.type == NAJ_CMD_NOTES_AT && cmd.nargs >= 4) {
+            unsigned int time = naj_read_u32(cmd.args);
+            for (int i = 4; i + 1 < cmd.nargs; i += 2) {
+                set_motor_note_at(time, cmd.args[i], cmd.args[i + 1]);
+            }
+        } else if (cmd.type == NAJ_CMD_SNAPSHOT) {
+            // Full state - brings the motors back in line if an earlier frame was lost
+            for (int i = 0; i < cmd.nargs; i++) {
+                set_motor_note(i, cmd.args[i]);
+            }
+        } else if (cmd.type == NAJ_CMD_JITTER_DUMP) {
+            jitter_dump();
+        } else if (cmd.type == NAJ_CMD_SLICE && cmd.nargs >= 2) {
+            sched_set_slice(cmd.args[0] | (cmd.args[1] << 8));
+        } else if (cmd.type == NAJ_CMD_BEND) {
+            for (int i = 0; i + 2 < cmd.nargs; i += 3) {
+                set_voice_bend(cmd.args[i], (cmd.args[i + 1] | (cmd.args[i + 2] << 7)) - 0x2000);
+            }
+        } else if (cmd.type == NAJ_CMD_ENUM) {
+            // naj has already handled it - just report which address we ended up with
+            printf("Board address: %d\n", naj_address());
+        } else if (cmd.type == NAJ_CMD_TRANSPOSE) {
+            for (int i = 0; i + 1 < cmd.nargs; i += 2) {
+                set_voice_transpose(cmd.args[i], (signed char) cmd.args[i + 1]);
+            }
+        }
     }
 }
 
@@ -196,42 +189,41 @@ void main(void)
 
     naj_init_read();
 
+    // The motor board is the reader that acknowledges bytes when the bus is paced by ACK
+    if (NAJ_USE_ACK) naj_enable_ack();
+
     interrupts_global_enable();
 
     // Set all motor step pins to outputs
-    // Also initialize all motors to not playing with the maximum possible delay
     for (int i = 0; i < NUM_MOTORS; i++) {
         gpio_set_output(step_pins[i]);
+        step_masks[i] = 1 << step_pins[i];
+    }
+    for (int i = 0; i < NUM_VOICES; i++) {
+        voice_notes[i] = NAJ_NOTE_OFF;
+        voice_bends[i] = 0;
+        voice_transposes[i] = 0;
+    }
 
-        motor_active[i] = 0;
-
+    // All motors start off - steps are fired by the scheduler's timer interrupt once notes arrive
+    sched_init(NUM_MOTORS, step_motors);
+    if (USE_DMA_STEPS) {
+        dmastep_init();
+        sched_set_lead(DMASTEP_LEAD_US);
     }
 
     // Wait for start signal from host
     printf("Waiting for host...");
-    while (1) {
-        if (naj_has_data()) {
-            if (naj_read_byte() == 0x19) break;
-        }
-    }
+    // The handshake also starts the shared timebase used by timed notes
+    naj_wait_handshake();
     printf("Connected!\n");
 
+    struct naj_frame_t frame;
     while (1) {
-        // Read and process naj data that has been received
-        if (naj_has_data()) {
-            handle_naj_byte();
-        }
-
-        // Loop through all motors
-        for (int i = 0; i < NUM_MOTORS; i++) {
-            if (!motor_active[i]) continue; // Skip if this motor is not playing
-
-            // If motor needs to step, do step and calculate next step time based on frequency
-            unsigned int time = timer_get_ticks();
-            if (time > next_step_times[i]) {
-                next_step_times[i] = time + motor_delays[i];
-                step_motor(i);
-            }
+        // Read and process naj frames that have been received
+        // Motor steps happen in the scheduler's timer interrupt, so this loop can take its time
+        if (naj_read_frame(&frame)) {
+            handle_naj_frame(&frame);
         }
     }
 }
@@ -1,8 +1,11 @@
 // This file implements the functions for the NAJ interface as defined in `naj.h`
 #include "naj.h"
+#include "clocksync.h"
+#include "najtx.h"
 #include "gpio.h"
 #include "gpio_extra.h"
 #include "gpio_interrupts.h"
+#include "armtimer.h"
 #include "interrupts.h"
 #include "ringbuffer.h"
 #include "timer.h"
@@ -20,22 +23,123 @@ static const unsigned int data_pins[] = {
     NAJ_BIT7,
 };
 
+// GPIO registers, so all data pins can be written or read at once (BCM2835 peripherals manual, section 6.1)
+#define GPIO_SET0 ((volatile unsigned int *)0x2020001C)
+#define GPIO_CLR0 ((volatile unsigned int *)0x20200028)
+#define GPIO_LEV0 ((volatile unsigned int *)0x20200034)
+
+// Writing the ARM timer load register restarts the countdown, so the writer can re-arm the transmit
+// timer for each step of an ACK-paced byte (as `sched.c` does for its deadlines)
+#ifndef ARMTIMER_LOAD
+#define ARMTIMER_LOAD ((volatile unsigned int *)0x2000B400)
+#endif
+
+// The data pins are scattered over two windows of the GPIO level register
+// Each window is looked up in its own table to turn a GPLEV read into a byte
+// (every NAJ_BIT pin must fall inside one of them)
+#define LEV_LOW_SHIFT 7   // GPIO 7-12
+#define LEV_LOW_BITS 6
+#define LEV_HIGH_SHIFT 16 // GPIO 16-25
+#define LEV_HIGH_BITS 10
+
+static unsigned char low_pins_to_byte[1 << LEV_LOW_BITS];     // Byte bits carried by GPIO 7-12
+static unsigned char high_pins_to_byte[1 << LEV_HIGH_BITS];   // Byte bits carried by GPIO 16-25
+
 // Internal ringbuffer to store bytes as they arrive
 static rb_t *data_ringbuffer;
+static unsigned int ack_enabled;
+static unsigned int ack_level;
+
+// Internal ringbuffer to store bytes waiting to be sent, drained by the transmit timer interrupt
+static rb_t *tx_ringbuffer;
+static struct najtx_t tx;
+static volatile unsigned int tx_enqueued;
+static volatile unsigned int tx_dequeued;
+
+// Bytes the transmit queue takes at most - within what a libpi ringbuffer holds, so a frame that
+// fits by this count never finds the ringbuffer full halfway through
+#define TX_QUEUE_BYTES 255
+
+// Queued bytes flagged with this bit record the time they are clocked out in `tx_mark_time`
+#define TX_MARK 0x100
+static volatile unsigned int tx_mark_time;
+static volatile unsigned int tx_marks;     // Marked bytes clocked out so far
+
+// Run at the start of every transmit interrupt (see `naj_set_tx_hook`)
+static void (*tx_hook)(void);
+
+// Shared timebase: the host's clock, counting from the moment the handshake byte was clocked
+// On the host the model is just an offset; readers refine theirs from SYNC/SYNC_TIME frame pairs
+static struct clocksync_t shared_clock;
+
+// Received bytes are queued with the low bits of the tick they were latched at above the data
+#define RX_TIME_SHIFT 8
+#define RX_TIME_MASK 0xFFFFFF
+// Board addressing: the host's count of boards, and a reader's own address and the count it was told
+static unsigned int board_count = 1;
+static struct naj_addr_t rx_addr;
+static volatile unsigned int rx_chain_high;  // ENUM_IN has risen, at local tick `rx_chain_rise`
+static volatile unsigned int rx_chain_rise;
+
+// Frame reader state: the frame being assembled lives in the parser, not in the caller's frame
+static struct naj_parser_t rx_parser;
+static struct naj_frame_t rx_frame;
+static unsigned int rx_sync_time;   // Local tick at which the last SYNC frame's sync byte was latched
+static unsigned char rx_sync_seq;
+static unsigned int rx_sync_valid;
+
+static unsigned int tx_max_depth;
+static unsigned int tx_overflows;
+
+static void build_pin_tables(void) {
+    // Precompute the reverse lookups for the reader (the writer's tables live in `tx`)
+    for (unsigned int lev = 0; lev < (1 << LEV_LOW_BITS); lev++) {
+        low_pins_to_byte[lev] = 0;
+        for (int i = 0; i < 8; i++) {
+            unsigned int bit = data_pins[i] - LEV_LOW_SHIFT;
+            if (data_pins[i] >= LEV_LOW_SHIFT && bit < LEV_LOW_BITS && (lev & (1 << bit))) low_pins_to_byte[lev] |= 1 << i;
+        }
+    }
+
+    for (unsigned int lev = 0; lev < (1 << LEV_HIGH_BITS); lev++) {
+        high_pins_to_byte[lev] = 0;
+        for (int i = 0; i < 8; i++) {
+            unsigned int bit = data_pins[i] - LEV_HIGH_SHIFT;
+            if (data_pins[i] >= LEV_HIGH_SHIFT && bit < LEV_HIGH_BITS && (lev & (1 << bit))) high_pins_to_byte[lev] |= 1 << i;
+        }
+    }
+}
 
 static void handle_clock_pulse(unsigned int pc, void *aux_data) {
     // Interrupt handler to run on the rising edge of the clock pulse
-    unsigned int data = 0;
+    unsigned int time = timer_get_ticks();
 
-    for (int i = 0; i < 8; i++) {
-        data |= (gpio_read(data_pins[i]) << i);
-    }
+    // Read all data pins with a single register read
+    unsigned int lev = *GPIO_LEV0;
+    unsigned int data = low_pins_to_byte[(lev >> LEV_LOW_SHIFT) & ((1 << LEV_LOW_BITS) - 1)]
+                      | high_pins_to_byte[(lev >> LEV_HIGH_SHIFT) & ((1 << LEV_HIGH_BITS) - 1)];
 
-    rb_enqueue(data_ringbuffer, data);
+    rb_enqueue(data_ringbuffer, data | (time << RX_TIME_SHIFT));
     gpio_clear_event(NAJ_CLOCK);
+
+    // Tell the writer the byte has been latched by toggling the ACK line
+    if (ack_enabled) {
+        ack_level = !ack_level;
+        if (ack_level) *GPIO_SET0 = 1 << NAJ_ACK;
+        else *GPIO_CLR0 = 1 << NAJ_ACK;
+    }
 }
 
 
+static void handle_chain_rise(unsigned int pc, void *aux_data) {
+    // Timestamp the board before us taking its address, to tell which offers came after it
+    gpio_clear_event(NAJ_ENUM_IN);
+    if (rx_chain_high) return;
+
+    rx_chain_rise = timer_get_ticks();
+    rx_chain_high = 1;
+}
+
 // Initialize this device to read data
 void naj_init_read(void) {
     // Set all data pins and clock to inputs
@@ -46,7 +150,19 @@ void naj_init_read(void) {
         gpio_set_input(data_pins[i]);
     }
 
+    build_pin_tables();
     data_ringbuffer = rb_new();
+    naj_parser_init(&rx_parser);
+    ack_enabled = 0;
+
+    // Boards off the enumeration chain see ENUM_IN low forever and keep address 0
+    gpio_set_input(NAJ_ENUM_IN);
+    gpio_set_pulldown(NAJ_ENUM_IN);
+    gpio_set_output(NAJ_ENUM_OUT);
+    gpio_write(NAJ_ENUM_OUT, 0);
+    naj_addr_init(&rx_addr);
+    rx_chain_rise = timer_get_ticks();
+    rx_chain_high = gpio_read(NAJ_ENUM_IN);
 
     // Initialize interrupts on the clock pin
     // Globlal interrupts must have already been enabled my the mian PROGRAM
@@ -54,9 +170,56 @@ void naj_init_read(void) {
 
     gpio_interrupts_init();
     gpio_interrupts_register_handler(NAJ_CLOCK, handle_clock_pulse, NULL);
+    gpio_enable_event_detection(NAJ_ENUM_IN, GPIO_DETECT_RISING_EDGE);
+    gpio_interrupts_register_handler(NAJ_ENUM_IN, handle_chain_rise, NULL);
     gpio_interrupts_enable();
 }
 
+void naj_enable_ack(void) {
+    // Only one reader on the bus may drive the ACK line
+    gpio_set_output(NAJ_ACK);
+    gpio_write(NAJ_ACK, 0);
+    ack_level = 0;
+    ack_enabled = 1;
+}
+
+static int tx_dequeue(int *data, void *aux) {
+    if (!rb_dequeue(tx_ringbuffer, data)) return 0;
+    tx_dequeued++;
+    return 1;
+}
+
+static void apply_tx_flags(int done) {
+    if ((done & NAJTX_RAISED) && (tx.data & TX_MARK)) {
+        tx_mark_time = timer_get_ticks();
+        tx_marks++;
+    }
+
+    if (done & NAJTX_STOP) {
+        // Queue drained - stop the timer until the next write, which starts it a tick later
+        armtimer_disable();
+        *ARMTIMER_LOAD = NAJ_DELAY;
+    } else if (done & NAJTX_WAIT) {
+        *ARMTIMER_LOAD = tx.wait;
+        armtimer_enable();
+    }
+}
+
+static void handle_tx_tick(unsigned int pc, void *aux_data) {
+    // Interrupt handler run every NAJ_DELAY microseconds while there is data to send, or with ACK
+    // when the writer's next step or its ACK timeout is due
+    armtimer_check_and_clear_interrupt();
+    if (tx_hook) tx_hook();
+    apply_tx_flags(najtx_tick(&tx, timer_get_ticks(), tx_dequeue, NULL));
+}
+
+static void handle_tx_ack(unsigned int pc, void *aux_data) {
+    // Interrupt handler run when the ACK line toggles: the reader has the byte, so clock the next
+    gpio_clear_event(NAJ_ACK);
+    if (tx_hook) tx_hook();
+    apply_tx_flags(najtx_ack(&tx, timer_get_ticks(), tx_dequeue, NULL));
+}
+
 // Initialize this device to write data
 void naj_init_write(void) {
     // Set all data pins and clock to inputs
@@ -67,19 +230,131 @@ void naj_init_write(void) {
         gpio_set_output(data_pins[i]);
         gpio_write(data_pins[i], 0);
     }
+
+    tx_ringbuffer = rb_new();
+
+    gpio_set_output(NAJ_ENUM_OUT);
+    gpio_write(NAJ_ENUM_OUT, 0);
+    gpio_set_input(NAJ_ENUM_IN);
+    gpio_set_pulldown(NAJ_ENUM_IN);
+    board_count = 1;
+    tx_enqueued = 0;
+    tx_dequeued = 0;
+    tx_max_depth = 0;
+    tx_overflows = 0;
+
+    gpio_set_input(NAJ_ACK);
+    gpio_set_pulldown(NAJ_ACK);
+    najtx_init(&tx, GPIO_SET0, GPIO_CLR0, GPIO_LEV0, data_pins, NAJ_CLOCK, NAJ_ACK, NAJ_USE_ACK);
+
+    // With ACK each toggle of the line clocks the next byte straight away; the timer is then only
+    // the setup delay, the hold and the timeout
+    if (NAJ_USE_ACK) {
+        gpio_enable_event_detection(NAJ_ACK, GPIO_DETECT_RISING_EDGE);
+        gpio_enable_event_detection(NAJ_ACK, GPIO_DETECT_FALLING_EDGE);
+        gpio_interrupts_register_handler(NAJ_ACK, handle_tx_ack, NULL);
+        gpio_interrupts_enable();
+    }
+
+    // Timer only runs while there is data to send
+    // Globlal interrupts must have already been enabled my the mian PROGRAM
+    armtimer_init(NAJ_DELAY);
+    armtimer_enable_interrupts();
+
+    interrupts_register_handler(INTERRUPTS_BASIC_ARM_TIMER_IRQ, handle_tx_tick, NULL);
+    interrupts_enable_source(INTERRUPTS_BASIC_ARM_TIMER_IRQ);
 }
 
-// Write one byte of data over the NAJ bus
-void naj_write_byte(unsigned char data) {
-    // Write bits to all pins
-    for (int i = 0; i < 8; i++) {
-        gpio_write(data_pins[i], data & (1 << i));
+static int tx_room(unsigned int n) {
+    // The interrupt only ever makes more room, so there is at least this much until the next write
+    if (tx_enqueued - tx_dequeued + n <= TX_QUEUE_BYTES) return 1;
+    tx_overflows++;
+    return 0;
+}
+
+// Queue `n` bytes, all or none: returns 0, queuing nothing, if they do not all fit
+static int tx_enqueue(const int *data, unsigned int n) {
+    if (!tx_room(n)) return 0;
+
+    for (unsigned int i = 0; i < n; i++) {
+        rb_enqueue(tx_ringbuffer, data[i]);
     }
+    tx_enqueued += n;
 
-    // Pulse clock
-    gpio_write(NAJ_CLOCK, 1);
-    timer_delay_us(NAJ_DELAY);
-    gpio_write(NAJ_CLOCK, 0);
+    unsigned int depth = naj_tx_depth();
+    if (depth > tx_max_depth) tx_max_depth = depth;
+
+    // (Re)start the transmit timer - harmless if it is already running
+    armtimer_enable();
+    return 1;
+}
+
+// Queue one byte of data to be sent over the NAJ bus
+int naj_write_byte(unsigned char data) {
+    int entry = data;
+    return tx_enqueue(&entry, 1);
+}
+
+static unsigned char read_byte_stamped(unsigned int *time) {
+    int data;
+    rb_dequeue(data_ringbuffer, &data);
+
+    // Rebuild the full tick from its low bits - fine as long as bytes are read within ~16 seconds
+    unsigned int now = timer_get_ticks();
+    *time = now - ((now - ((unsigned int) data >> RX_TIME_SHIFT)) & RX_TIME_MASK);
+    return data & 0xFF;
+}
+
+void naj_send_handshake(void) {
+    // Time 0 is the moment the handshake is clocked out, which the readers timestamp too
+    int entry = NAJ_HANDSHAKE | TX_MARK;
+    tx_enqueue(&entry, 1);
+    naj_flush();
+    clocksync_init(&shared_clock, tx_mark_time, 0);
+}
+
+void naj_wait_handshake(void) {
+    unsigned int time;
+    while (1) {
+        if (naj_has_data() && read_byte_stamped(&time) == NAJ_HANDSHAKE) break;
+    }
+    clocksync_init(&shared_clock, time, 0);
+}
+
+unsigned int naj_time(void) {
+    return clocksync_to_master(&shared_clock, timer_get_ticks());
+}
+
+unsigned int naj_time_to_ticks(unsigned int time) {
+    return clocksync_to_local(&shared_clock, time);
+}
+
+int naj_time_error(void) {
+    return shared_clock.last_error;
+}
+
+void naj_flush(void) {
+    while (naj_tx_depth() > 0 || tx.state != NAJTX_IDLE) {}
+}
+
+unsigned int naj_tx_depth(void) {
+    return tx_enqueued - tx.sent;
+}
+
+unsigned int naj_tx_max_depth(void) {
+    return tx_max_depth;
+}
+
+unsigned int naj_tx_overflows(void) {
+    return tx_overflows;
+}
+
+void naj_set_tx_hook(void (*fn)(void)) {
+    tx_hook = fn;
+}
+
+unsigned int naj_tx_ack_timeouts(void) {
+    return tx.ack_timeouts;
 }
 
 // To be used only in reading mode
@@ -91,8 +366,155 @@ unsigned char naj_has_data(void) {
 // To be used only in reading mode
 // Return the most recent byte in the ringbuffer
 unsigned char naj_read_byte(void) {
-    int data;
-    rb_dequeue(data_ringbuffer, &data);
+    unsigned int time;
+    return read_byte_stamped(&time);
+}
+
+// Frame writer state
+static unsigned char tx_seq;
+
+// A SYNC frame whose SYNC_TIME is still to be sent, once its sync byte has been clocked out
+static unsigned int sync_pending;
+static unsigned char sync_seq;
+static unsigned int sync_marks;     // `tx_marks` before it was queued
+
+// `mark` is TX_MARK to record when the frame's sync byte is clocked out, or 0
+// Returns 0, queuing nothing and using no sequence number, if the frame does not fit in the queue
+static int frame_send(struct naj_frame_t *frame, int mark) {
+    frame->seq = tx_seq;
+
+    unsigned char bytes[NAJ_MAX_FRAME];
+    unsigned int n = naj_frame_encode(frame, bytes);
+
+    int entries[NAJ_MAX_FRAME];
+    for (unsigned int i = 0; i < n; i++) {
+        entries[i] = bytes[i];
+    }
+    entries[0] |= mark;
+
+    if (!tx_enqueue(entries, n)) return 0;
+    tx_seq++;
+    return 1;
+}
+
+int naj_frame_send(struct naj_frame_t *frame) {
+    return frame_send(frame, 0);
+}
+
+void naj_send_sync(void) {
+    // Two step exchange over the one-way bus: the SYNC frame is timestamped by both ends as its
+    // sync byte is clocked, then SYNC_TIME tells the readers what the host's timestamp was
+    // A SYNC that does not fit now is simply skipped until the next period
+    if (sync_pending) return;
+
+    struct naj_frame_t frame;
+    naj_frame_begin(&frame);
+    naj_frame_add(&frame, NAJ_CMD_SYNC, NULL, 0);
+    unsigned int marks = tx_marks;
+    if (!frame_send(&frame, TX_MARK)) return;
+
+    sync_seq = frame.seq;
+    sync_marks = marks;
+    sync_pending = 1;
+}
+
+void naj_poll_write(void) {
+    // The transmit interrupt stamps the SYNC frame's sync byte as it goes out; the SYNC_TIME with
+    // that stamp follows on the first pass after, rather than waiting here for the bus
+    if (!sync_pending || tx_marks == sync_marks) return;
+
+    unsigned int time = clocksync_to_master(&shared_clock, tx_mark_time);
+    unsigned char args[5] = {sync_seq, time, time >> 8, time >> 16, time >> 24};
+    struct naj_frame_t frame;
+    naj_frame_begin(&frame);
+    naj_frame_add(&frame, NAJ_CMD_SYNC_TIME, args, 5);
+    if (frame_send(&frame, 0)) sync_pending = 0;
+}
+
+static void enum_send(struct naj_frame_t *frame, void *aux) {
+    // Enumeration runs before anything else is queued, and waits for each frame anyway
+    while (!naj_frame_send(frame)) {}
+    naj_flush();
+}
+
+static int enum_chain_end(void *aux) {
+    return gpio_read(NAJ_ENUM_IN);
+}
+
+static unsigned int enum_ticks(void *aux) {
+    return timer_get_ticks();
+}
+
+unsigned int naj_enumerate(void) {
+    // Raise the start of the chain, then let the boards claim addresses in turn
+    gpio_write(NAJ_ENUM_OUT, 1);
+
+    struct naj_enum_io_t io = { enum_send, enum_chain_end, enum_ticks, NULL };
+    board_count = naj_enum_run(&io);
+    return board_count;
+}
+
+unsigned int naj_board_count(void) {
+    return board_count;
+}
+
+unsigned char naj_address(void) {
+    return rx_addr.address;
+}
+
+void naj_listen_all(void) {
+    rx_addr.listen_all = 1;
+}
+
+static void apply_clock_commands(const struct naj_frame_t *frame) {
+    unsigned int pos = 0;
+    struct naj_cmd_t cmd;
+
+    while (naj_frame_next(frame, &pos, &cmd)) {
+        if (cmd.type == NAJ_CMD_SYNC) {
+            rx_sync_time = frame->time;
+            rx_sync_seq = frame->seq;
+            rx_sync_valid = 1;
+        } else if (cmd.type == NAJ_CMD_SYNC_TIME && cmd.nargs >= 5) {
+            // Only pair the timestamp with the SYNC frame it belongs to
+            if (rx_sync_valid && cmd.args[0] == rx_sync_seq) {
+                clocksync_sample(&shared_clock, rx_sync_time, naj_read_u32(&cmd.args[1]));
+            }
+            rx_sync_valid = 0;
+        }
+    }
+
+    int chain_in = rx_chain_high && (int)(frame->time - rx_chain_rise) >= 0;
+    if (naj_addr_handle(&rx_addr, frame, chain_in)) gpio_write(NAJ_ENUM_OUT, 1);
+    board_count = rx_addr.boards;
+}
+
+int naj_read_frame(struct naj_frame_t *frame) {
+    while (1) {
+        // Frames already complete come first, so the parser always has room for the next byte
+        while (naj_parser_frame(&rx_parser, &rx_frame)) {
+            if (!naj_addr_accepts(&rx_addr, rx_frame.addr)) continue;
+
+            apply_clock_commands(&rx_frame);
+            *frame = rx_frame;
+            return 1;
+        }
+        if (!naj_has_data()) return 0;
+
+        unsigned int time;
+        unsigned char data = read_byte_stamped(&time);
+        naj_parser_push(&rx_parser, data, time);
+    }
+}
+
+unsigned int naj_rx_frames(void) {
+    return rx_parser.frames;
+}
+
+unsigned int naj_rx_crc_errors(void) {
+    return rx_parser.crc_errors;
+}
 
-    return data;
+unsigned int naj_rx_lost_frames(void) {
+    return rx_parser.lost_frames;
 }
@@ -3,17 +3,33 @@
 // using 8 data bits in parallel and one clock line
 
 // The host sets all 8 data bits and then pulses the clock pin
+// Writes are queued and clocked out asynchronously by the ARM timer interrupt (see `najtx.h`)
+// Optionally, one reader toggles an ACK line after latching each byte, and the host holds each
+// clock pulse until it sees the ACK, so it never runs ahead of that reader - and clocks the next
+// byte from the ACK's edge interrupt, rather than waiting for a timer tick
+
+// On top of the byte interface, motor updates are sent in frames, addressed to one of several motor
+// boards along a daisy chain (see `najframe.h`)
 
 #ifndef _NAJ_H
 #define _NAJ_H
 
 #include "gpio.h"
+#include "najframe.h"
+#include "najtx.h"
+
+// Set to 1 to pace the bus with the ACK line (the reader driving it must call `naj_enable_ack`)
+#define NAJ_USE_ACK 0
 
-// Defines how long to hold the pulse clock pin for when sending a byte
-#define NAJ_DELAY 10
+// Raw byte sent by the host once at startup, before any frames
+#define NAJ_HANDSHAKE 0x19
+
+// How often the host should call `naj_send_sync`, in microseconds
+#define NAJ_SYNC_PERIOD 1000000
 
 // Constants to define which pin
 #define NAJ_CLOCK GPIO_PIN23
+#define NAJ_ACK GPIO_PIN26
 
 // Least significant bit first
 #define NAJ_BIT0 GPIO_PIN24
@@ -25,18 +41,120 @@
 #define NAJ_BIT6 GPIO_PIN20
 #define NAJ_BIT7 GPIO_PIN21
 
+// Enumeration daisy chain: high on ENUM_IN means every board before this one has an address
+// On the host, ENUM_OUT starts the chain and ENUM_IN is the end of it coming back
+#define NAJ_ENUM_IN GPIO_PIN5
+#define NAJ_ENUM_OUT GPIO_PIN6
+
 // Initialize this device to read data
 void naj_init_read(void);
 
+// To be used in writing mode
+// Send the startup handshake and wait until it has gone out
+// The moment it is clocked becomes time 0 of the shared timebase
+void naj_send_handshake(void);
+
+// To be used in reading mode
+// Block until the host's handshake arrives - the moment it was latched becomes time 0 of the shared timebase
+void naj_wait_handshake(void);
+
+// To be used in writing mode
+// Give every motor board on the daisy chain an address, in chain order, and return how many there are
+// A host whose chain does not come back (single board, not wired for it) assumes one board at address 0
+unsigned int naj_enumerate(void);
+
+// Number of motor boards: found by `naj_enumerate` on the host, announced by it to the readers
+// (1 until then)
+unsigned int naj_board_count(void);
+
+// To be used in reading mode
+// This board's address - 0 until the host's enumeration reaches it (boards off the chain stay at 0)
+unsigned char naj_address(void);
+
+// To be used in reading mode
+// Accept the frames for every board, as a reader that follows all of them (the visualizer) must
+// Such a reader stays off the enumeration chain
+void naj_listen_all(void);
+
+// To be used in writing mode
+// Send a SYNC/SYNC_TIME frame pair so the readers can correct their shared time
+// Call periodically (every NAJ_SYNC_PERIOD), and `naj_poll_write` on every pass of the main loop,
+// which sends the SYNC_TIME once the SYNC frame has been clocked out
+// Returns at once; if the queue has no room, or the last SYNC_TIME is still to go, it does nothing
+void naj_send_sync(void);
+
+// To be used in writing mode
+// Send whatever the writer has been waiting to send (the SYNC_TIME after a SYNC) - call on every
+// pass of the main loop
+void naj_poll_write(void);
+
+// Shared timebase: microseconds since the handshake, measured on the host's clock
+// Readers follow it by timestamping sync frames, which `naj_read_frame` handles as they arrive
+unsigned int naj_time(void);
+
+// To be used in reading mode
+// Difference between the host's time and this board's estimate of it at the most recent sync,
+// in microseconds
+int naj_time_error(void);
+
+// Convert a shared time to the equivalent value of this board's `timer_get_ticks`
+unsigned int naj_time_to_ticks(unsigned int time);
+
+// To be used in reading mode
+// Drive the ACK line after every byte received (only one reader on the bus may do this)
+void naj_enable_ack(void);
+
 // Initialize this device to write data
 void naj_init_write(void);
 
-// Write one byte of data over the NAJ bus
-void naj_write_byte(unsigned char data);
+// Queue one byte of data to be sent over the NAJ bus and return immediately
+// Returns 0, without queuing it, if the transmit queue is full: retry once it has drained
+// (global interrupts must be enabled for it to drain)
+int naj_write_byte(unsigned char data);
+
+// To be used in writing mode
+// Block until every queued byte has been sent
+void naj_flush(void);
+
+// To be used in writing mode
+// Transmit queue statistics: bytes currently waiting, the most that have ever been waiting,
+// and the number of writes that found the queue full and were turned away
+unsigned int naj_tx_depth(void);
+unsigned int naj_tx_max_depth(void);
+unsigned int naj_tx_overflows(void);
+
+// To be used in writing mode
+// Number of bytes sent after giving up on waiting for an ACK
+unsigned int naj_tx_ack_timeouts(void);
+
+// To be used in writing mode
+// Call `fn` first thing in every transmit interrupt (NULL for none), for an interrupt that must not
+// wait behind them: with ACK they can come back to back, and the ARM timer is dispatched first
+void naj_set_tx_hook(void (*fn)(void));
+
+// To be used in writing mode
+// Stamp the frame with the next sequence number and CRC and queue it for sending
+// Returns 0 if the whole frame does not fit in the transmit queue: nothing is queued, and the
+// caller may retry once it has drained
+int naj_frame_send(struct naj_frame_t *frame);
 
 // Read one byte of data over the NAJ bus
 unsigned char naj_read_byte(void);
 
+// To be used in reading mode
+// Consume received bytes until a complete, valid frame for this board has been assembled
+// Returns 1 and fills in `*frame` if one was, 0 if more bytes are needed (`*frame` is then untouched,
+// and the partial frame stays inside the reader until the next call)
+// Frames for other boards are checked and counted, but not returned
+int naj_read_frame(struct naj_frame_t *frame);
+
+// To be used in reading mode
+// Frame statistics: valid frames received, frames rejected by the CRC check, and frames
+// missing from the sequence (lost or corrupted on the bus)
+unsigned int naj_rx_frames(void);
+unsigned int naj_rx_crc_errors(void);
+unsigned int naj_rx_lost_frames(void);
+
 // To be used in reading mode
 // Returns 1 if there is data in the internal ring buffer, 0 otherwise
 unsigned char naj_has_data(void);
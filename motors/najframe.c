@@ -0,0 +1,254 @@
+// This file implements the NAJ frame functions as defined in `najframe.h`
+#include "najframe.h"
+
+// CRC-8 (polynomial 0x07) of every byte value
+static const unsigned char crc8_table[256] = {
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+    0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65, 0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D,
+    0xE0, 0xE7, 0xEE, 0xE9, 0xFC, 0xFB, 0xF2, 0xF5, 0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+    0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85, 0xA8, 0xAF, 0xA6, 0xA1, 0xB4, 0xB3, 0xBA, 0xBD,
+    0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2, 0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA,
+    0xB7, 0xB0, 0xB9, 0xBE, 0xAB, 0xAC, 0xA5, 0xA2, 0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+    0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32, 0x1F, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0D, 0x0A,
+    0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42, 0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A,
+    0x89, 0x8E, 0x87, 0x80, 0x95, 0x92, 0x9B, 0x9C, 0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+    0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC, 0xC1, 0xC6, 0xCF, 0xC8, 0xDD, 0xDA, 0xD3, 0xD4,
+    0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C, 0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44,
+    0x19, 0x1E, 0x17, 0x10, 0x05, 0x02, 0x0B, 0x0C, 0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+    0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B, 0x76, 0x71, 0x78, 0x7F, 0x6A, 0x6D, 0x64, 0x63,
+    0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B, 0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13,
+    0xAE, 0xA9, 0xA0, 0xA7, 0xB2, 0xB5, 0xBC, 0xBB, 0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+    0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB, 0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3,
+};
+
+unsigned char naj_crc8(const unsigned char *bytes, unsigned int len) {
+    unsigned char crc = 0;
+    for (unsigned int i = 0; i < len; i++) {
+        crc = crc8_table[crc ^ bytes[i]];
+    }
+    return crc;
+}
+
+void naj_frame_begin(struct naj_frame_t *frame) {
+    frame->addr = NAJ_ADDR_ALL;
+    frame->len = 0;
+    frame->last_cmd = NAJ_MAX_PAYLOAD;
+}
+
+int naj_frame_add(struct naj_frame_t *frame, unsigned char type, const unsigned char *args, unsigned int nargs) {
+    if (frame->len + 2 + nargs > NAJ_MAX_PAYLOAD) return 0;
+
+    frame->last_cmd = frame->len;
+    frame->payload[frame->len++] = type;
+    frame->payload[frame->len++] = nargs;
+    for (unsigned int i = 0; i < nargs; i++) {
+        frame->payload[frame->len++] = args[i];
+    }
+    return 1;
+}
+
+int naj_frame_add_note(struct naj_frame_t *frame, unsigned char motor, unsigned char key) {
+    unsigned char args[2] = {motor, key};
+
+    // Consecutive notes share one command header
+    if (frame->last_cmd < frame->len && frame->payload[frame->last_cmd] == NAJ_CMD_NOTES) {
+        if (frame->len + 2 > NAJ_MAX_PAYLOAD) return 0;
+
+        frame->payload[frame->last_cmd + 1] += 2;
+        frame->payload[frame->len++] = motor;
+        frame->payload[frame->len++] = key;
+        return 1;
+    }
+
+    return naj_frame_add(frame, NAJ_CMD_NOTES, args, 2);
+}
+
+int naj_frame_add_note_at(struct naj_frame_t *frame, unsigned int deadline, unsigned char motor, unsigned char key) {
+    // Consecutive notes for the same deadline share one command header
+    if (frame->last_cmd < frame->len && frame->payload[frame->last_cmd] == NAJ_CMD_NOTES_AT
+        && naj_read_u32(&frame->payload[frame->last_cmd + 2]) == deadline) {
+        if (frame->len + 2 > NAJ_MAX_PAYLOAD) return 0;
+
+        frame->payload[frame->last_cmd + 1] += 2;
+        frame->payload[frame->len++] = motor;
+        frame->payload[frame->len++] = key;
+        return 1;
+    }
+
+    unsigned char args[6] = {deadline, deadline >> 8, deadline >> 16, deadline >> 24, motor, key};
+    return naj_frame_add(frame, NAJ_CMD_NOTES_AT, args, 6);
+}
+
+unsigned int naj_frame_encode(const struct naj_frame_t *frame, unsigned char *bytes) {
+    unsigned int n = 0;
+    bytes[n++] = NAJ_FRAME_SYNC;
+    bytes[n++] = frame->addr;
+    bytes[n++] = frame->seq;
+    bytes[n++] = frame->len;
+    for (unsigned int i = 0; i < frame->len; i++) {
+        bytes[n++] = frame->payload[i];
+    }
+    bytes[n] = naj_crc8(bytes + 1, n - 1);
+    return n + 1;
+}
+
+unsigned int naj_read_u32(const unsigned char *bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int) bytes[3] << 24);
+}
+
+int naj_frame_next(const struct naj_frame_t *frame, unsigned int *pos, struct naj_cmd_t *cmd) {
+    // Every command needs at least its type and argument count, and must fit in the payload
+    if (*pos + 2 > frame->len) return 0;
+
+    cmd->type = frame->payload[*pos];
+    cmd->nargs = frame->payload[*pos + 1];
+    cmd->args = &frame->payload[*pos + 2];
+    if (*pos + 2 + cmd->nargs > frame->len) return 0;
+
+    *pos += 2 + cmd->nargs;
+    return 1;
+}
+
+void naj_parser_init(struct naj_parser_t *parser) {
+    parser->count = 0;
+    parser->synced = 0;
+    parser->expected_seq = 0;
+    parser->frames = 0;
+    parser->crc_errors = 0;
+    parser->lost_frames = 0;
+}
+
+int naj_parser_has_room(const struct naj_parser_t *parser) {
+    return parser->count < NAJ_MAX_FRAME;
+}
+
+void naj_parser_push(struct naj_parser_t *parser, unsigned char data, unsigned int time) {
+    if (parser->count == NAJ_MAX_FRAME) return;
+
+    parser->bytes[parser->count] = data;
+    parser->times[parser->count] = time;
+    parser->count++;
+}
+
+// Forget the oldest `n` bytes
+static void drop(struct naj_parser_t *parser, unsigned int n) {
+    parser->count -= n;
+    for (unsigned int i = 0; i < parser->count; i++) {
+        parser->bytes[i] = parser->bytes[i + n];
+        parser->times[i] = parser->times[i + n];
+    }
+}
+
+int naj_parser_frame(struct naj_parser_t *parser, struct naj_frame_t *frame) {
+    const unsigned char *bytes = parser->bytes;
+
+    while (parser->count > 0) {
+        // Anything other than a sync byte is noise (or part of a frame we lost track of)
+        if (bytes[0] != NAJ_FRAME_SYNC) {
+            drop(parser, 1);
+            continue;
+        }
+        if (parser->count < 4) return 0;
+
+        // A bad frame only rules out its sync byte - whatever followed it is scanned again
+        unsigned int len = bytes[3];
+        if (len > NAJ_MAX_PAYLOAD) {
+            parser->crc_errors++;
+            drop(parser, 1);
+            continue;
+        }
+        if (parser->count < len + NAJ_FRAME_OVERHEAD) return 0;
+
+        if (naj_crc8(bytes + 1, len + 3) != bytes[len + 4]) {
+            parser->crc_errors++;
+            drop(parser, 1);
+            continue;
+        }
+
+        frame->time = parser->times[0];
+        frame->addr = bytes[1];
+        frame->seq = bytes[2];
+        frame->len = len;
+        for (unsigned int i = 0; i < len; i++) {
+            frame->payload[i] = bytes[4 + i];
+        }
+
+        if (parser->synced) parser->lost_frames += (unsigned char)(frame->seq - parser->expected_seq);
+        parser->expected_seq = frame->seq + 1;
+        parser->synced = 1;
+        parser->frames++;
+
+        drop(parser, len + NAJ_FRAME_OVERHEAD);
+        return 1;
+    }
+
+    return 0;
+}
+
+void naj_addr_init(struct naj_addr_t *addr) {
+    addr->address = 0;
+    addr->enumerated = 0;
+    addr->boards = 1;
+    addr->listen_all = 0;
+}
+
+int naj_addr_handle(struct naj_addr_t *addr, const struct naj_frame_t *frame, int chain_in) {
+    unsigned int pos = 0;
+    struct naj_cmd_t cmd;
+    int claimed = 0;
+
+    while (naj_frame_next(frame, &pos, &cmd)) {
+        if (cmd.type == NAJ_CMD_ENUM && cmd.nargs >= 1) {
+            // Our turn once every board before us on the chain has taken an address
+            if (!addr->listen_all && !addr->enumerated && chain_in) {
+                addr->address = cmd.args[0];
+                addr->enumerated = 1;
+                claimed = 1;
+            }
+        } else if (cmd.type == NAJ_CMD_BOARDS && cmd.nargs >= 1) {
+            if (cmd.args[0] >= 1 && cmd.args[0] <= NAJ_MAX_BOARDS) addr->boards = cmd.args[0];
+        }
+    }
+    return claimed;
+}
+
+int naj_addr_accepts(const struct naj_addr_t *addr, unsigned char frame_addr) {
+    return addr->listen_all || frame_addr == NAJ_ADDR_ALL || frame_addr == addr->address;
+}
+
+unsigned int naj_enum_run(const struct naj_enum_io_t *io) {
+    struct naj_frame_t frame;
+
+    unsigned int count = 0;
+    while (count < NAJ_MAX_BOARDS && !io->chain_end(io->aux)) {
+        unsigned char offer = count;
+        naj_frame_begin(&frame);
+        naj_frame_add(&frame, NAJ_CMD_ENUM, &offer, 1);
+        io->send(&frame, io->aux);
+
+        // Only the end of the chain is visible, so every board but the last takes the whole wait
+        unsigned int start = io->ticks(io->aux);
+        while (io->ticks(io->aux) - start < NAJ_ENUM_SETTLE_US && !io->chain_end(io->aux)) {}
+        count++;
+    }
+
+    // The chain never came back - not wired for enumeration, so there is just the one board
+    unsigned char boards = (count > 0 && io->chain_end(io->aux)) ? count : 1;
+
+    naj_frame_begin(&frame);
+    naj_frame_add(&frame, NAJ_CMD_BOARDS, &boards, 1);
+    io->send(&frame, io->aux);
+    return boards;
+}
+
+unsigned int naj_pool_board(unsigned int motor, unsigned int boards) {
+    return motor % boards;
+}
+
+unsigned int naj_pool_voice(unsigned int motor, unsigned int boards) {
+    return motor / boards;
+}
+
+unsigned int naj_pool_motor(unsigned int board, unsigned int voice, unsigned int boards) {
+    return voice * boards + board;
+}
@@ -0,0 +1,187 @@
+// This file defines the frames carried over the NAJ bus (see `naj.h`): building them, turning them
+// into bytes, assembling received bytes back into frames, and addressing them to motor boards
+// Everything here is pure computation on memory - no hardware is touched - so it can be tested on the host
+//
+// Motor updates are sent in frames:
+//     sync | addr | seq | len | payload (len bytes) | crc8
+// The sync byte carries the protocol version in its low nibble, addr is the motor board the frame is
+// for (or NAJ_ADDR_ALL), seq counts frames so readers can detect lost ones, and the CRC-8 covers
+// everything after the sync byte
+// A payload holds one or more commands, each encoded as: type | nargs | args (nargs bytes)
+// The parser keeps the bytes of the frame it is assembling, so when a frame turns out to be bad
+// (impossible length, CRC error) it rescans from the byte after that frame's sync byte: a corrupted
+// frame costs only itself, even if its length byte was hit
+//
+// Several motor boards can share the bus. Right after the handshake the host enumerates them along a
+// daisy chain (ENUM_OUT of each board to ENUM_IN of the next, the last one back to the host): it
+// offers address 0, 1, ... in ENUM frames, and the first board without an address whose ENUM_IN was
+// high when the offer arrived claims the address and raises its ENUM_OUT. The host only sees the end of the chain, so it
+// gives each board NAJ_ENUM_SETTLE_US to claim before offering the next address, and stops once the
+// chain comes back high. It then announces the number of boards in a BOARDS frame
+// The motors of every board form one pool: pool motor m is voice m / boards of board m % boards, so
+// a pool that is only partly busy is spread over the physical motors of all the boards
+
+#ifndef _NAJFRAME_H
+#define _NAJFRAME_H
+
+// Frame format
+#define NAJ_VERSION 2
+#define NAJ_FRAME_SYNC (0xA0 | NAJ_VERSION)
+#define NAJ_MAX_PAYLOAD 64
+
+// Bytes in a frame besides the payload: sync, addr, seq, len and crc
+#define NAJ_FRAME_OVERHEAD 5
+#define NAJ_MAX_FRAME (NAJ_FRAME_OVERHEAD + NAJ_MAX_PAYLOAD)
+
+// Frame commands
+#define NAJ_CMD_NOTES 0x01       // Pairs of (motor, key): set each motor to a piano key index, or NAJ_NOTE_OFF
+#define NAJ_CMD_SNAPSHOT 0x02    // One key (or NAJ_NOTE_OFF) per motor, starting at motor 0: full motor state
+#define NAJ_CMD_JITTER_DUMP 0x03 // No arguments: motor board prints its step jitter statistics
+#define NAJ_CMD_NOTES_AT 0x04    // Shared-time deadline (4 bytes, little endian), then (motor, key) pairs to apply then
+#define NAJ_CMD_SYNC 0x05        // No arguments: readers timestamp the frame's sync byte
+#define NAJ_CMD_SYNC_TIME 0x06   // seq of the SYNC frame, then the host's shared time when it was sent (4 bytes)
+#define NAJ_CMD_SLICE 0x07       // Time slice of a shared motor in microseconds (2 bytes, little endian)
+#define NAJ_CMD_BEND 0x08        // Triples of (motor, LSB, MSB): 14-bit MIDI pitch bend (0x2000 = none) for each motor
+#define NAJ_CMD_TRANSPOSE 0x09   // Pairs of (motor, semitones): signed transposition of each motor
+#define NAJ_CMD_ENUM 0x0A        // Address: claimed by the first board in the chain that has none yet
+#define NAJ_CMD_BOARDS 0x0B      // Number of motor boards found by enumeration
+
+// The "motor" in note commands is a logical voice: voices beyond the physical motors time-share them,
+// voice v playing on motor v % NAJ_MOTORS in turn with the other voices on that motor
+#define NAJ_MOTORS 8
+#define NAJ_MAX_VOICES 32
+
+// Key value that turns a motor off
+#define NAJ_NOTE_OFF 0xFF
+
+// Motor value that applies a bend or transposition to every motor
+#define NAJ_ALL_MOTORS 0xFF
+
+// Frame address that every board accepts
+#define NAJ_ADDR_ALL 0xFF
+
+// Maximum number of motor boards on one bus
+#define NAJ_MAX_BOARDS 8
+
+// How long the host gives a board to claim an address and pass enumeration on, in microseconds
+// Every board must handle an ENUM frame within this time of receiving it, or addresses are skipped
+#define NAJ_ENUM_SETTLE_US 2000
+
+// A frame being built for sending, or a frame that has been received
+struct naj_frame_t {
+    unsigned int time;      // Received frames: the time passed in with the sync byte
+    unsigned char addr;     // Board the frame is for, or NAJ_ADDR_ALL
+    unsigned char last_cmd; // Frames being built: offset of the last command added
+    unsigned char seq;
+    unsigned char len;
+    unsigned char payload[NAJ_MAX_PAYLOAD];
+};
+
+// One command inside a received frame
+struct naj_cmd_t {
+    unsigned char type;
+    unsigned char nargs;
+    const unsigned char *args;
+};
+
+// Received bytes waiting to be assembled into frames, and what has come of them so far
+struct naj_parser_t {
+    unsigned char bytes[NAJ_MAX_FRAME]; // Bytes not yet consumed, oldest first
+    unsigned int times[NAJ_MAX_FRAME];  // The time each of them was received
+    unsigned int count;
+    unsigned int synced;                // 1 once a valid frame has been seen (sequence numbers are meaningful)
+    unsigned char expected_seq;
+    unsigned int frames;                // Valid frames
+    unsigned int crc_errors;            // Frames rejected by the length or CRC check
+    unsigned int lost_frames;           // Frames missing from the sequence (lost or corrupted on the bus)
+};
+
+// A reader's addressing state
+struct naj_addr_t {
+    unsigned char address;  // 0 until enumeration reaches this board (boards off the chain stay at 0)
+    unsigned int enumerated;
+    unsigned int boards;    // Number of motor boards announced by the host (1 until then)
+    unsigned int listen_all;
+};
+
+// Hardware used by the host's side of enumeration, so it can be simulated
+struct naj_enum_io_t {
+    void (*send)(struct naj_frame_t *frame, void *aux); // Send a frame and wait until it has been clocked out
+    int (*chain_end)(void *aux);                         // Level of the host's ENUM_IN
+    unsigned int (*ticks)(void *aux);                    // Current time in microseconds
+    void *aux;
+};
+
+// Start building an empty frame, for every board (set `frame->addr` to send it to just one)
+void naj_frame_begin(struct naj_frame_t *frame);
+
+// Append a command to a frame
+// Returns 1 on success, or 0 if the frame does not have room (the frame is unchanged)
+int naj_frame_add(struct naj_frame_t *frame, unsigned char type, const unsigned char *args, unsigned int nargs);
+
+// Append a (motor, key) pair, extending the frame's last command if it is already a NAJ_CMD_NOTES
+// Returns 1 on success, or 0 if the frame does not have room
+int naj_frame_add_note(struct naj_frame_t *frame, unsigned char motor, unsigned char key);
+
+// Append a (motor, key) pair to be applied at the shared time `deadline`, extending the frame's
+// last command if it is a NAJ_CMD_NOTES_AT for the same deadline
+// Returns 1 on success, or 0 if the frame does not have room
+int naj_frame_add_note_at(struct naj_frame_t *frame, unsigned int deadline, unsigned char motor, unsigned char key);
+
+// Write the frame, with its CRC, to `bytes` (room for NAJ_MAX_FRAME) as it goes on the bus
+// `frame->seq` must already be set; returns the number of bytes written
+unsigned int naj_frame_encode(const struct naj_frame_t *frame, unsigned char *bytes);
+
+// CRC-8 (polynomial x^8 + x^2 + x + 1) of `len` bytes, as used for frames
+unsigned char naj_crc8(const unsigned char *bytes, unsigned int len);
+
+// Decode a little endian 32-bit command argument
+unsigned int naj_read_u32(const unsigned char *bytes);
+
+// Walk the commands of a received frame
+// `*pos` must start at 0; returns 1 and fills in `*cmd` for each command, then 0 at the end
+int naj_frame_next(const struct naj_frame_t *frame, unsigned int *pos, struct naj_cmd_t *cmd);
+
+// Start a parser with no bytes and no statistics
+void naj_parser_init(struct naj_parser_t *parser);
+
+// Returns 1 if the parser has room for another byte - it always does once `naj_parser_frame` has
+// returned 0
+int naj_parser_has_room(const struct naj_parser_t *parser);
+
+// Add one received byte, received at `time`
+void naj_parser_push(struct naj_parser_t *parser, unsigned char data, unsigned int time);
+
+// Take the next complete, valid frame from the bytes pushed so far
+// Returns 1 and fills in `*frame` if there is one, 0 if more bytes are needed
+// `*frame` is only written when a frame passes the CRC check; call until it returns 0, since one
+// byte can complete several frames after a bad one has been rescanned
+int naj_parser_frame(struct naj_parser_t *parser, struct naj_frame_t *frame);
+
+// Start a reader with no address, accepting only frames for address 0 and NAJ_ADDR_ALL
+void naj_addr_init(struct naj_addr_t *addr);
+
+// Apply the addressing commands (ENUM, BOARDS) in a received frame
+// `chain_in` is 1 if this board's ENUM_IN was already high when the frame's sync byte arrived: a
+// board that is slow to handle a frame must not take an offer meant for the board before it, which
+// only raised ENUM_IN since
+// Returns 1 if the board has just claimed an address, and must now raise its ENUM_OUT
+// A reader listening to every frame takes part in none of this but the board count
+int naj_addr_handle(struct naj_addr_t *addr, const struct naj_frame_t *frame, int chain_in);
+
+// Returns 1 if a frame sent to `frame_addr` is for this reader
+int naj_addr_accepts(const struct naj_addr_t *addr, unsigned char frame_addr);
+
+// The host's side of enumeration, once the start of the chain has been raised: offer addresses until
+// the end of the chain comes back high, then announce the number of boards with a BOARDS frame
+// Returns the number of boards - 1 if the chain never came back (a single board not wired for it)
+unsigned int naj_enum_run(const struct naj_enum_io_t *io);
+
+// Board that plays pool motor `motor`, and its voice there, with `boards` boards
+unsigned int naj_pool_board(unsigned int motor, unsigned int boards);
+unsigned int naj_pool_voice(unsigned int motor, unsigned int boards);
+
+// Pool motor played by voice `voice` of board `board`, with `boards` boards
+unsigned int naj_pool_motor(unsigned int board, unsigned int voice, unsigned int boards);
+
+#endif
@@ -0,0 +1,109 @@
+// This file implements the NAJ writer's clocking as defined in `najtx.h`
+#include "najtx.h"
+
+void najtx_init(struct najtx_t *tx, volatile unsigned int *set, volatile unsigned int *clr, volatile unsigned int *lev,
+                const unsigned int *data_pins, unsigned int clock_pin, unsigned int ack_pin, unsigned int use_ack) {
+    tx->set = set;
+    tx->clr = clr;
+    tx->lev = lev;
+    tx->clock_pin = clock_pin;
+    tx->ack_pin = ack_pin;
+    tx->use_ack = use_ack;
+    tx->hold = NAJ_ACK_HOLD_US;
+
+    // Precompute the pin masks for every byte value
+    tx->data_pin_mask = 0;
+    for (int i = 0; i < 8; i++) {
+        tx->data_pin_mask |= 1 << data_pins[i];
+    }
+    for (unsigned int value = 0; value < 256; value++) {
+        tx->byte_to_pins[value] = 0;
+        for (int i = 0; i < 8; i++) {
+            if (value & (1 << i)) tx->byte_to_pins[value] |= 1 << data_pins[i];
+        }
+    }
+
+    tx->state = NAJTX_IDLE;
+    tx->data = 0;
+    tx->rise_time = 0;
+    tx->ack_expected = 0;
+    tx->acked = 0;
+    tx->wait = NAJ_DELAY;
+    tx->sent = 0;
+    tx->ack_timeouts = 0;
+}
+
+static unsigned int ack_level(const struct najtx_t *tx) {
+    return (*tx->lev >> tx->ack_pin) & 1;
+}
+
+static int next_byte(struct najtx_t *tx, unsigned int clock, int (*next)(int *data, void *aux), void *aux) {
+    int data;
+    if (!next(&data, aux)) {
+        // Queue drained - end the pulse and let the caller stop the timer until the next write
+        if (clock) *tx->clr = clock;
+        tx->state = NAJTX_IDLE;
+        return NAJTX_STOP;
+    }
+
+    // Drop the clock and the byte's zero bits with one clear, then set its one bits: the data only
+    // ever changes while the clock is low
+    unsigned int pins = tx->byte_to_pins[data & 0xFF];
+    *tx->clr = clock | (tx->data_pin_mask & ~pins);
+    *tx->set = pins;
+    tx->data = data;
+    tx->state = NAJTX_LOW;
+
+    if (!tx->use_ack) return 0;
+    tx->wait = NAJ_ACK_SETUP_US;
+    return NAJTX_WAIT;
+}
+
+static int after_high(struct najtx_t *tx, unsigned int now, int (*next)(int *data, void *aux), void *aux) {
+    // The clock is high - with ACK, move on once the byte is acknowledged and held long enough
+    unsigned int high = now - tx->rise_time;
+    if (tx->use_ack) {
+        if (!tx->acked && ack_level(tx) == tx->ack_expected) tx->acked = 1;
+
+        if (!tx->acked) {
+            if (high < NAJ_ACK_TIMEOUT * NAJ_DELAY) {
+                tx->wait = NAJ_ACK_TIMEOUT * NAJ_DELAY - high;
+                return NAJTX_WAIT;
+            }
+            tx->ack_timeouts++;
+        } else if (high < tx->hold) {
+            // Acknowledged, but the other readers may still be on their way to latch it
+            tx->wait = tx->hold - high;
+            return NAJTX_WAIT;
+        }
+    }
+
+    return next_byte(tx, 1 << tx->clock_pin, next, aux);
+}
+
+int najtx_tick(struct najtx_t *tx, unsigned int now, int (*next)(int *data, void *aux), void *aux) {
+    if (tx->state == NAJTX_LOW) {
+        // The byte has been on the pins for the setup time - raise the clock for the readers to latch it
+        // Its ACK is the next toggle of the line: since the data changed before now, any toggle from
+        // now on comes from a reader that has latched this byte, however late it was with the last one
+        tx->ack_expected = !ack_level(tx);
+        tx->acked = 0;
+        *tx->set = 1 << tx->clock_pin;
+        tx->state = NAJTX_HIGH;
+        tx->rise_time = now;
+        tx->sent++;
+
+        if (!tx->use_ack) return NAJTX_RAISED;
+        tx->wait = NAJ_ACK_TIMEOUT * NAJ_DELAY;
+        return NAJTX_RAISED | NAJTX_WAIT;
+    }
+
+    if (tx->state == NAJTX_HIGH) return after_high(tx, now, next, aux);
+    return next_byte(tx, 0, next, aux);
+}
+
+int najtx_ack(struct najtx_t *tx, unsigned int now, int (*next)(int *data, void *aux), void *aux) {
+    // Only a toggle to the expected level while the clock is high acknowledges the byte
+    if (!tx->use_ack || tx->state != NAJTX_HIGH || tx->acked || ack_level(tx) != tx->ack_expected) return 0;
+    return after_high(tx, now, next, aux);
+}
@@ -0,0 +1,82 @@
+// This file defines how the NAJ writer clocks bytes onto the bus (see `naj.h`), driven by the
+// transmit timer interrupt and, with ACK, the ACK line's edge interrupt
+// The GPIO registers are reached through pointers, so the host can aim them at a simulated GPIO bank
+//
+// Each byte goes onto the data pins while the clock is low, and the data does not change again until
+// the clock has fallen, so the readers latch it from their rising edge interrupt
+// Without ACK the timer ticks every NAJ_DELAY: the clock is low for one tick and high for the next,
+// so every reader has a tick of setup and a tick to latch the byte
+// With ACK the timer is re-armed for each step instead: the clock rises NAJ_ACK_SETUP_US after the
+// data changes, and falls - with the next byte going straight onto the pins - as soon as the ACK line
+// has toggled since the rise and the clock has been high for NAJ_ACK_HOLD_US, the time the readers
+// that do not drive ACK need. The ACK edge interrupt calls `najtx_ack` to move on at once; the timer
+// only ends the hold, or gives up on the ACK after NAJ_ACK_TIMEOUT ticks
+// As the expected ACK level is taken when the clock rises, after the data changed, a toggle after
+// that can only come from a reader that latched this byte - an ACK that comes in after a timeout is
+// never taken for the wrong byte, and the two sides are back in step from the next byte
+
+#ifndef _NAJTX_H
+#define _NAJTX_H
+
+// Period of the transmit timer without ACK, in microseconds
+// A byte takes two ticks: one with the clock low, one with it high
+#define NAJ_DELAY 10
+
+// With ACK: microseconds from the data changing to the clock rising
+#define NAJ_ACK_SETUP_US 1
+
+// With ACK: microseconds the clock stays high at least, for the readers that do not drive ACK to
+// latch the byte - their worst interrupt latency (0 if the ACK reader is the only one on the bus)
+#define NAJ_ACK_HOLD_US NAJ_DELAY
+
+// Number of NAJ_DELAY ticks the clock is held high waiting for an ACK before moving on anyway
+#define NAJ_ACK_TIMEOUT 5
+
+// What the writer is doing
+#define NAJTX_IDLE 0 // Clock low, nothing to send - the timer can stop
+#define NAJTX_LOW 1  // Clock low, the next byte on the data pins
+#define NAJTX_HIGH 2 // Clock high, readers latching the byte on the data pins
+
+// What `najtx_tick` and `najtx_ack` did, for the caller (flags)
+#define NAJTX_RAISED 1 // The clock rose on `tx->data`
+#define NAJTX_STOP 2   // The queue is empty and the bus is idle - stop the timer
+#define NAJTX_WAIT 4   // Restart the timer to expire `tx->wait` microseconds from now (ACK only)
+
+struct najtx_t {
+    volatile unsigned int *set;       // GPSET0, GPCLR0 and GPLEV0, or simulated ones
+    volatile unsigned int *clr;
+    volatile unsigned int *lev;
+    unsigned int clock_pin;
+    unsigned int ack_pin;
+    unsigned int use_ack;
+    unsigned int hold;                // NAJ_ACK_HOLD_US, unless changed after `najtx_init`
+    unsigned int byte_to_pins[256];   // GPSET mask for each byte value
+    unsigned int data_pin_mask;       // All data pins
+
+    volatile unsigned int state;      // Volatile, like `sent`: the caller may wait on them
+    int data;                         // The byte on the data pins, as it came from the queue
+    unsigned int rise_time;           // Tick at which the clock rose on it
+    unsigned int ack_expected;        // ACK level that means the byte on the pins has been latched
+    unsigned int acked;               // That level has been seen since the clock rose
+    unsigned int wait;                // With NAJTX_WAIT: microseconds until the next timer expiry
+    volatile unsigned int sent;       // Bytes clocked (rising edges)
+    unsigned int ack_timeouts;        // Bytes moved on from without an ACK
+};
+
+// Set up the writer for the 8 data pins `data_pins` (least significant bit first), the clock and
+// the ACK pin, paced by ACK if `use_ack` is set
+// The pins must already be outputs (ACK an input) and low
+void najtx_init(struct najtx_t *tx, volatile unsigned int *set, volatile unsigned int *clr, volatile unsigned int *lev,
+                const unsigned int *data_pins, unsigned int clock_pin, unsigned int ack_pin, unsigned int use_ack);
+
+// Advance the writer when the transmit timer expires, at tick `now`
+// `next` takes the next queued byte (only the low 8 bits go on the bus; the rest is the caller's)
+// and returns 1, or returns 0 if the queue is empty
+// Returns the NAJTX_ flags for what the caller must do
+int najtx_tick(struct najtx_t *tx, unsigned int now, int (*next)(int *data, void *aux), void *aux);
+
+// With ACK: advance the writer when the ACK line changes, at tick `now`
+// Returns the NAJTX_ flags for what the caller must do (0 if the edge changed nothing)
+int najtx_ack(struct najtx_t *tx, unsigned int now, int (*next)(int *data, void *aux), void *aux);
+
+#endif
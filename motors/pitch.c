@@ -0,0 +1,153 @@
+// This file implements the pitch tables and conversions as defined in `pitch.h`
+#include "pitch.h"
+
+// The tables are worked out by the compiler from PITCH_A4_HZ - every entry is a constant expression,
+// so retuning is a rebuild and nothing is computed at run time
+
+// 2^(k/12) for 0 <= k < 16, built up from powers of the equal tempered semitone
+#define SEMITONE_POW(k) (((k) & 1 ? 1.0594630943592953 : 1.0) \
+                        * ((k) & 2 ? 1.1224620483093730 : 1.0) \
+                        * ((k) & 4 ? 1.2599210498948732 : 1.0) \
+                        * ((k) & 8 ? 1.5874010519681994 : 1.0))
+
+// Frequency of piano key n (A0 is key 0, four octaves below A4)
+#define PITCH_KEY_HZ(n) ((PITCH_A4_HZ / 16.0) * (1 << ((n) / 12)) * SEMITONE_POW((n) % 12))
+
+// Step period of piano key n in fixed point microseconds, rounded to nearest
+#define PITCH_KEY_Q8(n) ((unsigned int)(1000000.0 * (1 << PITCH_FRAC_BITS) / PITCH_KEY_HZ(n) + 0.5))
+
+const unsigned int pitch_periods[PITCH_KEYS] = {
+    PITCH_KEY_Q8(0), // A0
+    PITCH_KEY_Q8(1), // A#0/Bb0
+    PITCH_KEY_Q8(2), // B0
+    PITCH_KEY_Q8(3), // C1
+    PITCH_KEY_Q8(4), // C#1/Db1
+    PITCH_KEY_Q8(5), // D1
+    PITCH_KEY_Q8(6), // D#1/Eb1
+    PITCH_KEY_Q8(7), // E1
+    PITCH_KEY_Q8(8), // F1
+    PITCH_KEY_Q8(9), // F#1/Gb1
+    PITCH_KEY_Q8(10), // G1
+    PITCH_KEY_Q8(11), // G#1/Ab1
+    PITCH_KEY_Q8(12), // A1
+    PITCH_KEY_Q8(13), // A#1/Bb1
+    PITCH_KEY_Q8(14), // B1
+    PITCH_KEY_Q8(15), // C2
+    PITCH_KEY_Q8(16), // C#2/Db2
+    PITCH_KEY_Q8(17), // D2
+    PITCH_KEY_Q8(18), // D#2/Eb2
+    PITCH_KEY_Q8(19), // E2
+    PITCH_KEY_Q8(20), // F2
+    PITCH_KEY_Q8(21), // F#2/Gb2
+    PITCH_KEY_Q8(22), // G2
+    PITCH_KEY_Q8(23), // G#2/Ab2
+    PITCH_KEY_Q8(24), // A2
+    PITCH_KEY_Q8(25), // A#2/Bb2
+    PITCH_KEY_Q8(26), // B2
+    PITCH_KEY_Q8(27), // C3
+    PITCH_KEY_Q8(28), // C#3/Db3
+    PITCH_KEY_Q8(29), // D3
+    PITCH_KEY_Q8(30), // D#3/Eb3
+    PITCH_KEY_Q8(31), // E3
+    PITCH_KEY_Q8(32), // F3
+    PITCH_KEY_Q8(33), // F#3/Gb3
+    PITCH_KEY_Q8(34), // G3
+    PITCH_KEY_Q8(35), // G#3/Ab3
+    PITCH_KEY_Q8(36), // A3
+    PITCH_KEY_Q8(37), // A#3/Bb3
+    PITCH_KEY_Q8(38), // B3
+    PITCH_KEY_Q8(39), // C4
+    PITCH_KEY_Q8(40), // C#4/Db4
+    PITCH_KEY_Q8(41), // D4
+    PITCH_KEY_Q8(42), // D#4/Eb4
+    PITCH_KEY_Q8(43), // E4
+    PITCH_KEY_Q8(44), // F4
+    PITCH_KEY_Q8(45), // F#4/Gb4
+    PITCH_KEY_Q8(46), // G4
+    PITCH_KEY_Q8(47), // G#4/Ab4
+    PITCH_KEY_Q8(48), // A4
+    PITCH_KEY_Q8(49), // A#4/Bb4
+    PITCH_KEY_Q8(50), // B4
+    PITCH_KEY_Q8(51), // C5
+    PITCH_KEY_Q8(52), // C#5/Db5
+    PITCH_KEY_Q8(53), // D5
+    PITCH_KEY_Q8(54), // D#5/Eb5
+    PITCH_KEY_Q8(55), // E5
+    PITCH_KEY_Q8(56), // F5
+    PITCH_KEY_Q8(57), // F#5/Gb5
+    PITCH_KEY_Q8(58), // G5
+    PITCH_KEY_Q8(59), // G#5/Ab5
+    PITCH_KEY_Q8(60), // A5
+    PITCH_KEY_Q8(61), // A#5/Bb5
+    PITCH_KEY_Q8(62), // B5
+    PITCH_KEY_Q8(63), // C6
+    PITCH_KEY_Q8(64), // C#6/Db6
+    PITCH_KEY_Q8(65), // D6
+    PITCH_KEY_Q8(66), // D#6/Eb6
+    PITCH_KEY_Q8(67), // E6
+    PITCH_KEY_Q8(68), // F6
+    PITCH_KEY_Q8(69), // F#6/Gb6
+    PITCH_KEY_Q8(70), // G6
+    PITCH_KEY_Q8(71), // G#6/Ab6
+    PITCH_KEY_Q8(72), // A6
+    PITCH_KEY_Q8(73), // A#6/Bb6
+    PITCH_KEY_Q8(74), // B6
+    PITCH_KEY_Q8(75), // C7
+    PITCH_KEY_Q8(76), // C#7/Db7
+    PITCH_KEY_Q8(77), // D7
+    PITCH_KEY_Q8(78), // D#7/Eb7
+    PITCH_KEY_Q8(79), // E7
+    PITCH_KEY_Q8(80), // F7
+    PITCH_KEY_Q8(81), // F#7/Gb7
+    PITCH_KEY_Q8(82), // G7
+    PITCH_KEY_Q8(83), // G#7/Ab7
+    PITCH_KEY_Q8(84), // A7
+    PITCH_KEY_Q8(85), // A#7/Bb7
+    PITCH_KEY_Q8(86), // B7
+    PITCH_KEY_Q8(87), // C8
+};
+
+// 2^(s/192) for 0 <= s < 64: the ratio of a bend of s sixteenths of a semitone
+#define SIXTEENTH_POW(s) (((s) & 1 ? 1.0036166659754628 : 1.0) \
+                         * ((s) & 2 ? 1.0072464122237039 : 1.0) \
+                         * ((s) & 4 ? 1.0145453349375237 : 1.0) \
+                         * ((s) & 8 ? 1.0293022366434921 : 1.0) \
+                         * ((s) & 16 ? 1.0594630943592953 : 1.0) \
+                         * ((s) & 32 ? 1.1224620483093730 : 1.0))
+
+// Bend of table entry i in sixteenths of a semitone (entry PITCH_BEND_STEPS / 2 is no bend)
+#define BEND_SIXTEENTHS(i) (((i) - PITCH_BEND_STEPS / 2) * PITCH_BEND_RANGE * 16 * 2 / PITCH_BEND_STEPS)
+
+// Period multiplier (Q16) of table entry i - bending up shortens the period
+#define BEND_Q16(i) ((unsigned int)(65536.0 * (BEND_SIXTEENTHS(i) >= 0 \
+                    ? 1.0 / SIXTEENTH_POW(BEND_SIXTEENTHS(i)) : SIXTEENTH_POW(-BEND_SIXTEENTHS(i))) + 0.5))
+
+#define BEND_ROW(i) BEND_Q16(i), BEND_Q16(i + 1), BEND_Q16(i + 2), BEND_Q16(i + 3), \
+                    BEND_Q16(i + 4), BEND_Q16(i + 5), BEND_Q16(i + 6), BEND_Q16(i + 7)
+
+const unsigned int pitch_bend_factors[PITCH_BEND_STEPS + 1] = {
+    BEND_ROW(0), BEND_ROW(8), BEND_ROW(16), BEND_ROW(24),
+    BEND_Q16(PITCH_BEND_STEPS),
+};
+
+unsigned int pitch_period(int key, int transpose, int bend) {
+    // Keys transposed off the end of the piano are brought back by octaves
+    key += transpose;
+    while (key < 0) key += 12;
+    while (key >= PITCH_KEYS) key -= 12;
+
+    if (bend < PITCH_BEND_MIN) bend = PITCH_BEND_MIN;
+    if (bend > PITCH_BEND_MAX) bend = PITCH_BEND_MAX;
+
+    // Interpolate between the two nearest bend table entries - the error is far below a cent,
+    // and there is no division anywhere
+    unsigned int position = (bend - PITCH_BEND_MIN) * PITCH_BEND_STEPS;
+    unsigned int index = position >> PITCH_BEND_BITS;
+    unsigned int frac = position & ((1 << PITCH_BEND_BITS) - 1);
+    unsigned int factor = pitch_bend_factors[index];
+    if (frac) {
+        factor -= ((pitch_bend_factors[index] - pitch_bend_factors[index + 1]) * frac) >> PITCH_BEND_BITS;
+    }
+
+    return ((unsigned long long) pitch_periods[key] * factor) >> 16;
+}
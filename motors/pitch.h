@@ -0,0 +1,41 @@
+// This file defines the pitch engine for the motor board
+// Step periods are fixed point microseconds (PITCH_FRAC_BITS fractional bits), and the scheduler
+// carries the fraction from one step to the next, so even the top notes play within a fraction of
+// a cent of equal temperament rather than rounding to whole microseconds
+// The period table is generated by the compiler from the A4 reference; pitch bend and transposition
+// cost one multiply when a note changes, never anything per step
+
+#ifndef _PITCH_H
+#define _PITCH_H
+
+// Tuning reference: frequency of A4 in Hz
+#define PITCH_A4_HZ 440.0
+
+// Fractional bits of every period (periods are in 1/256 microseconds)
+#define PITCH_FRAC_BITS 8
+
+// Number of keys (A0 to C8)
+#define PITCH_KEYS 88
+
+// Pitch bend values, as sent by MIDI (14 bits, centred on 0)
+#define PITCH_BEND_MIN -8192
+#define PITCH_BEND_MAX 8191
+#define PITCH_BEND_BITS 14
+
+// Semitones reached at full bend in either direction
+#define PITCH_BEND_RANGE 2
+
+// Intervals in the bend table (interpolated between)
+#define PITCH_BEND_STEPS 32
+
+// Step period of every key, in 1/256 microseconds
+extern const unsigned int pitch_periods[PITCH_KEYS];
+
+// Period multipliers (Q16) from full bend down to full bend up
+extern const unsigned int pitch_bend_factors[PITCH_BEND_STEPS + 1];
+
+// Step period in 1/256 microseconds of piano key `key` moved by `transpose` semitones and bent by `bend`
+// Keys moved off the piano are brought back by octaves
+unsigned int pitch_period(int key, int transpose, int bend);
+
+#endif
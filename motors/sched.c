@@ -0,0 +1,444 @@
+// This file implements the step scheduler as defined in `sched.h`
+#include "sched.h"
+#include "armtimer.h"
+#include "interrupts.h"
+#include "jitter.h"
+#include "timer.h"
+
+#include <stddef.h>
+
+// Writing the ARM timer load register restarts the countdown immediately,
+// which lets us re-arm it for each new deadline without reinitializing the timer
+// (`tools/schedsim` defines it to point at its simulated timer)
+#ifndef ARMTIMER_LOAD
+#define ARMTIMER_LOAD ((volatile unsigned int *)0x2000B400)
+#endif
+
+static sched_step_fn_t step_function;
+static unsigned int motor_count;
+
+static unsigned int periods[SCHED_MAX_MOTORS];         // Fixed point microseconds between each step (of the sounding slot)
+static unsigned int phases[SCHED_MAX_MOTORS];          // Fraction of a microsecond carried over to the next step
+static unsigned int next_step_times[SCHED_MAX_MOTORS]; // Tick at which each motor next needs to step
+
+// Acceleration ramp: ramp_table[i] is the period after i steps of constant acceleration from
+// SCHED_RAMP_START_US, and ramp_steps[m] is a ramping motor's position in it
+// A motor is ramping while its period differs from the period of its sounding slot
+static unsigned int ramp_table[SCHED_RAMP_STEPS];
+static int ramp_steps[SCHED_MAX_MOTORS];
+
+// Whole microseconds of a fixed point period
+#define WHOLE(period) ((period) >> SCHED_FRAC_BITS)
+#define FRAC_MASK ((1 << SCHED_FRAC_BITS) - 1)
+
+// Time slices: every motor has SCHED_MAX_SLOTS pitches (period 0 = empty slot) and plays its
+// non-empty ones in turn, each for `slice_length` microseconds
+static unsigned int slot_periods[SCHED_MAX_MOTORS][SCHED_MAX_SLOTS];
+static unsigned int slots[SCHED_MAX_MOTORS];      // Slot currently sounding
+static unsigned int slice_ends[SCHED_MAX_MOTORS]; // Tick at which the current slice is over
+static unsigned int slice_length;
+
+// How far ahead of the clock steps are handed to the step function (0 = pulse them as they come due)
+static unsigned int lead_time;
+
+// Min-heap of motor numbers ordered by `next_step_times`
+// heap_pos[m] is the index of motor m in the heap, or -1 if the motor is not playing
+static unsigned int heap[SCHED_MAX_MOTORS];
+static int heap_pos[SCHED_MAX_MOTORS];
+static unsigned int heap_size;
+
+// Period changes waiting for their deadline, sorted by `when` (earliest first)
+struct sched_event_t {
+    unsigned int when;
+    unsigned int motor;
+    unsigned int slot;
+    unsigned int period; // 0 = stop
+};
+
+static struct sched_event_t pending[SCHED_MAX_PENDING];
+static unsigned int pending_count;
+
+// Tick the scheduler is working at - the clock plus the lead
+static unsigned int schedule_time(void) {
+    return timer_get_ticks() + lead_time;
+}
+
+static void heap_swap(unsigned int a, unsigned int b) {
+    unsigned int tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+    heap_pos[heap[a]] = a;
+    heap_pos[heap[b]] = b;
+}
+
+static void sift_up(unsigned int i) {
+    while (i > 0) {
+        unsigned int parent = (i - 1) / 2;
+        if (!SCHED_BEFORE(next_step_times[heap[i]], next_step_times[heap[parent]])) break;
+        heap_swap(i, parent);
+        i = parent;
+    }
+}
+
+static void sift_down(unsigned int i) {
+    while (1) {
+        unsigned int smallest = i;
+        unsigned int left = 2 * i + 1;
+        unsigned int right = 2 * i + 2;
+
+        if (left < heap_size && SCHED_BEFORE(next_step_times[heap[left]], next_step_times[heap[smallest]])) smallest = left;
+        if (right < heap_size && SCHED_BEFORE(next_step_times[heap[right]], next_step_times[heap[smallest]])) smallest = right;
+        if (smallest == i) break;
+
+        heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+static void heap_remove(unsigned int motor) {
+    int i = heap_pos[motor];
+    if (i < 0) return;
+
+    heap_size--;
+    heap_pos[motor] = -1;
+    if ((unsigned int) i == heap_size) return;
+
+    // Move the last element into the hole and restore heap order around it
+    unsigned int moved = heap[heap_size];
+    heap[i] = moved;
+    heap_pos[moved] = i;
+    sift_up(i);
+    sift_down(heap_pos[moved]);
+}
+
+static unsigned int isqrt(unsigned int n) {
+    unsigned int root = 0;
+    for (unsigned int bit = 1u << 30; bit != 0; bit >>= 2) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+// Fill the ramp table - speed squared grows by 2 * SCHED_RAMP_ACCEL every step
+static void build_ramp_table(void) {
+    unsigned int start_rate = 1000000 / SCHED_RAMP_START_US;
+    for (unsigned int i = 0; i < SCHED_RAMP_STEPS; i++) {
+        unsigned int rate = isqrt(start_rate * start_rate + 2 * SCHED_RAMP_ACCEL * i);
+        ramp_table[i] = (1000000u << SCHED_FRAC_BITS) / rate;
+    }
+}
+
+// Ramp position of a motor turning at `period`: the first entry at or below it, or -1 if it is slower
+// than the start of the ramp (only done on note changes, never per step)
+static int ramp_position(unsigned int period) {
+    int low = 0, high = SCHED_RAMP_STEPS;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (ramp_table[mid] <= period) high = mid;
+        else low = mid + 1;
+    }
+    return (low == 0 && ramp_table[0] < period) ? -1 : low;
+}
+
+// Move a ramping motor's period one table entry towards its sounding slot's period
+static void ramp_step(unsigned int motor) {
+    unsigned int target = slot_periods[motor][slots[motor]];
+    if (periods[motor] == target) return;
+
+    if (periods[motor] > target) {
+        // Speeding up
+        int step = ++ramp_steps[motor];
+        unsigned int period = (step < SCHED_RAMP_STEPS) ? ramp_table[step] : target;
+        periods[motor] = (period > target) ? period : target;
+    } else {
+        // Slowing down
+        int step = --ramp_steps[motor];
+        unsigned int period = (step >= 0) ? ramp_table[step] : target;
+        periods[motor] = (period < target) ? period : target;
+    }
+}
+
+// Tick of the step after one at `last`, carrying the fractional part of the period forward
+static unsigned int step_after(unsigned int motor, unsigned int last) {
+    unsigned int total = phases[motor] + periods[motor];
+    phases[motor] = total & FRAC_MASK;
+    return last + WHOLE(total);
+}
+
+// Next non-empty slot after `slot` (wrapping round to `slot` itself), or -1 if all are empty
+static int next_slot(unsigned int motor, unsigned int slot) {
+    for (unsigned int i = 1; i <= SCHED_MAX_SLOTS; i++) {
+        unsigned int candidate = (slot + i) % SCHED_MAX_SLOTS;
+        if (slot_periods[motor][candidate] != 0) return candidate;
+    }
+    return -1;
+}
+
+// Make `slot` sound from `start`, with its first step one period later and a fresh slice
+// A motor at rest ramps up from the start of the ramp, a turning one glides from its current period
+static void play_slot(unsigned int motor, unsigned int slot, unsigned int start) {
+    unsigned int period = slot_periods[motor][slot];
+    if (heap_pos[motor] < 0) {
+        periods[motor] = (period < ramp_table[0]) ? ramp_table[0] : period;
+        ramp_steps[motor] = 0;
+    } else {
+        ramp_steps[motor] = ramp_position(periods[motor]);
+    }
+
+    slots[motor] = slot;
+    phases[motor] = 0;
+    next_step_times[motor] = step_after(motor, start);
+    slice_ends[motor] = start + slice_length;
+
+    if (heap_pos[motor] < 0) {
+        heap[heap_size] = motor;
+        heap_pos[motor] = heap_size;
+        heap_size++;
+        sift_up(heap_size - 1);
+    } else {
+        // Motor was already playing - its deadline may have moved either way
+        sift_up(heap_pos[motor]);
+        sift_down(heap_pos[motor]);
+    }
+}
+
+// Set, retune or clear (period 0) one slot of a motor at tick `start`
+static void set_slot(unsigned int motor, unsigned int slot, unsigned int period, unsigned int start) {
+    slot_periods[motor][slot] = period;
+
+    if (heap_pos[motor] < 0) {
+        if (period != 0) play_slot(motor, slot, start);
+        return;
+    }
+
+    // Another slot is sounding - this one gets its turn when its slice comes round
+    if (slot != slots[motor]) return;
+
+    int next = (period != 0) ? (int) slot : next_slot(motor, slot);
+    if (next < 0) heap_remove(motor);
+    else play_slot(motor, next, start);
+}
+
+// Called after a motor steps at `last`: if the next step would fall past the end of its slice,
+// move on to the next pitch, which starts its first full period at this step so the waveform
+// has no partial period (and no click) at the switch
+static void advance_slice(unsigned int motor, unsigned int last, unsigned int deadline, unsigned int now) {
+    if (SCHED_BEFORE(last + WHOLE(periods[motor]), slice_ends[motor])) {
+        ramp_step(motor);
+        return;
+    }
+
+    slice_ends[motor] += slice_length;
+    if (SCHED_BEFORE(slice_ends[motor], last)) slice_ends[motor] = last + slice_length;
+
+    int next = next_slot(motor, slots[motor]);
+    if (next < 0 || (unsigned int) next == slots[motor]) {
+        ramp_step(motor);
+        return;
+    }
+
+    // Slices are too short to ramp through, and the motor is already turning, so pitches switch directly
+    slots[motor] = next;
+    periods[motor] = slot_periods[motor][next];
+    phases[motor] = 0;
+    jitter_switch(motor, SCHED_BEFORE(now, deadline) ? 0 : now - deadline);
+}
+
+static void clear_slots(unsigned int motor) {
+    for (unsigned int slot = 0; slot < SCHED_MAX_SLOTS; slot++) {
+        slot_periods[motor][slot] = 0;
+    }
+}
+
+static void apply_due_events(unsigned int now) {
+    unsigned int due = 0;
+    while (due < pending_count && !SCHED_BEFORE(now + SCHED_SLACK_US, pending[due].when)) {
+        // Phase starts at the requested time, not when the interrupt got around to it
+        set_slot(pending[due].motor, pending[due].slot, pending[due].period, pending[due].when);
+        due++;
+    }
+
+    if (due == 0) return;
+    for (unsigned int i = due; i < pending_count; i++) {
+        pending[i - due] = pending[i];
+    }
+    pending_count -= due;
+}
+
+// Fire every motor that is due, then arm the timer for the next deadline
+// Must be called with interrupts disabled (or from the timer interrupt)
+static void run_due_steps(void) {
+    while (1) {
+        unsigned int now = schedule_time();
+        apply_due_events(now);
+
+        if (heap_size == 0 && pending_count == 0) break;
+
+        // Next thing to happen is either a step or a pending period change
+        unsigned int motor = heap[0];
+        unsigned int deadline = (heap_size > 0) ? next_step_times[motor] : pending[0].when;
+        if (pending_count > 0 && SCHED_BEFORE(pending[0].when, deadline)) deadline = pending[0].when;
+
+        if (SCHED_BEFORE(now + SCHED_SLACK_US, deadline)) {
+            // Earliest deadline is still in the future - arm timer and wait for the interrupt
+            *ARMTIMER_LOAD = deadline - now;
+            armtimer_enable();
+            return;
+        }
+
+        // Due pending events were applied above, so this deadline belongs to a step
+        // Gather every motor due within the batch window and step them all in one pulse
+        unsigned int due = 0;
+        unsigned int when = deadline;
+        while (heap_size > 0) {
+            motor = heap[0];
+            deadline = next_step_times[motor];
+            if (SCHED_BEFORE(now + SCHED_BATCH_US, deadline) || (due & (1 << motor))) break;
+
+            due |= 1 << motor;
+            jitter_record(motor, SCHED_BEFORE(now, deadline) ? 0 : now - deadline);
+
+            // Advance from the deadline rather than from `now` so lateness does not accumulate
+            // If we fell a whole period behind, resynchronize instead of firing a burst of catch-up steps
+            unsigned int last = deadline;
+            if (SCHED_BEFORE(deadline + WHOLE(periods[motor]), now)) {
+                jitter_missed(motor, (now - deadline) / WHOLE(periods[motor]));
+                last = now;
+            }
+            advance_slice(motor, last, deadline, now);
+            next_step_times[motor] = step_after(motor, last);
+            sift_down(0);
+        }
+        step_function(due, when);
+    }
+
+    // Nothing playing - no need for timer interrupts
+    armtimer_disable();
+}
+
+static void handle_timer(unsigned int pc, void *aux_data) {
+    armtimer_check_and_clear_interrupt();
+    run_due_steps();
+}
+
+void sched_init(unsigned int num_motors, sched_step_fn_t step_fn) {
+    step_function = step_fn;
+    motor_count = (num_motors > SCHED_MAX_MOTORS) ? SCHED_MAX_MOTORS : num_motors;
+
+    heap_size = 0;
+    pending_count = 0;
+    slice_length = SCHED_SLICE_US;
+    lead_time = 0;
+    build_ramp_table();
+    jitter_reset();
+    for (unsigned int i = 0; i < SCHED_MAX_MOTORS; i++) {
+        heap_pos[i] = -1;
+        periods[i] = 0;
+        phases[i] = 0;
+        clear_slots(i);
+    }
+
+    // Timer is only enabled while at least one motor is playing
+    armtimer_init(1000);
+    armtimer_enable_interrupts();
+
+    interrupts_register_handler(INTERRUPTS_BASIC_ARM_TIMER_IRQ, handle_timer, NULL);
+    interrupts_enable_source(INTERRUPTS_BASIC_ARM_TIMER_IRQ);
+}
+
+void sched_start(unsigned int motor, unsigned int period) {
+    if (motor >= motor_count || period == 0) return;
+
+    interrupts_global_disable();
+    set_slot(motor, 0, period, schedule_time());
+    run_due_steps();
+    interrupts_global_enable();
+}
+
+void sched_set_slot(unsigned int motor, unsigned int slot, unsigned int period) {
+    if (motor >= motor_count || slot >= SCHED_MAX_SLOTS) return;
+
+    interrupts_global_disable();
+    set_slot(motor, slot, period, schedule_time());
+    run_due_steps();
+    interrupts_global_enable();
+}
+
+void sched_retune_slot(unsigned int motor, unsigned int slot, unsigned int period) {
+    if (motor >= motor_count || slot >= SCHED_MAX_SLOTS) return;
+
+    interrupts_global_disable();
+    if (period != 0 && heap_pos[motor] >= 0 && slot == slots[motor]) {
+        // The step already scheduled stays put, so the waveform carries on without a restart
+        // A ramp in progress carries on towards the new period instead
+        if (periods[motor] == slot_periods[motor][slot]) periods[motor] = period;
+        else ramp_steps[motor] = ramp_position(periods[motor]);
+        slot_periods[motor][slot] = period;
+    } else {
+        set_slot(motor, slot, period, schedule_time());
+        run_due_steps();
+    }
+    interrupts_global_enable();
+}
+
+void sched_set_slice(unsigned int length) {
+    if (length == 0) return;
+
+    // Takes effect from each motor's next slice
+    interrupts_global_disable();
+    slice_length = length;
+    interrupts_global_enable();
+}
+
+void sched_set_lead(unsigned int lead) {
+    interrupts_global_disable();
+    lead_time = lead;
+    run_due_steps();
+    interrupts_global_enable();
+}
+
+void sched_stop(unsigned int motor) {
+    if (motor >= motor_count) return;
+
+    interrupts_global_disable();
+    clear_slots(motor);
+    heap_remove(motor);
+    run_due_steps();
+    interrupts_global_enable();
+}
+
+void sched_at(unsigned int when, unsigned int motor, unsigned int slot, unsigned int period) {
+    if (motor >= motor_count || slot >= SCHED_MAX_SLOTS) return;
+
+    interrupts_global_disable();
+
+    if (pending_count == SCHED_MAX_PENDING) {
+        // No room to wait - better to play it now than to drop it
+        set_slot(motor, slot, period, schedule_time());
+    } else {
+        // Insert in deadline order - events usually arrive in order, so this rarely moves anything
+        unsigned int i = pending_count;
+        while (i > 0 && SCHED_BEFORE(when, pending[i - 1].when)) {
+            pending[i] = pending[i - 1];
+            i--;
+        }
+        pending[i].when = when;
+        pending[i].motor = motor;
+        pending[i].slot = slot;
+        pending[i].period = period;
+        pending_count++;
+    }
+
+    run_due_steps();
+    interrupts_global_enable();
+}
+
+unsigned int sched_is_active(unsigned int motor) {
+    if (motor >= motor_count) return 0;
+    return heap_pos[motor] >= 0;
+}
@@ -0,0 +1,96 @@
+// This file defines the step scheduler for the motor board
+// Every playing motor has a deadline (the value of `timer_get_ticks` when it next needs to step)
+// The deadlines are kept in a small binary min-heap, and the ARM timer is armed to interrupt
+// at the earliest one, so steps are fired from the timer interrupt instead of a polling loop
+// Note changes can also be queued for a future tick and are applied by the same interrupt
+// A motor can also be time-shared between up to SCHED_MAX_SLOTS pitches (chiptune arpeggio style):
+// it plays each non-empty slot in turn for one slice, switching only on a step so the
+// pitches join without a click
+// Periods are fixed point microseconds with SCHED_FRAC_BITS fractional bits; each motor carries the
+// leftover fraction from step to step, so the average step rate is exact even though each step lands
+// on a whole tick
+// Steppers stall if asked to jump straight to a high step rate, so a motor starting from rest
+// accelerates from SCHED_RAMP_START_US along a constant acceleration ramp, and a note change on a
+// turning motor glides along the same ramp from the current rate to the new one
+
+#ifndef _SCHED_H
+#define _SCHED_H
+
+// Maximum number of motors the scheduler can track
+#define SCHED_MAX_MOTORS 8
+
+// Maximum number of timed period changes waiting to be applied
+#define SCHED_MAX_PENDING 32
+
+// Number of pitches a motor can alternate between
+#define SCHED_MAX_SLOTS 4
+
+// Default time each pitch of a time-shared motor sounds for, in microseconds
+#define SCHED_SLICE_US 20000
+
+// Fractional bits in every period passed to the scheduler
+#define SCHED_FRAC_BITS 8
+
+// Step period a motor can start at from rest without stalling, in microseconds
+#define SCHED_RAMP_START_US 2000
+
+// Acceleration of the ramp, in steps per second per second
+#define SCHED_RAMP_ACCEL 100000
+
+// Number of entries in the ramp table (enough to reach the top of the piano)
+#define SCHED_RAMP_STEPS 128
+
+// Deadlines closer than this many microseconds are fired immediately instead of arming the timer
+#define SCHED_SLACK_US 2
+
+// Motors due within this many microseconds of each other step together, in one pulse
+// (a chord's motors stay in phase, at the cost of stepping some of them this much early)
+#define SCHED_BATCH_US 4
+
+// Returns true if tick `a` comes before tick `b`
+// Safe across the 32-bit wraparound of `timer_get_ticks` (valid while they are < ~35 minutes apart)
+#define SCHED_BEFORE(a, b) ((int)((a) - (b)) < 0)
+
+// Function called (from the timer interrupt) to pulse motors whose deadlines have arrived
+// `motors` has bit m set for every motor m to step, so simultaneous steps can share one pulse
+// `when` is the tick the steps are due at - only later than now if the scheduler has a lead
+typedef void (*sched_step_fn_t)(unsigned int motors, unsigned int when);
+
+// Initialize the scheduler and the ARM timer interrupt
+// Global interrupts must be enabled by the main program
+void sched_init(unsigned int num_motors, sched_step_fn_t step_fn);
+
+// Start a motor stepping every `period` (fixed point) microseconds (or change the period of a playing motor)
+// The first step happens one period from now
+// Sets slot 0 - any other slots in use keep taking turns with it
+void sched_start(unsigned int motor, unsigned int period);
+
+// Set one time-shared slot of a motor to step every `period` (fixed point) microseconds, or clear it if `period` is 0
+// If the slot is the one sounding, the change takes effect now, otherwise at the slot's next turn
+void sched_set_slot(unsigned int motor, unsigned int slot, unsigned int period);
+
+// Change the period of a slot without restarting its phase or ramping (for pitch bends)
+// A sounding slot keeps its next step where it is and uses the new period from then on
+// Behaves like `sched_set_slot` if the slot or the motor is not playing
+void sched_retune_slot(unsigned int motor, unsigned int slot, unsigned int period);
+
+// Set how long each pitch of a time-shared motor sounds for, in microseconds
+void sched_set_slice(unsigned int length);
+
+// Run `lead` microseconds ahead of the clock, handing steps to the step function that long before
+// they are due (for step backends that queue pulses rather than firing them)
+// Notes started without a time start `lead` later; timed changes (`sched_at`) still happen on time
+void sched_set_lead(unsigned int lead);
+
+// Stop a motor (clearing all of its slots)
+void sched_stop(unsigned int motor);
+
+// At tick `when`, set one slot of the motor to step every `period` (fixed point) microseconds (or clear it if `period` is 0)
+// The change is applied from the timer interrupt, with the first step exactly one period after `when`
+// Changes whose time has already passed are applied immediately
+void sched_at(unsigned int when, unsigned int motor, unsigned int slot, unsigned int period);
+
+// Returns 1 if the motor is currently scheduled, 0 otherwise
+unsigned int sched_is_active(unsigned int motor);
+
+#endif
@@ -0,0 +1,293 @@
+// Host-side arranger: reduces a MIDI file to a motor event stream for the controller
+// (see `controller/stream.h` for the format and `controller/song.h` for playing it)
+//
+// Usage: ./arranger [-m motors] [-l lowest] [-h highest] [-d] song.mid song.stream
+//     -m  number of motors to use (default and maximum 8)
+//     -l  lowest and -h highest playable piano key index (default 0 and 87, the range of
+//         `note_delays` in motors/motors.c) - notes outside are moved by octaves until they fit
+//     -d  keep the General MIDI drum channel (10), which is left out by default
+//
+// Notes are given to motors in start order. A free motor is chosen to keep each motor's line as
+// smooth as possible (smallest jump from the last note it played). When every motor is busy the
+// oldest sounding note that is not the top line is cut short rather than dropping the new note.
+// The same key starting together on several channels is merged into one note
+// All of this happens here, so the controller only replays the result
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../controller/smf.h"
+#include "../controller/stream.h"
+
+#define MAX_MOTORS 8
+#define MAX_NOTES 200000
+#define PIANO_KEYS 88
+#define PIANO_OFFSET 21   // MIDI key of piano key 0 (A0)
+#define DRUM_CHANNEL 9
+
+struct note_t {
+    unsigned int start;
+    unsigned int end;
+    unsigned char key;    // Piano key index, after folding
+    unsigned char channel;
+    int motor;            // -1 if dropped or merged
+};
+
+struct event_t {
+    unsigned int time;
+    unsigned char motor;
+    unsigned char key;    // STREAM_KEY_OFF to turn off
+};
+
+static struct note_t notes[MAX_NOTES];
+static int num_notes;
+static struct event_t events[2 * MAX_NOTES];
+static int num_events;
+
+static int low_key = 0;
+static int high_key = PIANO_KEYS - 1;
+
+struct stats_t {
+    int folded;
+    int merged;
+    int dropped;
+    int cut;
+    long jumps;
+    int jump_count;
+};
+
+static struct stats_t stats;
+
+static void add_note(unsigned int start, unsigned int end, unsigned char midi_key, unsigned char channel) {
+    if (num_notes == MAX_NOTES || end <= start) return;
+
+    int key = midi_key - PIANO_OFFSET;
+    int folded = 0;
+    while (key < low_key) { key += 12; folded = 1; }
+    while (key > high_key) { key -= 12; folded = 1; }
+    if (key < low_key) return; // Range narrower than an octave
+    stats.folded += folded;
+
+    notes[num_notes++] = (struct note_t){start, end, key, channel, -1};
+}
+
+static int read_notes(const unsigned char *data, unsigned int len, int keep_drums) {
+    struct smf_t smf;
+    if (!smf_open(&smf, data, len)) return 0;
+
+    // Start time of the note sounding on each channel and key (or -1)
+    static long started[16][128];
+    for (int c = 0; c < 16; c++) {
+        for (int k = 0; k < 128; k++) started[c][k] = -1;
+    }
+
+    struct midi_event_t event;
+    unsigned int time, last = 0;
+    while (smf_next(&smf, &event, &time)) {
+        last = time;
+        if (event.channel == DRUM_CHANNEL && !keep_drums) continue;
+        if (event.action != MIDI_NOTE_ON && event.action != MIDI_NOTE_OFF) continue;
+
+        long *start = &started[event.channel][event.key & 0x7F];
+        if (*start >= 0) {
+            // Any event for a sounding key ends it - a repeated note-on restarts it
+            add_note(*start, time, event.key, event.channel);
+            *start = -1;
+        }
+        if (event.action == MIDI_NOTE_ON && event.velocity > 0) *start = time;
+    }
+
+    for (int c = 0; c < 16; c++) {
+        for (int k = 0; k < 128; k++) {
+            if (started[c][k] >= 0) add_note(started[c][k], last, k, c);
+        }
+    }
+    return 1;
+}
+
+static int compare_notes(const void *a, const void *b) {
+    const struct note_t *x = a, *y = b;
+    if (x->start != y->start) return (x->start < y->start) ? -1 : 1;
+    // Higher notes first, so the top line gets first pick of the motors
+    return y->key - x->key;
+}
+
+static int compare_events(const void *a, const void *b) {
+    const struct event_t *x = a, *y = b;
+    if (x->time != y->time) return (x->time < y->time) ? -1 : 1;
+    // Offs first, then by motor, so equal inputs always give the same stream
+    if ((x->key == STREAM_KEY_OFF) != (y->key == STREAM_KEY_OFF)) return (x->key == STREAM_KEY_OFF) ? -1 : 1;
+    return x->motor - y->motor;
+}
+
+static void assign(int motors) {
+    int playing[MAX_MOTORS];   // Note on each motor (or -1) - it may have ended already
+    int last_key[MAX_MOTORS];  // Last key each motor played (or -1)
+    for (int m = 0; m < motors; m++) {
+        playing[m] = -1;
+        last_key[m] = -1;
+    }
+
+    for (int i = 0; i < num_notes; i++) {
+        struct note_t *n = &notes[i];
+
+        // Same key already starting here on another channel - one motor plays both
+        int merged = 0;
+        for (int m = 0; m < motors && !merged; m++) {
+            struct note_t *p = (playing[m] >= 0) ? &notes[playing[m]] : NULL;
+            if (p && p->start == n->start && p->key == n->key) {
+                if (n->end > p->end) p->end = n->end;
+                merged = 1;
+            }
+        }
+        if (merged) {
+            stats.merged++;
+            continue;
+        }
+
+        // Free motor closest to the new key (never used motors count as a jump of an octave)
+        int best = -1, best_cost = 0;
+        for (int m = 0; m < motors; m++) {
+            if (playing[m] >= 0 && notes[playing[m]].end > n->start) continue;
+            int cost = (last_key[m] < 0) ? 12 : abs(last_key[m] - n->key);
+            if (best < 0 || cost < best_cost) {
+                best = m;
+                best_cost = cost;
+            }
+        }
+
+        if (best < 0) {
+            // Every motor busy - cut the oldest note that is not the highest one sounding
+            int top = 0;
+            for (int m = 1; m < motors; m++) {
+                if (notes[playing[m]].key > notes[playing[top]].key) top = m;
+            }
+            for (int m = 0; m < motors; m++) {
+                if (m == top && motors > 1) continue;
+                if (best < 0 || notes[playing[m]].start < notes[playing[best]].start) best = m;
+            }
+
+            // A note that has not sounded yet cannot be cut - the new one is dropped instead
+            if (notes[playing[best]].start >= n->start) {
+                stats.dropped++;
+                continue;
+            }
+            notes[playing[best]].end = n->start;
+            stats.cut++;
+        }
+
+        if (last_key[best] >= 0) {
+            stats.jumps += abs(last_key[best] - n->key);
+            stats.jump_count++;
+        }
+        n->motor = best;
+        playing[best] = i;
+        last_key[best] = n->key;
+    }
+}
+
+static void make_events(int motors) {
+    // Next note on the same motor, to leave out the off when the next note takes over directly
+    int next_on_motor[MAX_MOTORS];
+    for (int m = 0; m < motors; m++) next_on_motor[m] = -1;
+
+    num_events = 0;
+    for (int i = num_notes - 1; i >= 0; i--) {
+        struct note_t *n = &notes[i];
+        if (n->motor < 0) continue;
+
+        events[num_events++] = (struct event_t){n->start, n->motor, n->key};
+        int next = next_on_motor[n->motor];
+        if (next < 0 || notes[next].start > n->end) {
+            events[num_events++] = (struct event_t){n->end, n->motor, STREAM_KEY_OFF};
+        }
+        next_on_motor[n->motor] = i;
+    }
+
+    qsort(events, num_events, sizeof(events[0]), compare_events);
+}
+
+static void put_le32(FILE *f, unsigned int v) {
+    for (int i = 0; i < 4; i++) fputc((v >> (8 * i)) & 0xFF, f);
+}
+
+static int write_stream(const char *path, int motors) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+
+    fputc('M', f); fputc('S', f); fputc('T', f); fputc('R', f);
+    fputc(STREAM_VERSION, f);
+    fputc(motors, f);
+    fputc(0, f); fputc(0, f);
+    put_le32(f, num_events);
+
+    unsigned int time = 0;
+    for (int i = 0; i < num_events; i++) {
+        unsigned int delta = events[i].time - time;
+        time = events[i].time;
+        while (delta >= 0x80) {
+            fputc((delta & 0x7F) | 0x80, f);
+            delta >>= 7;
+        }
+        fputc(delta, f);
+        fputc(events[i].motor, f);
+        fputc(events[i].key, f);
+    }
+
+    long size = ftell(f);
+    fclose(f);
+    printf("wrote %s: %d events, %ld bytes\n", path, num_events, size);
+    return 1;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-m motors] [-l lowest] [-h highest] [-d] song.mid song.stream\n", name);
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    int motors = MAX_MOTORS;
+    int keep_drums = 0;
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-d") == 0) keep_drums = 1;
+        else if (arg + 1 >= argc) usage(argv[0]);
+        else if (strcmp(argv[arg], "-m") == 0) motors = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-l") == 0) low_key = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-h") == 0) high_key = atoi(argv[++arg]);
+        else usage(argv[0]);
+    }
+    if (argc - arg != 2 || motors < 1 || motors > MAX_MOTORS) usage(argv[0]);
+    if (low_key < 0 || high_key >= PIANO_KEYS || high_key - low_key < 11) {
+        fprintf(stderr, "arranger: playable range must be within 0-%d and span at least an octave\n", PIANO_KEYS - 1);
+        return 2;
+    }
+
+    FILE *f = fopen(argv[arg], "rb");
+    if (!f) {
+        perror(argv[arg]);
+        return 1;
+    }
+    static unsigned char data[1 << 22];
+    unsigned int len = fread(data, 1, sizeof(data), f);
+    fclose(f);
+
+    if (!read_notes(data, len, keep_drums)) {
+        fprintf(stderr, "arranger: %s is not a format 0/1 MIDI file\n", argv[arg]);
+        return 1;
+    }
+
+    qsort(notes, num_notes, sizeof(notes[0]), compare_notes);
+    assign(motors);
+    make_events(motors);
+
+    printf("%d notes: %d folded into range, %d merged, %d cut short, %d dropped, average jump %.1f keys\n",
+           num_notes, stats.folded, stats.merged, stats.cut, stats.dropped,
+           stats.jump_count ? (double) stats.jumps / stats.jump_count : 0.0);
+    return write_stream(argv[arg + 1], motors) ? 0 : 1;
+}
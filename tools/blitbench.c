@@ -0,0 +1,180 @@
+// Host-side test and microbenchmark for the graphics board's fill and copy kernels (see `graphics/blit.h`)
+//
+// Usage: ./blitbench
+// First checks the kernels against plain pixel loops for every start alignment and every width up to
+// a few dozen pixels, with guard pixels either side of each row that must not be written
+// Then times drawing the visualizer's keyboard with 16 keys pressed on a screen-sized buffer, two ways:
+//     - as `graphics.c` used to: 88 rectangles for the bare keyboard, then one per pressed key
+//     - from the keyboard sprites: one copy of the bare keyboard, then one key-sized copy per pressed key
+// and filling the whole screen each way
+// The rectangles go through a stand-in for libpi's `gl_draw_rect` (which the host can't link): clip to
+// the screen, then store one pixel at a time. Host times only show the ratio, not board times
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../graphics/blit.h"
+
+// The visualizer's screen and keyboard
+#define WIDTH 920
+#define HEIGHT 1000
+#define NUM_KEYS 88
+#define KEY_WIDTH 10
+#define KEY_HEIGHT 40
+#define KEYBOARD_WIDTH (NUM_KEYS * KEY_WIDTH)
+#define PRESSED 16
+
+#define WHITE 0xFFFFFFFF
+#define BLACK 0xFF000000
+#define GUARD 0xDEADBEEF
+
+#define MAX_TEST_WIDTH 40
+
+static unsigned int screen[HEIGHT * WIDTH] __attribute__((aligned(8)));
+static unsigned int idle_keyboard[KEY_HEIGHT * KEYBOARD_WIDTH] __attribute__((aligned(8)));
+static unsigned int pressed_keyboard[KEY_HEIGHT * KEYBOARD_WIDTH] __attribute__((aligned(8)));
+static int failures;
+
+// Stand-in for `gl_draw_rect`
+static void draw_rect(int x, int y, int w, int h, unsigned int color) {
+    unsigned int (*image)[WIDTH] = (unsigned int (*)[WIDTH]) screen;
+    int x_end = (x + w < WIDTH) ? x + w : WIDTH;
+    int y_end = (y + h < HEIGHT) ? y + h : HEIGHT;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    for (int j = y; j < y_end; j++) {
+        for (int i = x; i < x_end; i++) {
+            image[j][i] = color;
+        }
+    }
+}
+
+static unsigned int piano_color(int key) {
+    // Same pattern as `piano_color` in graphics.c
+    if (key < 3) return (key % 2 == 0) ? WHITE : BLACK;
+    int pos = (key - 3) % 12;
+    if (pos < 5) return (pos % 2 == 0) ? WHITE : BLACK;
+    return ((pos - 5) % 2 == 0) ? WHITE : BLACK;
+}
+
+static void check_kernels(void) {
+    unsigned int dst[MAX_TEST_WIDTH + 8] __attribute__((aligned(8)));
+    unsigned int src[MAX_TEST_WIDTH + 8] __attribute__((aligned(8)));
+
+    for (unsigned int i = 0; i < MAX_TEST_WIDTH + 8; i++) src[i] = 0xFF000000 | i * 0x010203;
+
+    for (unsigned int offset = 0; offset < 4; offset++) {
+        for (unsigned int src_offset = 0; src_offset < 4; src_offset++) {
+            for (unsigned int w = 0; w <= MAX_TEST_WIDTH; w++) {
+                for (unsigned int i = 0; i < MAX_TEST_WIDTH + 8; i++) dst[i] = GUARD;
+                blit_copy(dst + 1 + offset, 0, src + src_offset, 0, w, 1);
+
+                for (unsigned int i = 0; i < MAX_TEST_WIDTH + 8; i++) {
+                    int inside = i >= 1 + offset && i < 1 + offset + w;
+                    unsigned int expected = inside ? src[src_offset + i - 1 - offset] : GUARD;
+                    if (dst[i] != expected) {
+                        if (failures++ < 10) printf("FAIL: copy of %u from +%u to +%u, pixel %u\n", w, src_offset, offset, i);
+                        break;
+                    }
+                }
+
+                if (src_offset) continue;
+                for (unsigned int i = 0; i < MAX_TEST_WIDTH + 8; i++) dst[i] = GUARD;
+                blit_fill(dst + 1 + offset, 0, w, 1, 0x12345678);
+
+                for (unsigned int i = 0; i < MAX_TEST_WIDTH + 8; i++) {
+                    int inside = i >= 1 + offset && i < 1 + offset + w;
+                    if (dst[i] != (inside ? 0x12345678 : GUARD)) {
+                        if (failures++ < 10) printf("FAIL: fill of %u at +%u, pixel %u\n", w, offset, i);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // A rectangle with rows further apart than its width
+    for (unsigned int i = 0; i < WIDTH * 4; i++) screen[i] = GUARD;
+    blit_fill(screen + 3, WIDTH, 7, 3, 0x55);
+    for (unsigned int i = 0; i < WIDTH * 4; i++) {
+        unsigned int row = i / WIDTH, x = i % WIDTH;
+        unsigned int expected = (row < 3 && x >= 3 && x < 10) ? 0x55 : GUARD;
+        if (screen[i] != expected) {
+            if (failures++ < 10) printf("FAIL: rectangle fill, pixel %u\n", i);
+            break;
+        }
+    }
+}
+
+static int pressed_keys[PRESSED];
+
+static void keyboard_rects(void) {
+    for (int key = 0; key < NUM_KEYS; key++) {
+        draw_rect(key * KEY_WIDTH, 0, KEY_WIDTH, KEY_HEIGHT, piano_color(key));
+    }
+    for (int i = 0; i < PRESSED; i++) {
+        draw_rect(pressed_keys[i] * KEY_WIDTH, 0, KEY_WIDTH, KEY_HEIGHT, 0xFFFF0000);
+    }
+}
+
+static void keyboard_sprites(void) {
+    blit_copy(screen, WIDTH, idle_keyboard, KEYBOARD_WIDTH, KEYBOARD_WIDTH, KEY_HEIGHT);
+    for (int i = 0; i < PRESSED; i++) {
+        int x = pressed_keys[i] * KEY_WIDTH;
+        blit_copy(screen + x, WIDTH, pressed_keyboard + x, KEYBOARD_WIDTH, KEY_WIDTH, KEY_HEIGHT);
+    }
+}
+
+static void screen_rect(void) {
+    draw_rect(0, 0, WIDTH, HEIGHT, BLACK);
+}
+
+static void screen_fill(void) {
+    blit_fill(screen, WIDTH, WIDTH, HEIGHT, BLACK);
+}
+
+// Nanoseconds per call of `draw`
+static double time_ns(void (*draw)(void), int repeats) {
+    clock_t start = clock();
+    for (int i = 0; i < repeats; i++) {
+        draw();
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / repeats;
+}
+
+int main(void) {
+    check_kernels();
+
+    for (int key = 0; key < NUM_KEYS; key++) {
+        blit_fill(idle_keyboard + key * KEY_WIDTH, KEYBOARD_WIDTH, KEY_WIDTH, KEY_HEIGHT, piano_color(key));
+    }
+    blit_fill(pressed_keyboard, KEYBOARD_WIDTH, KEYBOARD_WIDTH, KEY_HEIGHT, 0xFFFF0000);
+    srand(25);
+    for (int i = 0; i < PRESSED; i++) pressed_keys[i] = rand() % NUM_KEYS;
+
+    // Both keyboard paths must draw the same picture
+    static unsigned int expected[KEY_HEIGHT * WIDTH];
+    memset(screen, 0, sizeof(expected));
+    keyboard_rects();
+    memcpy(expected, screen, sizeof(expected));
+    memset(screen, 0, sizeof(expected));
+    keyboard_sprites();
+    if (memcmp(expected, screen, sizeof(expected)) != 0) {
+        printf("FAIL: sprite keyboard differs from the rectangles\n");
+        failures++;
+    }
+
+    double rects = time_ns(keyboard_rects, 20000);
+    double sprites = time_ns(keyboard_sprites, 20000);
+    printf("keyboard, %d keys pressed: rectangles %8.0f ns, sprites %8.0f ns (%.1fx)\n",
+           PRESSED, rects, sprites, rects / sprites);
+
+    double rect = time_ns(screen_rect, 500);
+    double fill = time_ns(screen_fill, 500);
+    printf("whole screen:              rectangle  %8.0f ns, fill    %8.0f ns (%.1fx)\n", rect, fill, rect / fill);
+
+    printf(failures ? "%d failures\n" : "all passed\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,91 @@
+// Host-side simulation of the NAJ clock synchronization (see `motors/clocksync.h`)
+//
+// Usage: ./clocksim [seconds]
+// Simulates the host and two readers whose crystals run fast and slow, with interrupt latency
+// noise on every timestamp and the occasional badly delayed interrupt. The host sends a sync
+// pair every NAJ_SYNC_PERIOD, and the readers' view of the shared time is checked against the
+// host's at random moments in between. Exits with status 1 if the error does not settle
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../motors/clocksync.h"
+
+// Must match `motors/naj.h`
+#define NAJ_SYNC_PERIOD 1000000
+
+// Samples after this many syncs count towards the settled error
+#define SETTLE_SYNCS 10
+
+// Settled error must stay below this many microseconds
+#define MAX_SETTLED_ERROR 20
+
+struct node_t {
+    const char *name;
+    double ppm;            // Crystal error relative to the host
+    unsigned int offset;   // Tick counter value when the host's counter reads 0
+    struct clocksync_t clock;
+    int max_error;
+};
+
+// A board's tick counter at true (host) time `t`
+static unsigned int node_ticks(const struct node_t *node, double t) {
+    return node->offset + (unsigned int)(long long)(t * (1.0 + node->ppm / 1e6));
+}
+
+// Timestamping latency in microseconds: a few microseconds normally, very late once in a while
+static double latency(void) {
+    if (rand() % 50 == 0) return 800 + rand() % 400;
+    return 1 + rand() % 4;
+}
+
+int main(int argc, char *argv[]) {
+    int seconds = (argc > 1) ? atoi(argv[1]) : 120;
+    srand(107);
+
+    // Offsets put the readers' counters close to their 32-bit wraparound during the run
+    struct node_t nodes[] = {
+        { "fast (+80 ppm)", 80, 0xFFFFFFFFu - 20000000u },
+        { "slow (-120 ppm)", -120, 123456789u },
+    };
+    int num_nodes = sizeof(nodes) / sizeof(nodes[0]);
+
+    // Handshake: everyone timestamps the same edge, and that moment is shared time 0
+    double handshake = 5000;
+    unsigned int host_epoch = (unsigned int) handshake;
+    for (int n = 0; n < num_nodes; n++) {
+        clocksync_init(&nodes[n].clock, node_ticks(&nodes[n], handshake + latency()), 0);
+        nodes[n].max_error = 0;
+    }
+
+    for (int sync = 1; sync <= seconds; sync++) {
+        double t = handshake + (double) sync * NAJ_SYNC_PERIOD;
+
+        // Host stamps the SYNC frame as it clocks it out; the readers stamp it as it is latched
+        unsigned int host_time = (unsigned int) t - host_epoch;
+        for (int n = 0; n < num_nodes; n++) {
+            clocksync_sample(&nodes[n].clock, node_ticks(&nodes[n], t + latency()), host_time);
+        }
+
+        // Check the readers' shared time at a few moments before the next sync
+        for (int k = 0; k < 4; k++) {
+            double when = t + rand() % NAJ_SYNC_PERIOD;
+            int truth = (unsigned int) when - host_epoch;
+            for (int n = 0; n < num_nodes; n++) {
+                int error = (int)(clocksync_to_master(&nodes[n].clock, node_ticks(&nodes[n], when)) - truth);
+                if (error < 0) error = -error;
+                if (sync > SETTLE_SYNCS && error > nodes[n].max_error) nodes[n].max_error = error;
+            }
+        }
+    }
+
+    int failed = 0;
+    for (int n = 0; n < num_nodes; n++) {
+        double drift_ppm = nodes[n].clock.drift * 1e6 / (1 << CLOCKSYNC_DRIFT_SHIFT);
+        printf("%-16s drift estimate %+8.2f ppm  settled max error %3d us  samples %u  rejected %u\n",
+               nodes[n].name, drift_ppm, nodes[n].max_error, nodes[n].clock.samples, nodes[n].clock.rejected);
+        if (nodes[n].max_error > MAX_SETTLED_ERROR) failed = 1;
+    }
+
+    return failed;
+}
@@ -0,0 +1,107 @@
+// Host-side test for the DMA step backend's control block generator (see `motors/dmacb.h`)
+//
+// Usage: ./dmatest
+// Builds the ring at a made-up bus address and runs a simulated DMA engine over it: each control
+// block copies one word, and the block writing the PWM FIFO advances time by one slot
+// Checks that the chain closes on itself, that queued pins are set in their slot and cleared one
+// slot later, that the ring cleans up after itself so nothing repeats on the next lap, and that
+// steps too close to the DMA engine are refused
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "../motors/dmacb.h"
+
+#define RING_BUS 0x40100000
+#define BUS_SET 0x7E20001C
+#define BUS_CLEAR 0x7E200028
+#define BUS_FIFO 0x7E20C018
+
+static struct dmacb_ring_t ring;
+static int failures;
+
+static void expect(int ok, const char *what) {
+    printf("%s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) failures++;
+}
+
+// Word of the ring at bus address `bus`
+static unsigned int *ring_word(unsigned int bus) {
+    unsigned int offset = bus - RING_BUS;
+    if (offset >= sizeof(ring) || offset % 4) return NULL;
+    return (unsigned int *)((char *) &ring + offset);
+}
+
+struct pulse_t {
+    unsigned int time;
+    unsigned int pins;
+    int set;
+};
+
+// Run the ring for `slots` slots from slot 0, recording every non-empty GPSET0/GPCLR0 write
+static int run(unsigned int slots, struct pulse_t *pulses, int max) {
+    unsigned int block = RING_BUS + offsetof(struct dmacb_ring_t, blocks);
+    unsigned int time = 0;
+    int count = 0;
+
+    while (time < slots * DMACB_SLOT_US) {
+        int slot = dmacb_slot_at(RING_BUS, block);
+        if (slot < 0 || (unsigned int) slot != time / DMACB_SLOT_US % DMACB_SLOTS) {
+            printf("FAIL: block %08x is not in slot %u\n", block, time / DMACB_SLOT_US);
+            failures++;
+            return count;
+        }
+
+        struct dmacb_t *cb = (struct dmacb_t *) ring_word(block);
+        unsigned int value = *ring_word(cb->source);
+        if (cb->dest == BUS_FIFO) {
+            time += DMACB_SLOT_US;
+        } else if (cb->dest == BUS_SET || cb->dest == BUS_CLEAR) {
+            if (value && count < max) pulses[count++] = (struct pulse_t){time, value, cb->dest == BUS_SET};
+        } else {
+            *ring_word(cb->dest) = value;
+        }
+        block = cb->next;
+    }
+    return count;
+}
+
+int main(void) {
+    struct dmacb_targets_t targets = { BUS_SET, BUS_CLEAR, BUS_FIFO };
+    dmacb_build(&ring, RING_BUS, &targets);
+
+    // The last block leads back to the first
+    struct dmacb_t *last = &ring.blocks[DMACB_SLOTS * DMACB_PER_SLOT - 1];
+    expect(last->next == RING_BUS + offsetof(struct dmacb_ring_t, blocks), "chain closes on itself");
+    expect(last->dest == BUS_FIFO && (last->info & DMACB_TI_DEST_DREQ), "each slot ends paced by the PWM FIFO");
+
+    // Two chords and a lone step, queued while the DMA engine is at slot 0 at tick 1000
+    int a = dmacb_slot_for(0, 1000, 1100);
+    int b = dmacb_slot_for(0, 1000, 1101);
+    int c = dmacb_slot_for(0, 1000, 1400);
+    expect(a == 25 && b == 25 && c == 100, "steps map to the slots of their deadlines");
+    ring.pins[a] |= 1 << 2;
+    ring.pins[b] |= 1 << 3;
+    ring.pins[c] |= 1 << 17;
+
+    expect(dmacb_slot_for(0, 1000, 1004) < 0, "steps too close to the DMA engine are refused");
+    expect(dmacb_slot_for(0, 1000, 900) < 0, "steps already due are refused");
+    expect(dmacb_slot_for(0, 1000, 1000 + DMACB_SLOTS * DMACB_SLOT_US) < 0, "steps beyond the ring are refused");
+    expect(dmacb_slot_for(DMACB_SLOTS - 1, 0, 8) == 1, "slots wrap round the ring");
+    expect(dmacb_slot_at(RING_BUS, RING_BUS + sizeof(ring.blocks)) < 0, "addresses past the blocks are not slots");
+
+    // Two full laps - everything should happen once, on the first lap
+    struct pulse_t pulses[16];
+    int count = run(2 * DMACB_SLOTS, pulses, 16);
+    for (int i = 0; i < count; i++) {
+        printf("      t=%-5u %s %08x\n", pulses[i].time, pulses[i].set ? "set  " : "clear", pulses[i].pins);
+    }
+    expect(count == 4, "four writes in two laps (nothing repeats)");
+    expect(count == 4 && pulses[0].set && pulses[0].pins == 0xC && pulses[0].time == 100, "chord set together at its slot");
+    expect(count == 4 && !pulses[1].set && pulses[1].pins == 0xC && pulses[1].time == 104, "chord cleared one slot later");
+    expect(count == 4 && pulses[2].set && pulses[2].pins == 1 << 17 && pulses[2].time == 400, "lone step set at its slot");
+    expect(count == 4 && !pulses[3].set && pulses[3].time == 404, "lone step cleared one slot later");
+
+    printf(failures ? "%d failures\n" : "all passed\n", failures);
+    return failures != 0;
+}
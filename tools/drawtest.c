@@ -0,0 +1,287 @@
+// Host-side test for the visualizer's renderers (see `graphics/graphics.c`)
+//
+// Usage: ./drawtest
+// Links `graphics.c` itself against a fake gl that draws into framebuffer pages in memory (see
+// `fakepi/`), plays random notes into it through `set_voice_note` - a sparse passage, a dense one,
+// then silence - and after every frame compares the page on screen, pixel for pixel, with a full
+// redraw (clear, keyboard, pressed keys, every span) of the same moment:
+//     - the incremental renderer (INCREMENTAL_DRAW), which repaints only the damaged intervals of the
+//       page it draws, flipping pages as `main` does
+//     - the panned renderer (PANNED_SCROLL), both panning a virtual framebuffer - checking too that
+//       nothing on screen is written between pans - and, where the firmware cannot pan or stops
+//       panning, copying the window to a single buffer
+// Also counts the pixels the incremental renderer paints per frame through `gl_draw_rect` and
+// `gl_clear`, against the full redraw's: the work saved, not frame times, which only the board's
+// FRAME_LOG can give
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../graphics/naj.h"
+#include "fakepi/gl.h"
+
+#define WIDTH 920
+#define HEIGHT 1000
+#define FRAME_US 10000
+#define PHASE_FRAMES 200
+#define NUM_VOICES (NAJ_MAX_VOICES * NAJ_MAX_BOARDS)
+#define MAX_SPANS 512 // As in `graphics.c`
+
+// The renderer's entry points and state, from `graphics.c`
+extern unsigned char voice_notes[];
+extern unsigned short voice_spans[];
+extern unsigned int span_head, span_count, draw_page;
+extern int pan_failed;
+void build_sprites(void);
+void set_voice_note(unsigned char voice, unsigned char key, unsigned int time);
+void damage_all(void);
+void draw_frame(unsigned int now);
+void scroll_start(void);
+void draw_panned(unsigned int now);
+void color_piano(void);
+void color_keys(unsigned char *arr);
+void color_spans(unsigned int now);
+
+// Fake gl: two pages for double buffering, a virtual framebuffer twice the width and height for
+// panning, and the page the reference is drawn into
+static color_t pages[2][HEIGHT][WIDTH];
+static color_t virtual_fb[2 * HEIGHT][2 * WIDTH];
+static color_t on_screen[HEIGHT][WIDTH]; // The panned window as it was when the display was panned onto it
+static color_t reference[HEIGHT][WIDTH];
+static color_t *target;
+static unsigned int target_pitch = WIDTH;
+static unsigned int showing;
+static unsigned long painted;
+
+static unsigned int sim_time;
+static int can_pan;
+static unsigned int pan_x, pan_y, pans;
+static unsigned int refuse_after; // Pans the firmware accepts before refusing them, 0 for all
+static unsigned int disturbed;    // Pans that found the window on screen written since the last
+static int failures;
+
+static void expect(int ok, const char *what) {
+    if (!ok && failures++ < 20) printf("FAIL: %s\n", what);
+}
+
+void gl_draw_rect(int x, int y, int w, int h, color_t c) {
+    int x_end = (x + w < WIDTH) ? x + w : WIDTH;
+    int y_end = (y + h < HEIGHT) ? y + h : HEIGHT;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    for (int row = y; row < y_end; row++) {
+        for (int col = x; col < x_end; col++) target[row * target_pitch + col] = c;
+    }
+    if (x_end > x && y_end > y) painted += (x_end - x) * (y_end - y);
+}
+
+void gl_clear(color_t c) {
+    gl_draw_rect(0, 0, WIDTH, HEIGHT, c);
+}
+
+void gl_swap_buffer(void) {
+    // The page drawn goes on screen, and drawing moves to the other
+    showing = !showing;
+    target = &pages[!showing][0][0];
+}
+
+void gl_init(unsigned int width, unsigned int height, fb_mode_t mode) {
+    showing = 0;
+    target = &pages[mode == FB_DOUBLEBUFFER][0][0];
+}
+
+void *fb_get_draw_buffer(void) {
+    return target;
+}
+
+unsigned int fb_get_pitch(void) {
+    return target_pitch * sizeof(color_t);
+}
+
+void *panfb_init(unsigned int width, unsigned int height, unsigned int *pitch) {
+    *pitch = 2 * WIDTH * sizeof(color_t);
+    return can_pan ? virtual_fb : NULL;
+}
+
+int panfb_pan(unsigned int x, unsigned int y) {
+    if (refuse_after && pans == refuse_after) return 0;
+
+    for (unsigned int row = 0; row < HEIGHT; row++) {
+        if (memcmp(&virtual_fb[pan_y + row][pan_x], on_screen[row], sizeof(on_screen[row])) != 0) {
+            disturbed++;
+            break;
+        }
+    }
+    pan_x = x;
+    pan_y = y;
+    pans++;
+    for (unsigned int row = 0; row < HEIGHT; row++) {
+        memcpy(on_screen[row], &virtual_fb[pan_y + row][pan_x], sizeof(on_screen[row]));
+    }
+    return 1;
+}
+
+// The rest of the board, which the renderers do not use
+unsigned int naj_time(void) {
+    return sim_time;
+}
+
+unsigned int naj_board_count(void) {
+    return 2;
+}
+
+int naj_read_frame(struct naj_frame_t *frame) {
+    return 0;
+}
+
+void naj_init_read(void) {}
+void naj_listen_all(void) {}
+void naj_wait_handshake(void) {}
+void interrupts_init(void) {}
+void interrupts_global_enable(void) {}
+void uart_init(void) {}
+int uart_putchar(int ch) {
+    return ch;
+}
+void timer_init(void) {}
+unsigned int timer_get_ticks(void) {
+    return sim_time;
+}
+
+static void reset_notes(void) {
+    memset(voice_notes, 0xFF, NUM_VOICES);
+    memset(voice_spans, 0xFF, NUM_VOICES * sizeof(unsigned short));
+    span_head = 0;
+    span_count = 0;
+}
+
+// Returns 1 if a note started with the span ring full, dropping its oldest span
+static int play(unsigned int frame, unsigned int dense) {
+    // A few note changes per frame while sparse, `dense` while dense, none in the silence
+    unsigned int changes = (frame < PHASE_FRAMES) ? 1 : (frame < 2 * PHASE_FRAMES) ? dense : 0;
+    int overflow = 0;
+    for (unsigned int i = 0; i < changes; i++) {
+        if (rand() % 3 != 0) continue;
+        unsigned char key = (rand() % 4 == 0) ? 0xFF : rand() % 88;
+        if (span_count == MAX_SPANS && key < 88) overflow = 1;
+        set_voice_note(rand() % NUM_VOICES, key, sim_time - rand() % (FRAME_US / 2));
+    }
+    return overflow;
+}
+
+// Full redraw of the picture at `now`, into `reference`
+static void draw_reference(unsigned int now) {
+    color_t *saved = target;
+    target = &reference[0][0];
+    painted = 0;
+    gl_clear(GL_BLACK);
+    color_piano();
+    color_keys(voice_notes);
+    color_spans(now);
+    target = saved;
+}
+
+// Compare the screen with the reference, returning 1 if they match
+static int matches(const color_t *screen, unsigned int pitch) {
+    for (unsigned int row = 0; row < HEIGHT; row++) {
+        if (memcmp(screen + row * pitch, reference[row], sizeof(reference[row])) != 0) return 0;
+    }
+    return 1;
+}
+
+static void report(const char *name, unsigned int frame, unsigned long *phase_painted, unsigned long full_painted) {
+    if ((frame + 1) % PHASE_FRAMES != 0) return;
+    const char *phases[] = {"sparse", "dense", "silent"};
+    printf("%s, %s: %lu pixels painted per frame (full redraw %lu), %u spans\n", name, phases[frame / PHASE_FRAMES],
+           *phase_painted / PHASE_FRAMES, full_painted, span_count);
+    *phase_painted = 0;
+}
+
+static void check_incremental(void) {
+    reset_notes();
+    build_sprites();
+    sim_time = 1000000;
+
+    // As `main` starts it: both pages black, everything damaged
+    gl_init(WIDTH, HEIGHT, FB_DOUBLEBUFFER);
+    gl_clear(GL_BLACK);
+    gl_swap_buffer();
+    gl_clear(GL_BLACK);
+    draw_page = 0;
+    damage_all();
+
+    unsigned int bad = 0, overflows = 0;
+    unsigned long phase_painted = 0, full_painted = 0;
+    for (unsigned int frame = 0; frame < 3 * PHASE_FRAMES; frame++) {
+        overflows += play(frame, 12);
+        painted = 0;
+        draw_frame(sim_time);
+        phase_painted += painted;
+        gl_swap_buffer();
+        draw_page = !draw_page;
+
+        draw_reference(sim_time);
+        full_painted = painted;
+        if (!matches(&pages[showing][0][0], WIDTH) && bad++ < 3) printf("incremental: frame %u differs\n", frame);
+        report("incremental", frame, &phase_painted, full_painted);
+        sim_time += FRAME_US;
+    }
+    expect(bad == 0, "incremental repaint differs from a full redraw");
+    expect(overflows > 0, "incremental: the span ring never filled");
+}
+
+// With `refuse`, the firmware stops accepting pans after that many
+static void check_panned(int pan, unsigned int refuse) {
+    reset_notes();
+    sim_time = 1000000;
+    can_pan = pan;
+    pan_failed = 0;
+    pan_x = pan_y = pans = disturbed = 0;
+    refuse_after = refuse;
+    for (unsigned int row = 0; row < HEIGHT; row++) memcpy(on_screen[row], virtual_fb[row], sizeof(on_screen[row]));
+    gl_init(WIDTH, HEIGHT, FB_SINGLEBUFFER);
+    scroll_start();
+    sim_time += FRAME_US; // As `main` draws its first frame, a slot after the start
+
+    // Kept below a full span ring: the panned renderer leaves the rows already drawn of a span it drops
+    // for room, where a full redraw loses the whole span
+    // While panning, a frame is only drawn once the display has had time to take up the last pan
+    unsigned int bad = 0, overflows = 0, drawn = 0;
+    for (unsigned int frame = 0; frame < 3 * PHASE_FRAMES; frame++) {
+        overflows += play(frame, 6);
+        unsigned int pans_before = pans;
+        draw_panned(sim_time);
+
+        // The window on screen: where the display is panned to, or the copy of it
+        if (pan_failed || !pan || pans != pans_before) {
+            drawn++;
+            draw_reference(sim_time);
+            int panned = pan && !pan_failed;
+            const color_t *screen = panned ? &virtual_fb[pan_y][pan_x] : &pages[0][0][0];
+            if (!matches(screen, panned ? 2 * WIDTH : WIDTH) && bad++ < 3) printf("panned: frame %u differs\n", frame);
+        }
+        sim_time += FRAME_US;
+    }
+
+    const char *mode = !pan ? "copying the window" : refuse ? "panning, then copying" : "panning";
+    char what[160];
+    snprintf(what, sizeof(what), "panned (%s) scroll differs from a full redraw", mode);
+    expect(bad == 0 && overflows == 0, what);
+    snprintf(what, sizeof(what), "panned (%s): %u pans found the window on screen written", mode, disturbed);
+    expect(disturbed == 0, what);
+    snprintf(what, sizeof(what), "panned (%s): only %u of %u frames drawn", mode, drawn, 3 * PHASE_FRAMES);
+    expect(drawn >= 3 * PHASE_FRAMES / 2, what);
+    expect(!refuse || pan_failed, "panned: refused pan not noticed");
+}
+
+int main(void) {
+    srand(107);
+    check_incremental();
+    check_panned(1, 0);
+    check_panned(0, 0);
+    check_panned(1, 100);
+
+    printf(failures ? "%d failures\n" : "all passed\n", failures);
+    return failures != 0;
+}
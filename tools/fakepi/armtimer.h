@@ -0,0 +1,19 @@
+// Host stand-in for libpi's `armtimer.h`, for the simulations in `tools/` that link board code
+// The simulation defines these functions, and the load register the board code writes to re-arm
+// the timer (see `motors/sched.c`)
+
+#ifndef ARMTIMER_H
+#define ARMTIMER_H
+
+#include <stdbool.h>
+
+extern volatile unsigned int fakepi_armtimer_load;
+#define ARMTIMER_LOAD (&fakepi_armtimer_load)
+
+void armtimer_init(unsigned int nticks);
+void armtimer_enable(void);
+void armtimer_disable(void);
+void armtimer_enable_interrupts(void);
+bool armtimer_check_and_clear_interrupt(void);
+
+#endif
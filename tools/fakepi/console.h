@@ -0,0 +1,8 @@
+// Host stand-in for libpi's `console.h`, for the simulations in `tools/` that link board code
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+void console_init(unsigned int nrows, unsigned int ncols);
+
+#endif
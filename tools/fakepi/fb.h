@@ -0,0 +1,12 @@
+// Host stand-in for libpi's `fb.h`, for the simulations in `tools/` that link board code
+// The simulation defines these functions on framebuffer pages in memory
+
+#ifndef FB_H
+#define FB_H
+
+typedef enum { FB_SINGLEBUFFER = 0, FB_DOUBLEBUFFER = 1 } fb_mode_t;
+
+unsigned int fb_get_pitch(void);
+void *fb_get_draw_buffer(void);
+
+#endif
@@ -0,0 +1,28 @@
+// Host stand-in for libpi's `gl.h`, for the simulations in `tools/` that link board code
+// The simulation defines these functions on framebuffer pages in memory
+
+#ifndef GL_H
+#define GL_H
+
+#include "fb.h"
+
+typedef unsigned int color_t;
+
+#define GL_BLUE    0xFF0000FF
+#define GL_RED     0xFFFF0000
+#define GL_GREEN   0xFF00FF00
+#define GL_CYAN    0xFF00FFFF
+#define GL_MAGENTA 0xFFFF00FF
+#define GL_YELLOW  0xFFFFFF00
+#define GL_ORANGE  0xFFFF3F00
+#define GL_PURPLE  0xFF7F00FF
+#define GL_SILVER  0xFFBBBBBB
+#define GL_WHITE   0xFFFFFFFF
+#define GL_BLACK   0xFF000000
+
+void gl_init(unsigned int width, unsigned int height, fb_mode_t mode);
+void gl_clear(color_t c);
+void gl_swap_buffer(void);
+void gl_draw_rect(int x, int y, int w, int h, color_t c);
+
+#endif
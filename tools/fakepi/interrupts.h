@@ -0,0 +1,21 @@
+// Host stand-in for libpi's `interrupts.h`, for the simulations in `tools/` that link board code
+// The simulation defines these functions, and calls the registered handlers itself
+
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include <stdbool.h>
+
+enum interrupt_source {
+    INTERRUPTS_BASIC_ARM_TIMER_IRQ = 64,
+};
+
+typedef void (*handler_fn_t)(unsigned int, void *);
+
+void interrupts_init(void);
+void interrupts_global_enable(void);
+void interrupts_global_disable(void);
+bool interrupts_enable_source(unsigned int source);
+handler_fn_t interrupts_register_handler(unsigned int source, handler_fn_t fn, void *aux_data);
+
+#endif
@@ -0,0 +1,8 @@
+// Host stand-in for libpi's `malloc.h`: the C library's allocator does the same job
+
+#ifndef MALLOC_H
+#define MALLOC_H
+
+#include <stdlib.h>
+
+#endif
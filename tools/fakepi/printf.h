@@ -0,0 +1,8 @@
+// Host stand-in for libpi's `printf.h`: the C library's printf does the same job
+
+#ifndef PRINTF_H
+#define PRINTF_H
+
+#include <stdio.h>
+
+#endif
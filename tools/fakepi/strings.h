@@ -0,0 +1,9 @@
+// Host stand-in for libpi's `strings.h`: the C library's string functions do the same job
+// (only reached through "strings.h" with -iquote, so it never hides the C library's own)
+
+#ifndef STRINGS_H
+#define STRINGS_H
+
+#include <string.h>
+
+#endif
@@ -0,0 +1,10 @@
+// Host stand-in for libpi's `timer.h`, for the simulations in `tools/` that link board code
+// The simulation defines `timer_get_ticks` on its own clock
+
+#ifndef TIMER_H
+#define TIMER_H
+
+void timer_init(void);
+unsigned int timer_get_ticks(void);
+
+#endif
@@ -0,0 +1,11 @@
+// Host stand-in for libpi's `uart.h`, for the simulations in `tools/` that link board code
+
+#ifndef UART_H
+#define UART_H
+
+#define EOT 4
+
+void uart_init(void);
+int uart_putchar(int ch);
+
+#endif
@@ -0,0 +1,508 @@
+// Host-side simulation of several motor boards sharing one NAJ bus (see `motors/najframe.h`)
+//
+// Usage: ./fleetsim [--check]
+// Runs the shipped frame and addressing code - the frame builder, encoder and parser, enumeration
+// (`naj_enum_run` on the host, `naj_addr_handle` on each board) and the controller's per-board queue
+// (see `controller/motorq.h`) - against simulated boards on a simulated daisy chain and bus
+//
+// First enumerates:
+//     - chains of 1 to 8 boards, each taking a random time (up to the settle time) to handle a frame
+//     - a chain whose end is not wired back to the host, and one with a dead board in the middle,
+//       both of which must run every address into the NAJ_ENUM_SETTLE_US timeout and fall back to one board
+// checking every board's address and the board count announced to the boards and to a visualizer
+// listening to every frame
+// Then plays a generated stream of dense chords through the live voice allocator (see
+// `controller/voices.h`) with 1, 2, 4 and 8 boards, clocking every frame over the bus a byte at a
+// time into every board's parser, and after each chord checks that each board's voices and the
+// visualizer's pool match the controller's motors
+// and that each new note went to a motor playing no more notes than any other
+// Also checks that the notes of one chord, queued with one deadline as `midi.c` does in file mode,
+// share a single NOTES_AT header in each board's frame, and that after releasing a note alone on its
+// motor and one time-sharing a motor, in either order, the next note goes to the motor left idle
+// Reports how the notes spread over the boards, how busy the bus is, and the latency from each chord
+// to the end of the frame carrying each note, per board
+// With --check, also exits non-zero if any board's worst latency is over MAX_LATENCY_US, or if the
+// notes are not spread evenly over the boards
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../motors/najframe.h"
+#include "../motors/najtx.h"
+#include "../controller/voices.h"
+#include "../controller/motorq.h"
+
+// Bus timing: a byte takes two NAJ_DELAY ticks of the writer, clock low then high (see `najtx.h`)
+#define BYTE_US (2 * NAJ_DELAY)
+
+// Controller settings (MOTOR_NUM in controller.c)
+#define VOICES_PER_BOARD 16
+
+// Workload: a chord every CHORD_US, each released when the next one starts, and a snapshot now and then
+#define CHORDS 2000
+#define CHORD_US 40000
+#define MIN_CHORD 4
+#define MAX_CHORD 24
+#define SNAPSHOT_EVERY 100
+
+#define MAX_LATENCY_US 5000
+
+// Frames a board has received but not yet handled
+#define BOARD_QUEUE 64
+
+struct board_t {
+    struct naj_parser_t parser;
+    struct naj_addr_t addr;
+    unsigned int dead;            // Never powered: handles nothing and never raises ENUM_OUT
+    unsigned int latency;         // How long after a frame arrives the board gets round to it
+    unsigned int chain_out;       // Level of ENUM_OUT
+    unsigned int chain_out_time;  // When it was raised
+    struct naj_frame_t queue[BOARD_QUEUE];
+    unsigned int due[BOARD_QUEUE];
+    unsigned int queue_head;
+    unsigned int queue_count;
+    unsigned char keys[NAJ_MAX_VOICES]; // Key of each of the board's voices
+
+    // Playback statistics, by the board's address
+    unsigned int notes;
+    unsigned int frames;
+    unsigned int latency_total;
+    unsigned int latency_max;
+};
+
+static struct board_t boards[NAJ_MAX_BOARDS];
+static unsigned int chain_length;   // Boards on the chain, in chain order
+static unsigned int chain_wired;    // End of the chain connected back to the host
+static unsigned int host_chain_out;
+
+// The visualizer: follows every frame and keeps the whole pool
+static struct naj_parser_t viz_parser;
+static struct naj_addr_t viz_addr;
+static unsigned char viz_keys[NAJ_MAX_VOICES * NAJ_MAX_BOARDS];
+
+static unsigned int now;            // Simulated time, in microseconds
+static unsigned int bus_time;       // When the bus is next free
+static unsigned int bus_busy;
+static unsigned char tx_seq;
+static unsigned int chord_time;     // Time of the chord whose updates are being sent
+static int failures;
+
+static void expect(int ok, const char *what) {
+    if (!ok && failures++ < 20) printf("FAIL: %s\n", what);
+}
+
+// Whether a board's ENUM_IN had risen by `time`, as `naj.c` tells from the edge's timestamp
+static unsigned int chain_in(unsigned int position, unsigned int time) {
+    if (!chain_wired) return 0;
+    if (position == 0) return host_chain_out;
+    return boards[position - 1].chain_out && (int)(time - boards[position - 1].chain_out_time) >= 0;
+}
+
+static void apply_notes(unsigned char *keys, unsigned int size, unsigned int board, unsigned int pool_boards,
+                        const struct naj_frame_t *frame) {
+    // `keys` holds one board's voices when `pool_boards` is 0, or else the whole pool
+    unsigned int pos = 0;
+    struct naj_cmd_t cmd;
+    while (naj_frame_next(frame, &pos, &cmd)) {
+        unsigned int first = 0, step = 2;
+        if (cmd.type == NAJ_CMD_NOTES_AT) first = 4;
+        else if (cmd.type == NAJ_CMD_SNAPSHOT) step = 1;
+        else if (cmd.type != NAJ_CMD_NOTES) continue;
+
+        for (unsigned int i = first; i + step <= cmd.nargs; i += step) {
+            unsigned int voice = (step == 1) ? i : cmd.args[i];
+            unsigned char key = cmd.args[i + step - 1];
+            unsigned int index = pool_boards ? naj_pool_motor(board, voice, pool_boards) : voice;
+            if (index < size) keys[index] = key;
+        }
+    }
+}
+
+static void board_handle(unsigned int position, const struct naj_frame_t *frame) {
+    // As `naj_read_frame` and the motor board's main loop do
+    struct board_t *board = &boards[position];
+    if (!naj_addr_accepts(&board->addr, frame->addr)) return;
+
+    if (naj_addr_handle(&board->addr, frame, chain_in(position, frame->time))) {
+        board->chain_out = 1;
+        board->chain_out_time = now;
+    }
+    apply_notes(board->keys, NAJ_MAX_VOICES, 0, 0, frame);
+}
+
+// Handle every queued frame that is due by `now`, across the boards in time order
+static void run_boards(void) {
+    while (1) {
+        int next = -1;
+        for (unsigned int i = 0; i < chain_length; i++) {
+            struct board_t *board = &boards[i];
+            if (board->queue_count == 0 || (int)(board->due[board->queue_head] - now) > 0) continue;
+            if (next < 0 || (int)(board->due[board->queue_head] - boards[next].due[boards[next].queue_head]) < 0) next = i;
+        }
+        if (next < 0) return;
+
+        struct board_t *board = &boards[next];
+        board_handle(next, &board->queue[board->queue_head]);
+        board->queue_head = (board->queue_head + 1) % BOARD_QUEUE;
+        board->queue_count--;
+    }
+}
+
+static void board_receive(unsigned int position, unsigned char data, unsigned int time) {
+    struct board_t *board = &boards[position];
+    if (board->dead) return;
+
+    struct naj_frame_t frame;
+    naj_parser_push(&board->parser, data, time);
+    while (naj_parser_frame(&board->parser, &frame)) {
+        if (board->queue_count == BOARD_QUEUE) {
+            expect(0, "board queue overflow");
+            return;
+        }
+        unsigned int slot = (board->queue_head + board->queue_count++) % BOARD_QUEUE;
+        board->queue[slot] = frame;
+        board->due[slot] = time + board->latency;
+
+        // Playback statistics, for the note frames this board takes
+        if (naj_addr_accepts(&board->addr, frame.addr) && frame.addr != NAJ_ADDR_ALL) {
+            struct board_t *stats = &boards[board->addr.address];
+            unsigned int notes = 0, pos = 0;
+            struct naj_cmd_t cmd;
+            while (naj_frame_next(&frame, &pos, &cmd)) {
+                if (cmd.type == NAJ_CMD_NOTES) notes += cmd.nargs / 2;
+            }
+            if (notes == 0) continue;
+
+            unsigned int latency = time - chord_time;
+            stats->frames++;
+            stats->notes += notes;
+            stats->latency_total += latency * notes;
+            if (latency > stats->latency_max) stats->latency_max = latency;
+        }
+    }
+}
+
+static void viz_receive(unsigned char data, unsigned int time) {
+    struct naj_frame_t frame;
+    naj_parser_push(&viz_parser, data, time);
+    while (naj_parser_frame(&viz_parser, &frame)) {
+        if (!naj_addr_accepts(&viz_addr, frame.addr)) continue;
+        naj_addr_handle(&viz_addr, &frame, 0);
+
+        // As graphics.c maps a board's voices back to the pool
+        unsigned int pool_boards = viz_addr.boards;
+        unsigned int board = (frame.addr < pool_boards) ? frame.addr : 0;
+        apply_notes(viz_keys, sizeof(viz_keys), board, pool_boards, &frame);
+    }
+}
+
+// Clock a frame out over the bus, behind whatever is already on it, as `naj_frame_send` queues it
+static void bus_send(struct naj_frame_t *frame, void *aux) {
+    frame->seq = tx_seq++;
+    unsigned char bytes[NAJ_MAX_FRAME];
+    unsigned int n = naj_frame_encode(frame, bytes);
+
+    if ((int)(bus_time - now) < 0) bus_time = now;
+    for (unsigned int i = 0; i < n; i++) {
+        bus_time += BYTE_US;
+        for (unsigned int position = 0; position < chain_length; position++) {
+            board_receive(position, bytes[i], bus_time);
+        }
+        viz_receive(bytes[i], bus_time);
+    }
+    bus_busy += n * BYTE_US;
+}
+
+// Enumeration's hardware: sending waits for the frame to go out, and every look at the clock or
+// the end of the chain lets the boards catch up to the present
+static void enum_send(struct naj_frame_t *frame, void *aux) {
+    bus_send(frame, aux);
+    now = bus_time;
+    run_boards();
+}
+
+static int enum_chain_end(void *aux) {
+    run_boards();
+    if (!chain_wired) return 0;
+    return chain_length ? boards[chain_length - 1].chain_out : host_chain_out;
+}
+
+static unsigned int enum_ticks(void *aux) {
+    now++;
+    run_boards();
+    return now;
+}
+
+// Power up `length` boards (`dead` is the position of one that never starts, or -1) taking up to
+// `max_latency` to handle a frame, and enumerate them; returns the board count the host found
+static unsigned int enumerate(unsigned int length, int wired, int dead, unsigned int max_latency) {
+    chain_length = length;
+    chain_wired = wired;
+    host_chain_out = 0;
+    for (unsigned int i = 0; i < NAJ_MAX_BOARDS; i++) {
+        struct board_t *board = &boards[i];
+        memset(board, 0, sizeof(*board));
+        naj_parser_init(&board->parser);
+        naj_addr_init(&board->addr);
+        board->dead = ((int) i == dead);
+        board->latency = max_latency ? rand() % (max_latency + 1) : 0;
+        memset(board->keys, NAJ_NOTE_OFF, sizeof(board->keys));
+    }
+    naj_parser_init(&viz_parser);
+    naj_addr_init(&viz_addr);
+    viz_addr.listen_all = 1;
+    memset(viz_keys, NAJ_NOTE_OFF, sizeof(viz_keys));
+    now = 0;
+    bus_time = 0;
+    bus_busy = 0;
+
+    // As `naj_enumerate` does: raise the start of the chain and run the host's side
+    host_chain_out = 1;
+    struct naj_enum_io_t io = { enum_send, enum_chain_end, enum_ticks, NULL };
+    unsigned int count = naj_enum_run(&io);
+
+    // Let the slowest board handle the BOARDS frame
+    now += max_latency + 1;
+    run_boards();
+    return count;
+}
+
+static void check_enumeration(void) {
+    char what[96];
+
+    // Whole chains: every board gets its position as its address, and everyone hears the count
+    for (unsigned int length = 1; length <= NAJ_MAX_BOARDS; length++) {
+        unsigned int count = enumerate(length, 1, -1, NAJ_ENUM_SETTLE_US - 1);
+        printf("enumerate %u board(s): found %u in %5u us\n", length, count, now);
+
+        snprintf(what, sizeof(what), "chain of %u: host found %u boards", length, count);
+        expect(count == length, what);
+        for (unsigned int i = 0; i < length; i++) {
+            snprintf(what, sizeof(what), "chain of %u: board %u has address %u", length, i, boards[i].addr.address);
+            expect(boards[i].addr.enumerated && boards[i].addr.address == i, what);
+            snprintf(what, sizeof(what), "chain of %u: board %u was told %u boards", length, i, boards[i].addr.boards);
+            expect(boards[i].addr.boards == length, what);
+        }
+        snprintf(what, sizeof(what), "chain of %u: visualizer was told %u boards", length, viz_addr.boards);
+        expect(viz_addr.boards == length && !viz_addr.enumerated, what);
+    }
+
+    // Chain not wired back: every offer runs into the timeout, and the host assumes one board
+    unsigned int count = enumerate(1, 0, -1, 100);
+    printf("enumerate 1 board, chain not wired: found %u in %5u us\n", count, now);
+    expect(count == 1 && boards[0].addr.address == 0 && boards[0].addr.boards == 1, "unwired chain: not one board at address 0");
+    expect(now >= NAJ_MAX_BOARDS * NAJ_ENUM_SETTLE_US, "unwired chain: did not wait out the timeout for every address");
+
+    // Dead board in the middle: the boards before it claim addresses, the end of the chain never
+    // comes back, and the host falls back to one board
+    count = enumerate(4, 1, 2, 100);
+    printf("enumerate 4 boards, board 2 dead: found %u in %5u us\n", count, now);
+    expect(count == 1, "dead board: host did not fall back to one board");
+    expect(boards[0].addr.address == 0 && boards[1].addr.address == 1 && !boards[3].addr.enumerated,
+           "dead board: wrong addresses either side of it");
+    expect(now >= NAJ_MAX_BOARDS * NAJ_ENUM_SETTLE_US, "dead board: did not wait out the timeout for every address");
+}
+
+// Frames captured instead of sent
+static struct naj_frame_t captured[NAJ_MAX_BOARDS * 2];
+static unsigned int captured_count;
+
+static void capture(struct naj_frame_t *frame, void *aux) {
+    if (captured_count < sizeof(captured) / sizeof(captured[0])) captured[captured_count] = *frame;
+    captured_count++;
+}
+
+static void check_chord_deadline(void) {
+    // A chord of 12 notes over 4 boards, all at one deadline, as `midi_update_motors_at` queues it
+    struct motorq_t queue;
+    motorq_init(&queue, 4, capture, NULL);
+    captured_count = 0;
+
+    unsigned int deadline = 123456789;
+    for (unsigned int motor = 0; motor < 12; motor++) {
+        motorq_note_at(&queue, motor, 40 + motor, deadline);
+    }
+    motorq_flush(&queue);
+
+    expect(captured_count == 4, "chord: not one frame per board");
+    for (unsigned int i = 0; i < captured_count && i < 4; i++) {
+        unsigned int pos = 0, headers = 0;
+        struct naj_cmd_t cmd;
+        while (naj_frame_next(&captured[i], &pos, &cmd)) {
+            headers++;
+            expect(cmd.type == NAJ_CMD_NOTES_AT && cmd.nargs == 4 + 3 * 2 && naj_read_u32(cmd.args) == deadline,
+                   "chord: wrong NOTES_AT command");
+        }
+        expect(headers == 1, "chord: notes of one chord split over several NOTES_AT headers");
+    }
+}
+
+// Physical motor of pool voice `m`, numbered across the boards, as the boards map their voices
+static unsigned int physical_motor(unsigned int m, unsigned int boards) {
+    return naj_pool_board(m, boards) * NAJ_MOTORS + naj_pool_voice(m, boards) % NAJ_MOTORS;
+}
+
+// Notes sounding on each physical motor
+static void motor_notes(const struct voices_t *voices, unsigned int pool, unsigned int boards, unsigned int *notes) {
+    memset(notes, 0, NAJ_MAX_BOARDS * NAJ_MOTORS * sizeof(notes[0]));
+    for (unsigned int v = 0; v < pool; v++) {
+        if (voices->voice_key[v] != VOICES_NONE) notes[physical_motor(v, boards)]++;
+    }
+}
+
+// Hold one note more than there are motors, so one motor plays two, then release a note alone on
+// its motor and one of the two sharing - in either order - and press a new one
+// The new note must go to the motor left idle, not back to the one still playing
+static void check_shared_release(unsigned int boards, int shared_first) {
+    unsigned int pool = VOICES_PER_BOARD * boards, motors = NAJ_MOTORS * boards;
+    struct voices_t voices;
+    voices_init(&voices, pool, motors, VOICES_STEAL_OLDEST);
+
+    unsigned char voice_of[NAJ_MAX_BOARDS * NAJ_MOTORS + 1];
+    unsigned char stolen;
+    for (unsigned int i = 0; i <= motors; i++) voice_of[i] = voices_note_on(&voices, 20 + i, 100, &stolen);
+
+    // The last note shares a motor with an earlier one; the note before it is alone on its motor
+    unsigned int shared = motors, partner = motors, alone = motors - 1;
+    for (unsigned int i = 0; i < motors; i++) {
+        if (physical_motor(voice_of[i], boards) == physical_motor(voice_of[shared], boards)) partner = i;
+    }
+    char what[160];
+    snprintf(what, sizeof(what), "%u board(s): %u notes did not fill every motor before sharing one", boards, motors + 1);
+    expect(partner < motors && partner != alone, what);
+
+    unsigned int first = shared_first ? alone : shared, second = shared_first ? shared : alone;
+    voices_note_off(&voices, 20 + first);
+    voices_note_off(&voices, 20 + second);
+    unsigned char voice = voices_note_on(&voices, 100, 100, &stolen);
+
+    snprintf(what, sizeof(what), "%u board(s), released %s first: new note went to a busy motor", boards,
+             shared_first ? "the lone voice" : "the shared voice");
+    expect(voice != VOICES_NONE && physical_motor(voice, boards) == physical_motor(voice_of[alone], boards), what);
+}
+
+static int play(unsigned int board_count, int check) {
+    unsigned int count = enumerate(board_count, 1, -1, 100);
+    expect(count == board_count, "playback: enumeration");
+
+    struct voices_t voices;
+    unsigned int pool = VOICES_PER_BOARD * count;
+    voices_init(&voices, pool, NAJ_MOTORS * count, VOICES_STEAL_OLDEST);
+
+    struct motorq_t queue;
+    motorq_init(&queue, count, bus_send, NULL);
+
+    unsigned char motors[VOICES_MAX];
+    memset(motors, NAJ_NOTE_OFF, sizeof(motors));
+
+    unsigned char held[MAX_CHORD];
+    unsigned int held_count = 0;
+    unsigned int max_sharing = 0;
+    unsigned int mismatches = 0;
+    unsigned int unbalanced = 0;
+    unsigned int start = now;
+
+    srand(2024);
+    for (unsigned int chord = 0; chord < CHORDS; chord++) {
+        now = start + chord * CHORD_US;
+        chord_time = now;
+
+        for (unsigned int i = 0; i < held_count; i++) {
+            unsigned char voice = voices_note_off(&voices, held[i]);
+            if (voice == VOICES_NONE) continue;
+            motors[voice] = NAJ_NOTE_OFF;
+            motorq_note(&queue, voice, NAJ_NOTE_OFF);
+        }
+        held_count = 0;
+
+        unsigned int size = MIN_CHORD + rand() % (MAX_CHORD - MIN_CHORD + 1);
+        unsigned int root = 30 + rand() % 40;
+        for (unsigned int i = 0; i < size; i++) {
+            unsigned char key = root + 2 * i + rand() % 2;
+            unsigned int notes[NAJ_MAX_BOARDS * NAJ_MOTORS];
+            motor_notes(&voices, pool, count, notes);
+            unsigned int fewest = ~0u;
+            for (unsigned int m = 0; m < NAJ_MOTORS * count; m++) {
+                if (notes[m] < fewest) fewest = notes[m];
+            }
+
+            int sounding = voices.key_to_voice[key] != VOICES_NONE;
+            unsigned char stolen;
+            unsigned char voice = voices_note_on(&voices, key, 100, &stolen);
+            if (voice == VOICES_NONE) continue;
+            if (!sounding && stolen == VOICES_NONE && notes[physical_motor(voice, count)] != fewest) unbalanced++;
+            motors[voice] = key;
+            motorq_note(&queue, voice, key);
+            held[held_count++] = key;
+        }
+
+        // Voices sharing the busiest physical motor (a board's voice l plays on its motor l % NAJ_MOTORS)
+        unsigned int sharing[NAJ_MAX_BOARDS][NAJ_MOTORS] = {{0}};
+        for (unsigned int v = 0; v < pool; v++) {
+            if (voices.voice_key[v] == VOICES_NONE) continue;
+            unsigned int n = ++sharing[naj_pool_board(v, count)][naj_pool_voice(v, count) % NAJ_MOTORS];
+            if (n > max_sharing) max_sharing = n;
+        }
+
+        motorq_flush(&queue);
+        if (chord % SNAPSHOT_EVERY == SNAPSHOT_EVERY - 1) motorq_snapshot(&queue, motors, pool);
+
+        // Once the bus has drained, every board and the visualizer must agree with the controller
+        now = bus_time + 101;
+        run_boards();
+        for (unsigned int m = 0; m < pool; m++) {
+            struct board_t *board = &boards[naj_pool_board(m, count)];
+            if (board->keys[naj_pool_voice(m, count)] != motors[m] || viz_keys[m] != motors[m]) mismatches++;
+        }
+    }
+
+    unsigned int total = 0, least = ~0u, most = 0, worst = 0;
+    for (unsigned int board = 0; board < count; board++) {
+        total += boards[board].notes;
+        if (boards[board].notes < least) least = boards[board].notes;
+        if (boards[board].notes > most) most = boards[board].notes;
+        if (boards[board].latency_max > worst) worst = boards[board].latency_max;
+        expect(boards[board].parser.crc_errors == 0 && boards[board].parser.lost_frames == 0, "playback: frames lost");
+    }
+
+    printf("%u board(s), %u voices: %u updates, %u steals, %u drops, bus busy %.1f%%, "
+           "%.0f updates/s, at most %u voices on one motor\n",
+           count, pool, total, voices.steals, voices.drops, 100.0 * bus_busy / (CHORDS * CHORD_US),
+           total * 1e6 / (CHORDS * CHORD_US), max_sharing);
+    for (unsigned int board = 0; board < count; board++) {
+        printf("    board %u: %6u updates in %5u frames, latency mean %5u us max %5u us\n", board,
+               boards[board].notes, boards[board].frames,
+               boards[board].notes ? boards[board].latency_total / boards[board].notes : 0, boards[board].latency_max);
+    }
+
+    char what[96];
+    snprintf(what, sizeof(what), "%u board(s): %u voice states differ from the controller's", count, mismatches);
+    expect(mismatches == 0, what);
+    snprintf(what, sizeof(what), "%u board(s): %u notes went to a motor playing more than another", count, unbalanced);
+    expect(unbalanced == 0, what);
+
+    if (!check) return 0;
+    int ok = worst <= MAX_LATENCY_US && most <= 2 * least;
+    if (!ok) printf("FAIL: worst latency %u us, board updates %u to %u\n", worst, least, most);
+    return !ok;
+}
+
+int main(int argc, char *argv[]) {
+    int check = (argc > 1 && strcmp(argv[1], "--check") == 0);
+    int failed = 0;
+
+    srand(20);
+    check_enumeration();
+    check_chord_deadline();
+    for (unsigned int board_count = 1; board_count <= 2; board_count++) {
+        check_shared_release(board_count, 0);
+        check_shared_release(board_count, 1);
+    }
+    for (unsigned int board_count = 1; board_count <= NAJ_MAX_BOARDS; board_count *= 2) {
+        failed |= play(board_count, check);
+    }
+
+    printf(failures ? "%d failures\n" : "all passed\n", failures);
+    return failed || failures;
+}
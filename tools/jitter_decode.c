@@ -0,0 +1,113 @@
+// Host-side decoder for the step jitter statistics printed by the motor board
+// (see `motors/jitter.h` for the format)
+//
+// Usage: capture the motor board's UART output to a file, then run
+//     ./jitter_decode < capture.txt
+// Every JITTER block found in the input is summarized with per-motor percentiles
+
+#include <stdio.h>
+#include <string.h>
+
+// Must match `motors/jitter.h`
+#define JITTER_BUCKETS 16
+#define JITTER_MAX_MOTORS 8
+
+struct motor_stats_t {
+    unsigned long count;
+    unsigned long max;
+    unsigned long missed;
+    unsigned long buckets[JITTER_BUCKETS];
+    unsigned long switches;
+    unsigned long switch_max;
+};
+
+// Upper bound (in microseconds) of the lateness counted in a bucket
+static unsigned long bucket_limit(int bucket) {
+    return (bucket == 0) ? 0 : (1UL << bucket) - 1;
+}
+
+// Smallest bucket limit that covers at least `pct` percent of the recorded steps
+// Bucketing only gives an upper bound, which is capped by the exact maximum
+static unsigned long percentile(const struct motor_stats_t *s, double pct) {
+    double target = s->count * pct / 100.0;
+    unsigned long seen = 0;
+
+    for (int b = 0; b < JITTER_BUCKETS; b++) {
+        seen += s->buckets[b];
+        if (seen >= target) {
+            unsigned long limit = bucket_limit(b);
+            return (b == JITTER_BUCKETS - 1 || limit > s->max) ? s->max : limit;
+        }
+    }
+    return s->max;
+}
+
+static void print_summary(int dump, const struct motor_stats_t *stats, int nmotors) {
+    printf("dump %d\n", dump);
+    printf("motor      count    p50    p90    p99  p99.9    max  missed  switches  switch_max   (lateness in us)\n");
+    for (int m = 0; m < nmotors; m++) {
+        const struct motor_stats_t *s = &stats[m];
+        if (s->count == 0) {
+            printf("%5d %10lu      -      -      -      -      - %7lu %9lu           -\n", m, s->count, s->missed, s->switches);
+            continue;
+        }
+        printf("%5d %10lu %6lu %6lu %6lu %6lu %6lu %7lu %9lu %11lu\n", m, s->count,
+               percentile(s, 50), percentile(s, 90), percentile(s, 99), percentile(s, 99.9),
+               s->max, s->missed, s->switches, s->switch_max);
+    }
+    printf("\n");
+}
+
+static int parse_motor_line(const char *line, struct motor_stats_t *stats) {
+    int motor, offset;
+    struct motor_stats_t s;
+
+    if (sscanf(line, "motor %d count %lu max %lu missed %lu buckets%n",
+               &motor, &s.count, &s.max, &s.missed, &offset) != 4) return -1;
+    if (motor < 0 || motor >= JITTER_MAX_MOTORS) return -1;
+
+    const char *p = line + offset;
+    for (int b = 0; b < JITTER_BUCKETS; b++) {
+        int used;
+        if (sscanf(p, " %lu%n", &s.buckets[b], &used) != 1) return -1;
+        p += used;
+    }
+
+    // Older firmware does not report pitch switches
+    if (sscanf(p, " switches %lu switch_max %lu", &s.switches, &s.switch_max) != 2) {
+        s.switches = 0;
+        s.switch_max = 0;
+    }
+
+    stats[motor] = s;
+    return motor;
+}
+
+int main(void) {
+    char line[512];
+    struct motor_stats_t stats[JITTER_MAX_MOTORS];
+    int in_block = 0;
+    int nmotors = 0;
+    int dumps = 0;
+
+    while (fgets(line, sizeof(line), stdin)) {
+        // The dump is interleaved with other console output, so only look at our own lines
+        if (strncmp(line, "JITTER BEGIN", 12) == 0) {
+            memset(stats, 0, sizeof(stats));
+            in_block = 1;
+            nmotors = 0;
+        } else if (in_block && strncmp(line, "JITTER END", 10) == 0) {
+            print_summary(dumps++, stats, nmotors);
+            in_block = 0;
+        } else if (in_block) {
+            int motor = parse_motor_line(line, stats);
+            if (motor >= nmotors) nmotors = motor + 1;
+        }
+    }
+
+    if (dumps == 0) {
+        fprintf(stderr, "jitter_decode: no JITTER BEGIN/END block found in input\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+// Host-side test for the streaming MIDI parser (see `controller/midiparse.h`)
+//
+// Usage: ./midiparsetest
+// Feeds byte streams through `midi_parser_feed` and checks the events that come out:
+//     - running status across note on, note on with velocity 0 and note off
+//     - realtime bytes (0xF8 clock, 0xFE active sensing) in the middle of a message, which must come
+//       out on their own without disturbing it
+//     - SysEx with its 0xF7 terminator, without one (cut short by the next status byte), too long to
+//       collect, and with realtime bytes inside
+//     - 2-byte messages (program change, channel pressure), with running status
+//     - system common messages, which cancel running status
+//     - stray data bytes at startup, before any status byte
+// then feeds random bytes, checking that every event is well formed, and that taking the realtime
+// bytes out of the stream leaves the other events unchanged
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../controller/midiparse.h"
+
+#define FUZZ_BYTES 1000000
+#define MAX_EVENTS 64
+
+static struct midi_parser_t parser;
+static struct midi_event_t events[MAX_EVENTS];
+static unsigned int count;
+static int failures;
+
+static void expect(int ok, const char *what) {
+    if (!ok && failures++ < 20) printf("FAIL: %s\n", what);
+}
+
+// Reset the parser and feed it `n` bytes, collecting the events
+static void feed(const unsigned char *bytes, unsigned int n) {
+    midi_parser_init(&parser);
+    count = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        struct midi_event_t event;
+        if (midi_parser_feed(&parser, bytes[i], &event) && count < MAX_EVENTS) events[count++] = event;
+    }
+}
+
+static int is_event(unsigned int i, unsigned char action, unsigned char channel, unsigned char key, unsigned char velocity) {
+    return i < count && events[i].action == action && events[i].channel == channel &&
+           events[i].key == key && events[i].velocity == velocity;
+}
+
+static void check_running_status(void) {
+    const unsigned char bytes[] = {
+        0x90, 0x3C, 0x64, 0x40, 0x64, 0x3C, 0x00, // Note on, then two more under running status
+        0x81, 0x40, 0x20, 0x43, 0x20,             // Note off on channel 1, then another
+    };
+    feed(bytes, sizeof(bytes));
+    expect(count == 5, "running status: wrong number of events");
+    expect(is_event(0, MIDI_NOTE_ON, 0, 0x3C, 0x64) && is_event(1, MIDI_NOTE_ON, 0, 0x40, 0x64) &&
+           is_event(2, MIDI_NOTE_ON, 0, 0x3C, 0x00), "running status: note on events");
+    expect(is_event(3, MIDI_NOTE_OFF, 1, 0x40, 0x20) && is_event(4, MIDI_NOTE_OFF, 1, 0x43, 0x20), "running status: note off events");
+}
+
+static void check_realtime(void) {
+    const unsigned char bytes[] = {
+        0x92, 0x3C, 0xF8, 0x64, // Clock between the two data bytes
+        0xFE, 0x3E, 0xF8, 0x50, // Active sensing before a running status message, clock inside it
+    };
+    feed(bytes, sizeof(bytes));
+    expect(count == 5, "realtime: wrong number of events");
+    expect(is_event(0, MIDI_SYSTEM, 0x8, 0, 0) && is_event(1, MIDI_NOTE_ON, 2, 0x3C, 0x64), "realtime: clock inside a message");
+    expect(is_event(2, MIDI_SYSTEM, 0xE, 0, 0) && is_event(3, MIDI_SYSTEM, 0x8, 0, 0) && is_event(4, MIDI_NOTE_ON, 2, 0x3E, 0x50),
+           "realtime: running status disturbed");
+}
+
+static void check_sysex(void) {
+    // Terminated, with a clock inside; the running status from before is cancelled by it
+    const unsigned char terminated[] = {0x90, 0xF0, 0x7E, 0x7F, 0xF8, 0x09, 0x01, 0xF7, 0x3C, 0x64};
+    feed(terminated, sizeof(terminated));
+    expect(count == 2 && is_event(0, MIDI_SYSTEM, 0x8, 0, 0), "SysEx: clock inside it not reported");
+    expect(is_event(1, MIDI_SYSTEM, MIDI_SYSEX & 0xF, 4, 0), "SysEx: not reported with its length");
+    expect(memcmp(parser.sysex, "\x7E\x7F\x09\x01", 4) == 0, "SysEx: payload");
+
+    // Cut short by a status byte: no SysEx event, but the message that cut it is parsed
+    const unsigned char unterminated[] = {0xF0, 0x01, 0x02, 0x03, 0x91, 0x3C, 0x64, 0x3D, 0x64};
+    feed(unterminated, sizeof(unterminated));
+    expect(count == 2 && is_event(0, MIDI_NOTE_ON, 1, 0x3C, 0x64) && is_event(1, MIDI_NOTE_ON, 1, 0x3D, 0x64),
+           "SysEx without terminator: following messages");
+
+    // A stray terminator is ignored
+    const unsigned char stray_end[] = {0xF7, 0x90, 0x3C, 0x64};
+    feed(stray_end, sizeof(stray_end));
+    expect(count == 1 && is_event(0, MIDI_NOTE_ON, 0, 0x3C, 0x64), "stray SysEx terminator");
+
+    // Too long to collect: skipped, without overrunning the buffer
+    unsigned char too_long[MIDI_SYSEX_MAX + 8];
+    too_long[0] = 0xF0;
+    for (unsigned int i = 1; i < sizeof(too_long) - 1; i++) too_long[i] = i & 0x7F;
+    too_long[sizeof(too_long) - 1] = 0xF7;
+    feed(too_long, sizeof(too_long));
+    expect(count == 0, "SysEx too long: reported");
+
+    // Exactly the longest collected
+    unsigned char longest[MIDI_SYSEX_MAX + 2];
+    longest[0] = 0xF0;
+    for (unsigned int i = 1; i <= MIDI_SYSEX_MAX; i++) longest[i] = i;
+    longest[MIDI_SYSEX_MAX + 1] = 0xF7;
+    feed(longest, sizeof(longest));
+    expect(count == 1 && is_event(0, MIDI_SYSTEM, 0, MIDI_SYSEX_MAX, 0) && parser.sysex[MIDI_SYSEX_MAX - 1] == MIDI_SYSEX_MAX,
+           "SysEx of MIDI_SYSEX_MAX bytes");
+}
+
+static void check_two_byte(void) {
+    const unsigned char bytes[] = {
+        0xC5, 0x10, 0x11,       // Program change, then another under running status
+        0xD3, 0x40, 0xF8, 0x41, // Channel pressure, and another with a clock before it
+    };
+    feed(bytes, sizeof(bytes));
+    expect(count == 5, "2-byte messages: wrong number of events");
+    expect(is_event(0, 0xC, 5, 0x10, 0) && is_event(1, 0xC, 5, 0x11, 0), "program change");
+    expect(is_event(2, 0xD, 3, 0x40, 0) && is_event(3, MIDI_SYSTEM, 0x8, 0, 0) && is_event(4, 0xD, 3, 0x41, 0), "channel pressure");
+}
+
+static void check_system_common(void) {
+    const unsigned char bytes[] = {
+        0x90, 0x3C, 0x64,
+        0xF2, 0x10, 0x20,       // Song position - cancels running status
+        0x3D, 0x64,             // so these are stray
+        0xF1, 0x05,             // MTC quarter frame
+        0xF6,                   // Tune request, no data
+        0x90, 0x3E, 0x64,
+    };
+    feed(bytes, sizeof(bytes));
+    expect(count == 5, "system common: wrong number of events");
+    expect(is_event(1, MIDI_SYSTEM, 0x2, 0x10, 0x20) && is_event(2, MIDI_SYSTEM, 0x1, 0x05, 0) && is_event(3, MIDI_SYSTEM, 0x6, 0, 0),
+           "system common events");
+    expect(is_event(4, MIDI_NOTE_ON, 0, 0x3E, 0x64), "message after system common");
+}
+
+static void check_startup(void) {
+    // Joined mid-stream: data bytes before any status byte are dropped
+    const unsigned char bytes[] = {0x3C, 0x64, 0x12, 0x90, 0x3C, 0x64};
+    feed(bytes, sizeof(bytes));
+    expect(count == 1 && is_event(0, MIDI_NOTE_ON, 0, 0x3C, 0x64), "stray data bytes at startup");
+}
+
+// Returns 1 if `event` is something the parser may produce
+static int well_formed(const struct midi_event_t *event, const struct midi_parser_t *p) {
+    if (event->action < 0x8 || event->action > 0xF || event->channel > 0xF) return 0;
+    if (event->action != MIDI_SYSTEM) {
+        if (event->key > 0x7F || event->velocity > 0x7F) return 0;
+        return (event->action != 0xC && event->action != 0xD) || event->velocity == 0;
+    }
+
+    switch (event->channel) {
+    case 0x0:
+        // SysEx: the key is the length of a payload of data bytes
+        if (event->key > MIDI_SYSEX_MAX || event->velocity != 0) return 0;
+        for (unsigned int i = 0; i < event->key; i++) {
+            if (p->sysex[i] > 0x7F) return 0;
+        }
+        return 1;
+    case 0x1:
+    case 0x3:
+        return event->key <= 0x7F && event->velocity == 0;
+    case 0x2:
+        return event->key <= 0x7F && event->velocity <= 0x7F;
+    case 0x7:
+        return 0;
+    default:
+        return event->key == 0 && event->velocity == 0;
+    }
+}
+
+static unsigned char random_byte(void) {
+    // Mostly data bytes, as on the wire, with every kind of status byte now and then
+    int r = rand() % 16;
+    if (r < 10) return rand() & 0x7F;
+    if (r < 13) return 0x80 | (rand() & 0x7F);
+    if (r < 14) return 0xF0 | (rand() & 0x7);
+    return 0xF8 | (rand() & 0x7);
+}
+
+static void check_fuzz(void) {
+    static unsigned char bytes[FUZZ_BYTES];
+    for (unsigned int i = 0; i < FUZZ_BYTES; i++) bytes[i] = random_byte();
+
+    // Every event well formed, and the events other than realtime ones kept for the comparison
+    static struct midi_event_t with_realtime[FUZZ_BYTES];
+    unsigned int n = 0, bad = 0, total = 0;
+    struct midi_parser_t p;
+    midi_parser_init(&p);
+    for (unsigned int i = 0; i < FUZZ_BYTES; i++) {
+        struct midi_event_t event;
+        if (!midi_parser_feed(&p, bytes[i], &event)) continue;
+        total++;
+        if (!well_formed(&event, &p)) bad++;
+        if (bytes[i] < 0xF8) with_realtime[n++] = event;
+    }
+
+    // The same stream without its realtime bytes must give the same events
+    unsigned int m = 0, differ = 0;
+    midi_parser_init(&p);
+    for (unsigned int i = 0; i < FUZZ_BYTES; i++) {
+        struct midi_event_t event;
+        if (bytes[i] >= 0xF8 || !midi_parser_feed(&p, bytes[i], &event)) continue;
+        if (m >= n || memcmp(&event, &with_realtime[m], sizeof(event)) != 0) differ++;
+        m++;
+    }
+
+    printf("fuzz: %u bytes, %u events, %u malformed, %u changed by realtime bytes\n", FUZZ_BYTES, total, bad, differ);
+    expect(bad == 0, "fuzz: malformed events");
+    expect(differ == 0 && m == n, "fuzz: realtime bytes changed the other events");
+}
+
+int main(void) {
+    srand(107);
+    check_running_status();
+    check_realtime();
+    check_sysex();
+    check_two_byte();
+    check_system_common();
+    check_startup();
+    check_fuzz();
+
+    printf(failures ? "%d failures\n" : "all passed\n", failures);
+    return failures != 0;
+}
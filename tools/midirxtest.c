@@ -0,0 +1,212 @@
+// Host-side test for the bit-banged MIDI receiver (see `controller/midirx.h`)
+//
+// Usage: ./midirxtest
+// Replays edge timings through `midirx_edge` - each edge stamped late, as the GPIO interrupt in
+// `midi.c` stamps it, by up to a whole NAJ transmit interrupt - while calling `midirx_poll` between
+// edges the way the main loop does, and checks the bytes that come out
+// The fixed cases are edge lists written out from the bit timings of known bytes:
+//     - back-to-back 3-byte messages (note on, note off) with no idle time between bytes
+//     - a stop bit followed directly by a start bit, after bytes with no edge of their own at the
+//       end (0xFF, 0x7F), so the next start bit is the only edge that ends the frame
+//     - a byte ending in 1-bits with nothing after it, which only `midirx_poll` can complete: not
+//       before the middle of its stop bit, and on the first poll after that
+//     - a break (the line held low), which must be counted as an error and not stop the next byte
+// then a long stream of random bytes with random gaps, latencies and poll times must come through
+// unchanged
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../controller/midirx.h"
+
+#define POLL_US 40          // Main loop poll interval in the fixed cases
+#define FUZZ_BYTES 100000
+
+// Most an edge may be stamped late by in the fuzz: the rest of a NAJ transmit interrupt that had
+// already checked for a waiting edge when it came (see `naj_set_tx_hook`), then the edge interrupt's
+// own entry - estimates for the controller, caches off, with the dispatch
+#define TX_ISR_US 10
+#define EDGE_IRQ_US 2
+#define FUZZ_LATENCY_US (TX_ISR_US + EDGE_IRQ_US)
+
+struct edge_t {
+    unsigned int time;
+    unsigned int level;
+};
+
+// Note on (0x90 0x3C 0x64) then note off (0x80 0x3C 0x00), back to back from tick 1000
+static const struct edge_t note_on_off[] = {
+    {1000, 0}, {1162, 1}, {1196, 0}, {1257, 1}, {1323, 0}, {1416, 1}, {1546, 0}, {1612, 1},
+    {1641, 0}, {1739, 1}, {1768, 0}, {1834, 1}, {1900, 0}, {1929, 1}, {1963, 0}, {2216, 1},
+    {2282, 0}, {2380, 1}, {2505, 0}, {2571, 1}, {2600, 0}, {2890, 1},
+};
+static const unsigned char note_on_off_bytes[] = {0x90, 0x3C, 0x64, 0x80, 0x3C, 0x00};
+
+// 0xFF 0x00 0xFF 0x7F back to back from tick 5000: each 0xFF has no edge after its first data bit
+static const struct edge_t stop_then_start[] = {
+    {5000, 0}, {5035, 1}, {5322, 0}, {5609, 1}, {5640, 0}, {5675, 1}, {5962, 0}, {5993, 1},
+    {6216, 0}, {6251, 1},
+};
+static const unsigned char stop_then_start_bytes[] = {0xFF, 0x00, 0xFF, 0x7F};
+
+// Active sensing (0xFE) on its own at tick 9000: seven 1-bits and the stop bit, with no edge after
+static const struct edge_t ends_high[] = {
+    {9002, 0}, {9066, 1},
+};
+static const unsigned char ends_high_bytes[] = {0xFE};
+
+// The line held low for 20 bit times from tick 12000, then 0x42 from tick 13000
+static const struct edge_t line_break[] = {
+    {12000, 0}, {12640, 1}, {13000, 0}, {13066, 1}, {13097, 0}, {13224, 1}, {13258, 0}, {13289, 1},
+};
+static const unsigned char line_break_bytes[] = {0x42};
+
+static int failures;
+
+static void expect(int ok, const char *what) {
+    if (!ok && failures++ < 20) printf("FAIL: %s\n", what);
+}
+
+// Bytes received, and the tick at which each came out
+static unsigned char received[FUZZ_BYTES + 16];
+static unsigned int received_at[FUZZ_BYTES + 16];
+static unsigned int count;
+
+static void poll_until(struct midirx_t *rx, unsigned int *next_poll, unsigned int until, unsigned int interval) {
+    unsigned char byte;
+    while ((int) (*next_poll - until) < 0) {
+        if (midirx_poll(rx, *next_poll, &byte)) {
+            received_at[count] = *next_poll;
+            received[count++] = byte;
+        }
+        *next_poll += interval;
+    }
+}
+
+// Replay `n` edges, polling every POLL_US from the first one until well after the last
+static void replay(struct midirx_t *rx, const struct edge_t *edges, unsigned int n) {
+    unsigned int next_poll = edges[0].time;
+    for (unsigned int i = 0; i < n; i++) {
+        poll_until(rx, &next_poll, edges[i].time, POLL_US);
+
+        unsigned char byte;
+        if (midirx_edge(rx, edges[i].time, edges[i].level, &byte)) {
+            received_at[count] = edges[i].time;
+            received[count++] = byte;
+        }
+    }
+    poll_until(rx, &next_poll, edges[n - 1].time + 20 * MIDIRX_BIT_US, POLL_US);
+}
+
+static void check_case(const char *name, const struct edge_t *edges, unsigned int n,
+                       const unsigned char *bytes, unsigned int expected) {
+    struct midirx_t rx;
+    midirx_init(&rx);
+    count = 0;
+    replay(&rx, edges, n);
+
+    int same = count == expected;
+    for (unsigned int i = 0; same && i < expected; i++) same = received[i] == bytes[i];
+
+    char what[96];
+    snprintf(what, sizeof(what), "%s: wrong bytes (%u of %u received)", name, count, expected);
+    expect(same, what);
+    snprintf(what, sizeof(what), "%s: framing errors", name);
+    expect(rx.errors == 0, what);
+}
+
+static void check_poll_timeout(void) {
+    // The byte may only come out once its stop bit is half over, and then on the first poll
+    unsigned int stop_middle = ends_high[0].time + MIDIRX_FRAME_BITS * MIDIRX_BIT_US - MIDIRX_BIT_US / 2;
+    struct midirx_t rx;
+    unsigned char byte;
+
+    midirx_init(&rx);
+    count = 0;
+    replay(&rx, ends_high, sizeof(ends_high) / sizeof(ends_high[0]));
+    expect(count == 1 && received_at[0] >= stop_middle && received_at[0] < stop_middle + POLL_US,
+           "poll timeout: byte not completed by the first poll after the middle of its stop bit");
+
+    midirx_init(&rx);
+    midirx_edge(&rx, ends_high[0].time, ends_high[0].level, &byte);
+    midirx_edge(&rx, ends_high[1].time, ends_high[1].level, &byte);
+    expect(!midirx_poll(&rx, stop_middle - 1, &byte), "poll timeout: byte completed before the middle of its stop bit");
+    expect(midirx_poll(&rx, stop_middle, &byte) && byte == 0xFE, "poll timeout: byte not completed at the middle of its stop bit");
+    expect(!midirx_poll(&rx, stop_middle + 100, &byte), "poll timeout: byte completed twice");
+
+    // A start bit straight after the stop bit must still begin the next byte if the poll came first
+    midirx_init(&rx);
+    midirx_edge(&rx, 0, 0, &byte);
+    midirx_edge(&rx, 32, 1, &byte);
+    expect(midirx_poll(&rx, 310, &byte) && byte == 0xFF, "poll before the next start bit: byte not completed");
+    expect(!midirx_edge(&rx, 320, 0, &byte), "poll before the next start bit: byte completed twice");
+    midirx_edge(&rx, 608, 1, &byte);
+    expect(midirx_poll(&rx, 640, &byte) && byte == 0x00 && rx.errors == 0, "poll before the next start bit: next byte lost");
+}
+
+static void check_break(void) {
+    struct midirx_t rx;
+    midirx_init(&rx);
+    count = 0;
+    replay(&rx, line_break, sizeof(line_break) / sizeof(line_break[0]));
+    expect(rx.errors == 1, "break: not counted as a framing error");
+    expect(count == 1 && received[0] == line_break_bytes[0], "break: byte after it lost");
+}
+
+// Turn random bytes into edges, stamped up to FUZZ_LATENCY_US late, and replay them with polls at
+// random intervals
+static void check_fuzz(void) {
+    static unsigned char sent[FUZZ_BYTES];
+    struct midirx_t rx;
+    midirx_init(&rx);
+    count = 0;
+
+    unsigned int time = 1000, level = 1;
+    unsigned int next_poll = time;
+    for (unsigned int i = 0; i < FUZZ_BYTES; i++) {
+        sent[i] = rand();
+        unsigned int frame = (sent[i] << 1) | (1 << (MIDIRX_FRAME_BITS - 1));
+        for (unsigned int bit = 0; bit < MIDIRX_FRAME_BITS; bit++) {
+            unsigned int bit_level = (frame >> bit) & 1;
+            if (bit_level == level) continue;
+            level = bit_level;
+
+            unsigned int stamp = time + bit * MIDIRX_BIT_US + rand() % (FUZZ_LATENCY_US + 1);
+            poll_until(&rx, &next_poll, stamp, 10 + rand() % 150);
+
+            unsigned char byte;
+            if (midirx_edge(&rx, stamp, level, &byte)) {
+                received_at[count] = stamp;
+                received[count++] = byte;
+            }
+        }
+
+        // Mostly back to back, sometimes a few idle bits
+        time += MIDIRX_FRAME_BITS * MIDIRX_BIT_US;
+        if (rand() % 4 == 0) time += (rand() % 4) * MIDIRX_BIT_US;
+    }
+    poll_until(&rx, &next_poll, time + 20 * MIDIRX_BIT_US, 50);
+
+    unsigned int wrong = 0;
+    for (unsigned int i = 0; i < FUZZ_BYTES && i < count; i++) {
+        if (received[i] != sent[i]) wrong++;
+    }
+    printf("fuzz: %u bytes sent, %u received, %u wrong, %u framing errors\n", FUZZ_BYTES, count, wrong, rx.errors);
+    expect(count == FUZZ_BYTES && wrong == 0 && rx.errors == 0, "fuzz: bytes changed or lost");
+}
+
+int main(void) {
+    srand(107);
+    check_case("back-to-back messages", note_on_off, sizeof(note_on_off) / sizeof(note_on_off[0]),
+               note_on_off_bytes, sizeof(note_on_off_bytes));
+    check_case("stop bit then start bit", stop_then_start, sizeof(stop_then_start) / sizeof(stop_then_start[0]),
+               stop_then_start_bytes, sizeof(stop_then_start_bytes));
+    check_case("byte ending high", ends_high, sizeof(ends_high) / sizeof(ends_high[0]),
+               ends_high_bytes, sizeof(ends_high_bytes));
+    check_poll_timeout();
+    check_break();
+    check_fuzz();
+
+    printf(failures ? "%d failures\n" : "all passed\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,393 @@
+// Host-side simulation of the NAJ writer on a simulated GPIO bank (see `motors/najtx.h`)
+//
+// Usage: ./najbus
+// Drives the writer against three fake GPIO registers (set, clear, level) with the readers on the bus
+// modelled the way `naj.c` reads it: each latches the data pins some interrupt latency after a rising
+// clock edge - an edge that comes while the last one is still waiting to be handled is merged into
+// it, as the GPIO event flag would - and the motor board toggles ACK as it latches
+// The writer runs from interrupts as on the board: the transmit timer, ticking every NAJ_DELAY
+// without ACK and re-armed for each step with it, and with ACK the ACK line's edge interrupt, each
+// WRITER_IRQ_NS after the event. It writes each register at most once per call, so the bank applies
+// the clear, then the set, after every call
+// Each run streams the 'b' benchmark of `controller.c` (NAJ_BENCH_BYTES bytes back to back; the rate
+// does not depend on the data, so the bytes are random here, to be checked) and checks that:
+//     - the data never changes while the clock is high; without ACK the clock is low and high for
+//       at least a tick each, with ACK the data settles NAJ_ACK_SETUP_US before the clock rises and
+//       the clock stays high for the hold, less the microsecond the tick count may be short of it
+//     - every reader latches every byte once, in order - except that the ACK reader may lose a byte
+//       to a stall longer than NAJ_ACK_TIMEOUT ticks, after which it must be back in step
+// The same runs are made with the baseline writer, the blocking `naj_write_byte` the board had before
+// the transmit queue: 8 `gpio_write` calls of GPIO_WRITE_NS each, then the clock high for a
+// `timer_delay_us(NAJ_DELAY)`, then low. Its results are reported, not checked
+// Prints the shortest setup, low and high times seen and the bus rate in bytes/s for each run
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../motors/najtx.h"
+
+// The pins of `naj.h` (which needs the Pi headers)
+#define CLOCK_PIN 23
+#define ACK_PIN 26
+static const unsigned int data_pins[8] = {24, 25, 8, 7, 12, 16, 20, 21};
+
+#define NAJ_BENCH_BYTES 4096
+#define TICK_NS (NAJ_DELAY * 1000L)
+
+// Time from a timer expiry or an ACK edge to the writer's interrupt handler running on the controller
+#define WRITER_IRQ_NS 1500
+
+// Time a `gpio_write` call takes on the controller (a call, a read of the function select and a
+// write of GPSET or GPCLR) - an estimate, not a measurement
+#define GPIO_WRITE_NS 150
+
+// The simulated GPIO bank
+static volatile unsigned int gpset, gpclr, gplev;
+
+static long now;
+static long done_at;
+
+// Bytes to send, and the index of the one on the data pins
+static unsigned char bytes[NAJ_BENCH_BYTES];
+static unsigned int queued;
+static unsigned int on_pins;
+
+// Timing seen on the bus
+static long last_rise, last_fall, last_change;
+static int risen;
+static long min_setup, min_low, min_high;
+static unsigned int glitches, changed_high;
+
+// A reader's interrupt latency: `base_ns` plus up to `spread_ns`, `slow_ns` more one time in
+// `slow_one_in`, and a stall of `stall_ns` one time in `stall_one_in` (0 for never)
+struct reader_t {
+    const char *name;
+    int acks;
+    long base_ns, spread_ns;
+    unsigned int slow_one_in;
+    long slow_ns;
+    unsigned int stall_one_in;
+    long stall_ns;
+
+    int pending;
+    long latch_at;
+    unsigned int stalls;
+    unsigned int next_index;         // Index of the byte it should latch next
+    unsigned int good, missed, repeated, merged, corrupt;
+};
+
+static struct reader_t readers[2];
+static unsigned int num_readers;
+
+// The writer, and its interrupts: the timer expiry and the ACK edge, each handled WRITER_IRQ_NS later
+static struct najtx_t tx;
+static int ack_irq_pending;
+static long timer_irq_at, ack_irq_at;
+
+static int failures;
+
+static void expect(int ok, const char *what) {
+    if (!ok && failures++ < 20) printf("FAIL: %s\n", what);
+}
+
+static unsigned int data_mask(void) {
+    unsigned int mask = 0;
+    for (int i = 0; i < 8; i++) mask |= 1 << data_pins[i];
+    return mask;
+}
+
+static unsigned char pins_to_byte(unsigned int lev) {
+    unsigned char value = 0;
+    for (int i = 0; i < 8; i++) {
+        if (lev & (1 << data_pins[i])) value |= 1 << i;
+    }
+    return value;
+}
+
+static long latency(struct reader_t *reader) {
+    long ns = reader->base_ns + rand() % (reader->spread_ns + 1);
+    if (reader->slow_one_in && rand() % reader->slow_one_in == 0) ns += reader->slow_ns;
+    if (reader->stall_one_in && rand() % reader->stall_one_in == 0) {
+        ns += reader->stall_ns;
+        reader->stalls++;
+    }
+    return ns;
+}
+
+// Apply what the writer has just written to the set and clear registers
+static void bank_apply(void) {
+    unsigned int clock = 1 << CLOCK_PIN;
+    unsigned int before = gplev;
+    if (gpclr & gpset & clock) glitches++;
+
+    gplev = (gplev & ~gpclr) | gpset;
+    gpclr = gpset = 0;
+
+    if ((before & clock) && !(gplev & clock)) {
+        if (now - last_rise < min_high) min_high = now - last_rise;
+        last_fall = now;
+    }
+    if ((before ^ gplev) & data_mask()) {
+        if (gplev & clock) changed_high++;
+        last_change = now;
+    }
+    if (!(before & clock) && (gplev & clock)) {
+        if (now - last_change < min_setup) min_setup = now - last_change;
+        if (risen && now - last_fall < min_low) min_low = now - last_fall;
+        last_rise = now;
+        risen = 1;
+
+        for (unsigned int i = 0; i < num_readers; i++) {
+            struct reader_t *reader = &readers[i];
+            if (reader->pending) {
+                reader->merged++;
+                continue;
+            }
+            reader->pending = 1;
+            reader->latch_at = now + latency(reader);
+        }
+    }
+}
+
+static int next_byte(int *data, void *aux) {
+    if (queued == NAJ_BENCH_BYTES) return 0;
+    on_pins = queued;
+    *data = bytes[queued++];
+    return 1;
+}
+
+static void latch(struct reader_t *reader) {
+    reader->pending = 0;
+
+    // The value read is whatever is on the pins: a byte half written counts as corrupt, otherwise it
+    // is right if it is the byte that was expected
+    if (pins_to_byte(gplev) != bytes[on_pins]) {
+        reader->corrupt++;
+    } else if (on_pins == reader->next_index) {
+        reader->good++;
+    } else if (on_pins > reader->next_index) {
+        reader->missed += on_pins - reader->next_index;
+    } else {
+        reader->repeated++;
+    }
+    if (on_pins >= reader->next_index) reader->next_index = on_pins + 1;
+
+    if (reader->acks) {
+        gplev ^= 1 << ACK_PIN;
+        if (!ack_irq_pending) {
+            ack_irq_pending = 1;
+            ack_irq_at = now + WRITER_IRQ_NS;
+        }
+    }
+}
+
+// The baseline writer, one step of `naj_write_byte` at a time: steps 0-7 write a data pin, 8 raises
+// the clock and 9 lowers it after the delay. Returns the time of the next step
+static unsigned int baseline_step;
+static int baseline_data;
+
+static long baseline(void) {
+    if (baseline_step == 0 && !next_byte(&baseline_data, NULL)) {
+        done_at = now;
+        return now;
+    }
+
+    unsigned int step = baseline_step;
+    baseline_step = (baseline_step + 1) % 10;
+    if (step < 8) {
+        if (baseline_data & (1 << step)) gpset = 1 << data_pins[step];
+        else gpclr = 1 << data_pins[step];
+        bank_apply();
+        return now + GPIO_WRITE_NS;
+    }
+
+    if (step == 8) {
+        gpset = 1 << CLOCK_PIN;
+        bank_apply();
+        return now + GPIO_WRITE_NS + TICK_NS;
+    }
+    gpclr = 1 << CLOCK_PIN;
+    bank_apply();
+    return now + GPIO_WRITE_NS;
+}
+
+// Act on the flags the writer returned
+static void writer_flags(int done, int use_ack) {
+    bank_apply();
+    if (done & NAJTX_STOP) {
+        done_at = now;
+    } else if (use_ack && (done & NAJTX_WAIT)) {
+        timer_irq_at = now + WRITER_IRQ_NS + 1000L * tx.wait;
+    }
+}
+
+struct result_t {
+    double rate;
+    unsigned int timeouts;
+};
+
+// Stream the benchmark with the baseline writer or the queued one, and return the bus rate
+static struct result_t run(int use_baseline, int use_ack, unsigned int hold) {
+    najtx_init(&tx, &gpset, &gpclr, &gplev, data_pins, CLOCK_PIN, ACK_PIN, use_ack);
+    tx.hold = hold;
+    baseline_step = 0;
+
+    for (unsigned int i = 0; i < NAJ_BENCH_BYTES; i++) bytes[i] = rand();
+    queued = 0;
+    gpset = gpclr = gplev = 0;
+    now = 0;
+    done_at = -1;
+    last_rise = last_fall = last_change = 0;
+    risen = 0;
+    min_setup = min_low = min_high = 1L << 40;
+    glitches = changed_high = 0;
+    ack_irq_pending = 0;
+    for (unsigned int i = 0; i < num_readers; i++) {
+        struct reader_t *reader = &readers[i];
+        reader->pending = 0;
+        reader->stalls = reader->next_index = 0;
+        reader->good = reader->missed = reader->repeated = reader->merged = reader->corrupt = 0;
+    }
+
+    // All bytes are queued at time 0, which starts the timer: its first expiry is a period later
+    // The baseline writer starts at once and runs until it has sent them all
+    timer_irq_at = use_baseline ? 0 : TICK_NS + WRITER_IRQ_NS;
+    while (done_at < 0) {
+        // Next event: a reader latching, the writer's ACK interrupt, or its timer (the baseline's next step)
+        struct reader_t *first = NULL;
+        for (unsigned int i = 0; i < num_readers; i++) {
+            if (readers[i].pending && (!first || readers[i].latch_at < first->latch_at)) first = &readers[i];
+        }
+        long at = timer_irq_at;
+        if (first && first->latch_at < at) at = first->latch_at;
+        int ack_first = !use_baseline && use_ack && ack_irq_pending && ack_irq_at < at;
+        if (ack_first) at = ack_irq_at;
+        now = at;
+
+        if (first && first->latch_at == at) {
+            latch(first);
+        } else if (ack_first) {
+            ack_irq_pending = 0;
+            writer_flags(najtx_ack(&tx, now / 1000, next_byte, NULL), use_ack);
+        } else if (use_baseline) {
+            timer_irq_at = baseline();
+        } else {
+            // Without ACK the timer reloads itself every tick; with it, the writer re-arms it or it stops
+            if (use_ack) timer_irq_at = 1L << 62;
+            else timer_irq_at += TICK_NS;
+            writer_flags(najtx_tick(&tx, now / 1000, next_byte, NULL), use_ack);
+        }
+    }
+    ack_irq_pending = 0;
+
+    // Let the readers finish latching the last byte
+    for (unsigned int i = 0; i < num_readers; i++) {
+        if (readers[i].pending) {
+            now = readers[i].latch_at;
+            latch(&readers[i]);
+        }
+    }
+
+    struct result_t result = {
+        (double) NAJ_BENCH_BYTES * 1e9 / done_at,
+        use_baseline ? 0 : tx.ack_timeouts,
+    };
+    return result;
+}
+
+static void report(const char *label, struct result_t result) {
+    printf("%-36s %6.0f bytes/s  setup %5.2f us  low %5.2f us  high %5.2f us  ack timeouts %u\n",
+           label, result.rate, min_setup / 1000.0, min_low / 1000.0, min_high / 1000.0, result.timeouts);
+    for (unsigned int i = 0; i < num_readers; i++) {
+        struct reader_t *reader = &readers[i];
+        printf("    %-10s latched %u of %u, %u missed, %u twice, %u corrupt, %u edges merged, %u stalls\n",
+               reader->name, reader->good, NAJ_BENCH_BYTES, reader->missed, reader->repeated, reader->corrupt,
+               reader->merged, reader->stalls);
+    }
+}
+
+static void check_timing(const char *label, int use_ack, unsigned int hold) {
+    char what[160];
+    snprintf(what, sizeof(what), "%s: data changed while the clock was high", label);
+    expect(changed_high == 0, what);
+    snprintf(what, sizeof(what), "%s: clock cleared and set in one call", label);
+    expect(glitches == 0, what);
+
+    if (use_ack) {
+        // The hold is counted in whole ticks of `timer_get_ticks`, so it may be up to one short
+        long min_hold = hold ? (hold - 1) * 1000L : 0;
+        snprintf(what, sizeof(what), "%s: less than NAJ_ACK_SETUP_US of setup or the hold high", label);
+        expect(min_setup >= NAJ_ACK_SETUP_US * 1000L && min_high >= min_hold, what);
+    } else {
+        snprintf(what, sizeof(what), "%s: less than a tick of setup, low or high time", label);
+        expect(min_setup >= TICK_NS && min_low >= TICK_NS && min_high >= TICK_NS, what);
+    }
+}
+
+static void check_perfect(const struct reader_t *reader, const char *label) {
+    char what[160];
+    snprintf(what, sizeof(what), "%s: %s did not latch every byte once", label, reader->name);
+    expect(reader->good == NAJ_BENCH_BYTES && reader->missed == 0 && reader->repeated == 0 && reader->corrupt == 0, what);
+}
+
+// Run the scenario with both writers, checking the queued one
+static void scenario(const char *name, int use_ack, unsigned int hold) {
+    char label[64];
+    snprintf(label, sizeof(label), "%s, baseline", name);
+    report(label, run(1, use_ack, hold));
+
+    snprintf(label, sizeof(label), "%s, queued", name);
+    struct result_t result = run(0, use_ack, hold);
+    report(label, result);
+    check_timing(label, use_ack, hold);
+
+    // A stall loses at most the byte it was for and the one after (which it may latch twice)
+    struct reader_t *motor = &readers[0];
+    if (motor->stalls) {
+        char what[160];
+        snprintf(what, sizeof(what), "%s: motor board not back in step after its stalls", label);
+        expect(motor->corrupt == 0 && motor->missed + motor->repeated <= 2 * motor->stalls &&
+               result.timeouts <= 2 * motor->stalls, what);
+    } else {
+        check_perfect(motor, label);
+    }
+    for (unsigned int i = 1; i < num_readers; i++) check_perfect(&readers[i], label);
+}
+
+int main(void) {
+    srand(107);
+    printf("NAJ_DELAY %d us, NAJ_ACK_SETUP_US %d, NAJ_ACK_HOLD_US %d, NAJ_ACK_TIMEOUT %d ticks, %d bytes per run\n",
+           NAJ_DELAY, NAJ_ACK_SETUP_US, NAJ_ACK_HOLD_US, NAJ_ACK_TIMEOUT, NAJ_BENCH_BYTES);
+
+    // Interrupt latencies within a tick, as the readers must manage when nothing paces the bus
+    struct reader_t motor = {"motors", 0, 1000, 3000, 50, 4000, 0, 0};
+    struct reader_t graphics = {"graphics", 0, 1000, 4000, 100, 4000, 0, 0};
+    readers[0] = motor;
+    readers[1] = graphics;
+    num_readers = 2;
+    scenario("no ACK", 0, NAJ_ACK_HOLD_US);
+
+    // With ACK, the motor board may be slower than a tick now and then (the step interrupt ahead of it)
+    readers[0].acks = 1;
+    scenario("ACK", 1, NAJ_ACK_HOLD_US);
+
+    readers[0].slow_ns = 14000;
+    scenario("ACK, slow motor board", 1, NAJ_ACK_HOLD_US);
+
+    // Now and then it stalls for longer than the timeout
+    readers[0].stall_one_in = 500;
+    readers[0].stall_ns = (NAJ_ACK_TIMEOUT + 2) * TICK_NS;
+    scenario("ACK, stalling motor board", 1, NAJ_ACK_HOLD_US);
+
+    // The motor board alone on the bus: no hold, the ACK paces every byte
+    readers[0] = motor;
+    readers[0].acks = 1;
+    num_readers = 1;
+    scenario("ACK, motor board only, no hold", 1, 0);
+
+    readers[0].slow_ns = 14000;
+    scenario("ACK, slow motor board only, no hold", 1, 0);
+
+    printf(failures ? "%d failures\n" : "all passed\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,266 @@
+// Host-side test for the NAJ frame builder and parser (see `motors/najframe.h`)
+//
+// Usage: ./najtest
+// Builds frames, encodes them and feeds the bytes back through the parser the way `naj_read_frame`
+// does, checking that:
+//     - every frame comes back as it was sent, stamped with the time of its sync byte
+//     - a frame split over many calls is assembled inside the parser, and the caller's frame is
+//       only written once a whole, valid frame has arrived
+//     - a frame with a corrupted length (too long, or impossible) or a bad CRC costs only itself:
+//       the frames after it are found by rescanning the bytes the bad one swallowed
+//     - frames built side by side keep their own NOTES and NOTES_AT batching
+// and finally runs a long stream with random bytes corrupted, checking every intact frame is recovered
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../motors/najframe.h"
+
+#define FUZZ_FRAMES 20000
+#define FUZZ_CORRUPT_ONE_IN 8 // Frames with one byte corrupted
+
+static struct naj_parser_t parser;
+static int failures;
+
+static void expect(int ok, const char *what) {
+    if (!ok && failures++ < 20) printf("FAIL: %s\n", what);
+}
+
+static int same_frame(const struct naj_frame_t *a, const struct naj_frame_t *b) {
+    return a->addr == b->addr && a->seq == b->seq && a->len == b->len && memcmp(a->payload, b->payload, a->len) == 0;
+}
+
+// A frame of random notes and commands for `addr`, numbered `seq`
+static void random_frame(struct naj_frame_t *frame, unsigned char addr, unsigned char seq) {
+    naj_frame_begin(frame);
+    frame->addr = addr;
+    frame->seq = seq;
+
+    int commands = rand() % 6;
+    for (int i = 0; i < commands; i++) {
+        unsigned char args[8];
+        unsigned int nargs = rand() % 8;
+        for (unsigned int j = 0; j < nargs; j++) args[j] = rand();
+        switch (rand() % 3) {
+        case 0: naj_frame_add_note(frame, rand() % NAJ_MAX_VOICES, rand() % 88); break;
+        case 1: naj_frame_add_note_at(frame, rand(), rand() % NAJ_MAX_VOICES, rand() % 88); break;
+        default: naj_frame_add(frame, NAJ_CMD_BEND, args, nargs); break;
+        }
+    }
+}
+
+// Push `n` bytes received at times `first_time`, `first_time` + 1, ... and collect the frames
+// they complete into `out` (room for `max`); returns how many there were
+static unsigned int feed(const unsigned char *bytes, unsigned int n, unsigned int first_time,
+                         struct naj_frame_t *out, unsigned int max) {
+    unsigned int found = 0;
+    struct naj_frame_t frame;
+    for (unsigned int i = 0; i < n; i++) {
+        expect(naj_parser_has_room(&parser), "parser full before a push");
+        naj_parser_push(&parser, bytes[i], first_time + i);
+        while (naj_parser_frame(&parser, &frame)) {
+            if (found < max) out[found] = frame;
+            found++;
+        }
+    }
+    return found;
+}
+
+static void check_round_trip(void) {
+    naj_parser_init(&parser);
+
+    unsigned char bytes[NAJ_MAX_FRAME];
+    for (int i = 0; i < 1000; i++) {
+        struct naj_frame_t sent, received;
+        random_frame(&sent, rand() % 4, i);
+        unsigned int n = naj_frame_encode(&sent, bytes);
+        expect(n == sent.len + NAJ_FRAME_OVERHEAD, "encoded length");
+
+        unsigned int found = feed(bytes, n, 1000 * i, &received, 1);
+        expect(found == 1, "round trip: frame not found");
+        if (found != 1) continue;
+        expect(same_frame(&sent, &received), "round trip: frame changed");
+        expect(received.time == 1000u * i, "round trip: not stamped with the sync byte's time");
+    }
+    expect(parser.frames == 1000 && parser.crc_errors == 0 && parser.lost_frames == 0, "round trip statistics");
+}
+
+static void check_split(void) {
+    naj_parser_init(&parser);
+
+    struct naj_frame_t sent, received;
+    naj_frame_begin(&sent);
+    for (int i = 0; i < 20; i++) naj_frame_add_note(&sent, i, 40 + i);
+    sent.seq = 7;
+
+    unsigned char bytes[NAJ_MAX_FRAME];
+    unsigned int n = naj_frame_encode(&sent, bytes);
+
+    // One byte per call, as it arrives - with the caller's frame scribbled over between calls
+    for (unsigned int i = 0; i < n; i++) {
+        memset(&received, 0x5A, sizeof(received));
+        naj_parser_push(&parser, bytes[i], i);
+        int done = naj_parser_frame(&parser, &received);
+
+        if (i + 1 < n) {
+            struct naj_frame_t untouched;
+            memset(&untouched, 0x5A, sizeof(untouched));
+            expect(!done, "split: frame returned early");
+            expect(memcmp(&received, &untouched, sizeof(received)) == 0, "split: caller's frame written before the frame was complete");
+        } else {
+            expect(done && same_frame(&sent, &received), "split: frame not assembled");
+        }
+    }
+}
+
+// Frame A with `len_byte` written over its length, then B and C: both B and C must be found
+static void check_bad_length(unsigned char len_byte) {
+    naj_parser_init(&parser);
+
+    struct naj_frame_t a, b, c;
+    unsigned char notes[4] = {1, 40, 2, 41};
+    naj_frame_begin(&a);
+    naj_frame_add(&a, NAJ_CMD_NOTES, notes, 4);
+    a.seq = 0;
+    naj_frame_begin(&b);
+    naj_frame_add_note(&b, 3, 42);
+    b.seq = 1;
+    naj_frame_begin(&c);
+    naj_frame_add(&c, NAJ_CMD_JITTER_DUMP, NULL, 0);
+    c.seq = 2;
+
+    unsigned char bytes[3 * NAJ_MAX_FRAME + NAJ_MAX_FRAME];
+    unsigned int n = naj_frame_encode(&a, bytes);
+    bytes[3] = len_byte;
+    n += naj_frame_encode(&b, bytes + n);
+    n += naj_frame_encode(&c, bytes + n);
+
+    // Enough traffic after them for a long bogus length to run out
+    struct naj_frame_t filler;
+    naj_frame_begin(&filler);
+    filler.seq = 3;
+    for (int i = 0; i < 20; i++) naj_frame_add_note(&filler, i, i);
+    n += naj_frame_encode(&filler, bytes + n);
+
+    struct naj_frame_t received[4];
+    unsigned int found = feed(bytes, n, 0, received, 4);
+
+    char what[64];
+    snprintf(what, sizeof(what), "length %u: frames after the bad one lost", len_byte);
+    expect(found == 3 && same_frame(&received[0], &b) && same_frame(&received[1], &c) && same_frame(&received[2], &filler), what);
+    snprintf(what, sizeof(what), "length %u: error not counted", len_byte);
+    expect(parser.crc_errors >= 1, what);
+}
+
+static void check_bad_crc(void) {
+    naj_parser_init(&parser);
+
+    struct naj_frame_t a, b, received[2];
+    naj_frame_begin(&a);
+    naj_frame_add_note(&a, 0, 50);
+    a.seq = 10;
+    naj_frame_begin(&b);
+    naj_frame_add_note(&b, 1, 51);
+    b.seq = 11;
+
+    unsigned char bytes[2 * NAJ_MAX_FRAME];
+    unsigned int n = naj_frame_encode(&a, bytes);
+    bytes[5] ^= 0x10;
+    n += naj_frame_encode(&b, bytes + n);
+
+    unsigned int found = feed(bytes, n, 0, received, 2);
+    expect(found == 1 && same_frame(&received[0], &b), "bad CRC: next frame not found");
+    expect(parser.crc_errors == 1, "bad CRC: error not counted");
+}
+
+static void check_batching(void) {
+    // Two frames built side by side must each batch their own notes
+    struct naj_frame_t first, second;
+    naj_frame_begin(&first);
+    naj_frame_begin(&second);
+    for (int i = 0; i < 6; i++) {
+        naj_frame_add_note(&first, i, 30 + i);
+        naj_frame_add_note(&second, i, 60 + i);
+    }
+    expect(first.len == 2 + 12 && first.payload[1] == 12, "interleaved NOTES not batched in the first frame");
+    expect(second.len == 2 + 12 && second.payload[1] == 12, "interleaved NOTES not batched in the second frame");
+
+    naj_frame_begin(&first);
+    naj_frame_begin(&second);
+    for (int i = 0; i < 4; i++) {
+        naj_frame_add_note_at(&first, 123456, i, 30 + i);
+        naj_frame_add_note_at(&second, 654321, i, 60 + i);
+    }
+    expect(first.len == 2 + 4 + 8 && naj_read_u32(&first.payload[2]) == 123456, "interleaved NOTES_AT not batched in the first frame");
+    expect(second.len == 2 + 4 + 8 && naj_read_u32(&second.payload[2]) == 654321, "interleaved NOTES_AT not batched in the second frame");
+
+    // A different deadline starts a new header
+    naj_frame_add_note_at(&first, 123457, 9, 9);
+    expect(first.len == 2 + 4 + 8 + 8, "new deadline did not start a new NOTES_AT");
+
+    // A frame that is full is left unchanged
+    naj_frame_begin(&first);
+    while (naj_frame_add_note(&first, 0, 0)) {}
+    expect(first.len <= NAJ_MAX_PAYLOAD && first.len > NAJ_MAX_PAYLOAD - 2, "full frame");
+}
+
+static void check_fuzz(void) {
+    naj_parser_init(&parser);
+    srand(8);
+
+    static struct naj_frame_t sent[FUZZ_FRAMES];
+    static unsigned char intact[FUZZ_FRAMES];
+    static unsigned char recovered[FUZZ_FRAMES];
+    unsigned int corrupted = 0, spurious = 0, total = 0;
+
+    for (unsigned int i = 0; i < FUZZ_FRAMES; i++) {
+        random_frame(&sent[i], i % 3, i);
+        unsigned char bytes[NAJ_MAX_FRAME];
+        unsigned int n = naj_frame_encode(&sent[i], bytes);
+
+        // Corrupt one byte of some frames (a single bad byte always fails the CRC)
+        intact[i] = rand() % FUZZ_CORRUPT_ONE_IN != 0;
+        if (!intact[i]) {
+            bytes[rand() % n] ^= 1 + rand() % 255;
+            corrupted++;
+        }
+
+        for (unsigned int j = 0; j < n; j++) {
+            struct naj_frame_t frame;
+            naj_parser_push(&parser, bytes[j], total++);
+            while (naj_parser_frame(&parser, &frame)) {
+                // Frames are numbered in order, so the sequence number finds the frame that was sent
+                unsigned int k = i - (unsigned char)(i - frame.seq);
+                if (k < FUZZ_FRAMES && same_frame(&frame, &sent[k])) recovered[k] = 1;
+                else spurious++;
+            }
+        }
+    }
+
+    unsigned int missed = 0;
+    for (unsigned int i = 0; i < FUZZ_FRAMES; i++) {
+        if (intact[i] && !recovered[i]) missed++;
+        if (!intact[i] && recovered[i]) {
+            expect(0, "fuzz: corrupted frame accepted");
+        }
+    }
+    printf("fuzz: %u frames, %u corrupted, %u intact frames missed, %u false frames, %u CRC errors, %u counted lost\n",
+           FUZZ_FRAMES, corrupted, missed, spurious, parser.crc_errors, parser.lost_frames);
+    expect(missed == 0, "fuzz: intact frames missed");
+}
+
+int main(void) {
+    srand(107);
+    check_round_trip();
+    check_split();
+    check_bad_length(NAJ_MAX_PAYLOAD - 4);
+    check_bad_length(NAJ_MAX_PAYLOAD);
+    check_bad_length(200);
+    check_bad_crc();
+    check_batching();
+    check_fuzz();
+
+    printf(failures ? "%d failures\n" : "all passed\n", failures);
+    return failures != 0;
+}
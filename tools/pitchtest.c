@@ -0,0 +1,87 @@
+// Host-side test for the motor board pitch engine (see `motors/pitch.h`)
+//
+// Usage: ./pitchtest [--check]
+// Steps every key through the scheduler's fixed point accumulator for a few seconds of whole
+// microsecond ticks, and reports the realized frequency error in cents against equal temperament,
+// next to the error of the old table of whole microsecond periods
+// Then sweeps the pitch bend range on A4 and reports the error of each bend
+// With --check, exits non-zero if any error is over MAX_CENTS
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../motors/pitch.h"
+
+// Simulated playing time per key, in microseconds
+#define DURATION 4000000
+
+// Largest acceptable error, in cents
+#define MAX_CENTS 0.1
+
+static double ideal_hz(double key) {
+    return PITCH_A4_HZ * pow(2.0, (key - 48) / 12.0);
+}
+
+static double cents(double actual, double ideal) {
+    return 1200.0 * log2(actual / ideal);
+}
+
+// Play a fixed point period the way the scheduler does: every step lands on a whole tick,
+// with the leftover fraction carried to the next one
+static double realized_hz(unsigned int period) {
+    unsigned int tick = 0;
+    unsigned int phase = 0;
+    unsigned int steps = 0;
+
+    while (tick < DURATION) {
+        unsigned int total = phase + period;
+        phase = total & ((1 << PITCH_FRAC_BITS) - 1);
+        tick += total >> PITCH_FRAC_BITS;
+        steps++;
+    }
+    return steps * 1000000.0 / tick;
+}
+
+int main(int argc, char *argv[]) {
+    int check = (argc > 1 && strcmp(argv[1], "--check") == 0);
+    double worst = 0, worst_old = 0;
+    int worst_key = 0, worst_old_key = 0;
+
+    printf("key    hz         old cents  new cents\n");
+    for (int key = 0; key < PITCH_KEYS; key++) {
+        double ideal = ideal_hz(key);
+        double old = 1000000.0 / (unsigned int)(1000000.0 / ideal + 0.5);
+        double error = cents(realized_hz(pitch_period(key, 0, 0)), ideal);
+        double error_old = cents(old, ideal);
+
+        printf("%-5d  %-9.3f  %+9.4f  %+9.4f\n", key, ideal, error_old, error);
+        if (fabs(error) > fabs(worst)) { worst = error; worst_key = key; }
+        if (fabs(error_old) > fabs(worst_old)) { worst_old = error_old; worst_old_key = key; }
+    }
+    printf("worst: old %+.4f cents (key %d), new %+.4f cents (key %d)\n",
+           worst_old, worst_old_key, worst, worst_key);
+
+    // Bends on A4 (key 48), plus a transposition that folds off the top of the piano
+    double worst_bend = 0;
+    printf("\nbend    cents off target\n");
+    for (int bend = PITCH_BEND_MIN; bend <= PITCH_BEND_MAX + 1; bend += 1024) {
+        int value = (bend > PITCH_BEND_MAX) ? PITCH_BEND_MAX : bend;
+        double ideal = ideal_hz(48 + value * (double) PITCH_BEND_RANGE / 8192);
+        double error = cents(realized_hz(pitch_period(48, 0, value)), ideal);
+
+        printf("%+6d  %+9.4f\n", value, error);
+        if (fabs(error) > fabs(worst_bend)) worst_bend = error;
+    }
+    printf("worst bend: %+.4f cents\n", worst_bend);
+
+    unsigned int folded = pitch_period(80, 12, 0);
+    int fold_ok = (folded == pitch_periods[80]);
+    printf("E7 transposed up an octave folds back: %s\n", fold_ok ? "yes" : "no");
+
+    if (check && (fabs(worst) > MAX_CENTS || fabs(worst_bend) > MAX_CENTS || !fold_ok)) {
+        printf("FAIL: error above %.2f cents\n", MAX_CENTS);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,291 @@
+// Host-side simulation of the motor board's step timing (see `motors/sched.h`)
+//
+// Usage: ./schedsim
+// Plays the same workload - eight motors holding notes, one of them changing note every CHANGE_US,
+// with the NAJ bytes that carry each change - through two models of the motor board, and
+// histograms how far each step interval lands from the interval that was intended:
+//     - the busy-poll loop `motors.c` had before the scheduler, modelled here: each pass reads the
+//       clock for every motor, steps the ones past their time, and sets their next step a period
+//       after the pass noticed them; NAJ messages are handled (and printed) by the same loop
+//     - the heap scheduler, `motors/sched.c` itself, linked against a fake `timer_get_ticks`, ARM
+//       timer and interrupt controller (see `fakepi/`): steps fire from the simulated timer
+//       interrupt, which waits for any NAJ byte interrupt already running
+// The intended interval is the note's period: every note is below the scheduler's ramp start
+// (periods of SCHED_RAMP_START_US or more), so it plays them without ramping, and the periods are
+// whole microseconds, so the loop can play them exactly too
+// The costs below are estimates for the Pi's ARM1176, not measurements, so the histograms show the
+// shape of each design's jitter rather than exact figures
+// Also checks that the scheduler's intervals have no bias (no drift in pitch) and no missed steps
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../motors/sched.h"
+#include "../motors/jitter.h"
+#include "../motors/najframe.h"
+#include "fakepi/armtimer.h"
+#include "fakepi/interrupts.h"
+#include "fakepi/timer.h"
+
+#define NUM_MOTORS 8
+#define DURATION_US 20000000
+#define CHANGE_US 125000
+
+// Estimated costs, in nanoseconds
+#define CHECK_NS 150             // Busy loop: reading the clock and comparing, per playing motor
+#define PASS_NS 300              // Busy loop: the rest of a pass (checking for NAJ data)
+#define PRINT_NS 1560000         // Busy loop: printing a message, 26 characters (18 past the UART FIFO) at 115200 baud
+#define IRQ_ENTRY_NS 1000        // Taking an interrupt and dispatching it to the handler
+#define TIMER_HANDLER_NS 1500    // Scheduler: heap and deadline work around each batch of steps
+#define STEP_NS 2500             // Pulsing the step pins (STEP_PULSE_TICKS in `motors.c`, and the writes)
+#define NAJ_ISR_NS 2000          // Latching one NAJ byte
+#define NAJ_BYTE_NS 20000        // Spacing of NAJ bytes on the bus
+#define SET_NS 3000              // Scheduler: a note change, with interrupts disabled
+
+// Bytes that carry one note change: the old 3-byte message, and a frame with one NOTES command
+#define OLD_MESSAGE_BYTES 3
+#define FRAME_BYTES (NAJ_FRAME_OVERHEAD + 4)
+
+// Notes held, and the notes the changing motor moves between, as step periods in microseconds
+static const unsigned int chord[NUM_MOTORS] = {7645, 6068, 5102, 3822, 3034, 2551, 2273, 2025};
+static const unsigned int changes[] = {4545, 3405, 2863, 2408, 2145, 3214};
+#define NUM_CHANGES (sizeof(changes) / sizeof(changes[0]))
+
+// Histogram of |actual - intended| step intervals: bucket 0 is under 1 us, bucket k is [2^(k-1), 2^k) us
+#define BUCKETS 13
+
+struct histogram_t {
+    unsigned long counts[BUCKETS];
+    unsigned long steps;
+    long long total_error_ns;  // Signed, to show a bias
+    long max_error_ns;
+    unsigned int missed;
+};
+
+static struct histogram_t histogram;
+
+// Per motor: its period, and the time of its last step in nanoseconds (-1 after a change)
+static unsigned int periods[NUM_MOTORS];
+static long long last_step_ns[NUM_MOTORS];
+
+static int failures;
+
+static void expect(int ok, const char *what) {
+    if (!ok && failures++ < 20) printf("FAIL: %s\n", what);
+}
+
+// Record a step of `motor` at `now_ns`, intended a period after its last one
+static void record(unsigned int motor, long long now_ns) {
+    if (last_step_ns[motor] >= 0) {
+        long error = (long) (now_ns - last_step_ns[motor] - periods[motor] * 1000ll);
+        long size = (error < 0) ? -error : error;
+
+        unsigned int bucket = 0;
+        for (long us = size / 1000; us > 0 && bucket < BUCKETS - 1; us >>= 1) bucket++;
+        histogram.counts[bucket]++;
+        histogram.steps++;
+        histogram.total_error_ns += error;
+        if (size > histogram.max_error_ns) histogram.max_error_ns = size;
+    }
+    last_step_ns[motor] = now_ns;
+}
+
+static void reset(void) {
+    histogram = (struct histogram_t) {{0}, 0, 0, 0, 0};
+    for (unsigned int m = 0; m < NUM_MOTORS; m++) last_step_ns[m] = -1;
+}
+
+static void print_histogram(const char *name) {
+    printf("%s: %lu step intervals, mean error %+.2f us, max %.1f us, %u missed\n", name, histogram.steps,
+           histogram.total_error_ns / 1000.0 / histogram.steps, histogram.max_error_ns / 1000.0, histogram.missed);
+    for (unsigned int b = 0; b < BUCKETS; b++) {
+        if (b == 0) printf("    %5s %5s us", "", "< 1");
+        else if (b == BUCKETS - 1) printf("    %5u %5s us", 1 << (b - 1), "+");
+        else printf("    %5u-%5u us", 1 << (b - 1), 1 << b);
+        printf(" %9lu  %6.2f%%\n", histogram.counts[b], 100.0 * histogram.counts[b] / histogram.steps);
+    }
+}
+
+// The busy loop's clock, and the NAJ bytes still to come for the message being sent (in both models)
+static unsigned long long loop_ns;
+static unsigned long long next_byte;
+static unsigned int bytes_left;
+
+// Run the busy loop for `ns`, and the NAJ byte interrupts that come in meanwhile
+static void spend(unsigned long long ns) {
+    loop_ns += ns;
+    while (bytes_left > 0 && next_byte <= loop_ns) {
+        loop_ns += IRQ_ENTRY_NS + NAJ_ISR_NS;
+        next_byte += NAJ_BYTE_NS;
+        bytes_left--;
+    }
+}
+
+// The busy-poll loop, as `motors.c` had it
+static void run_busy_loop(void) {
+    reset();
+    unsigned long long next_step[NUM_MOTORS];
+    for (unsigned int m = 0; m < NUM_MOTORS; m++) {
+        periods[m] = chord[m];
+        next_step[m] = periods[m];
+    }
+
+    loop_ns = 0;
+    unsigned long long next_change = CHANGE_US * 1000ull;
+    next_byte = next_change;
+    bytes_left = OLD_MESSAGE_BYTES;
+    unsigned int changes_made = 0;
+
+    while (loop_ns < DURATION_US * 1000ull) {
+        // A complete message: print it and restart its motor, a period from now
+        if (bytes_left == 0 && loop_ns >= next_byte) {
+            spend(PRINT_NS);
+            unsigned int m = changes_made % NUM_MOTORS;
+            periods[m] = changes[changes_made % NUM_CHANGES];
+            next_step[m] = loop_ns / 1000 + periods[m];
+            last_step_ns[m] = -1;
+            changes_made++;
+
+            next_change += CHANGE_US * 1000ull;
+            next_byte = next_change;
+            bytes_left = OLD_MESSAGE_BYTES;
+        }
+
+        spend(PASS_NS);
+        for (unsigned int m = 0; m < NUM_MOTORS; m++) {
+            spend(CHECK_NS);
+            unsigned long long now = loop_ns / 1000;
+            if (now > next_step[m]) {
+                next_step[m] = now + periods[m];
+                record(m, loop_ns);
+                spend(STEP_NS);
+            }
+        }
+    }
+}
+
+// Fake hardware for `sched.c`
+volatile unsigned int fakepi_armtimer_load;
+static unsigned long long sim_ns;
+static int armtimer_running;
+static unsigned long long armtimer_fire_ns;
+static handler_fn_t timer_handler;
+
+unsigned int timer_get_ticks(void) {
+    return sim_ns / 1000;
+}
+
+void armtimer_init(unsigned int nticks) {
+    fakepi_armtimer_load = nticks;
+    armtimer_running = 0;
+}
+
+void armtimer_enable(void) {
+    // Every enable follows a write to the load register, which restarts the countdown
+    armtimer_running = 1;
+    armtimer_fire_ns = sim_ns + fakepi_armtimer_load * 1000ull;
+}
+
+void armtimer_disable(void) {
+    armtimer_running = 0;
+}
+
+void armtimer_enable_interrupts(void) {}
+
+bool armtimer_check_and_clear_interrupt(void) {
+    return true;
+}
+
+void interrupts_global_enable(void) {}
+void interrupts_global_disable(void) {}
+
+bool interrupts_enable_source(unsigned int source) {
+    return true;
+}
+
+handler_fn_t interrupts_register_handler(unsigned int source, handler_fn_t fn, void *aux_data) {
+    if (source == INTERRUPTS_BASIC_ARM_TIMER_IRQ) timer_handler = fn;
+    return NULL;
+}
+
+// The scheduler's jitter recorder is replaced by the histogram here
+void jitter_reset(void) {}
+void jitter_record(unsigned int motor, unsigned int lateness) {}
+void jitter_switch(unsigned int motor, unsigned int lateness) {}
+
+void jitter_missed(unsigned int motor, unsigned int count) {
+    histogram.missed += count;
+}
+
+static void sim_step(unsigned int motors, unsigned int when) {
+    for (unsigned int m = 0; m < NUM_MOTORS; m++) {
+        if (motors & (1 << m)) record(m, sim_ns);
+    }
+    sim_ns += STEP_NS;
+}
+
+// The heap scheduler, driven by the simulated timer
+static void run_scheduler(void) {
+    reset();
+    sim_ns = 0;
+    sched_init(NUM_MOTORS, sim_step);
+    for (unsigned int m = 0; m < NUM_MOTORS; m++) {
+        periods[m] = chord[m];
+        sched_start(m, periods[m] << SCHED_FRAC_BITS);
+    }
+
+    unsigned long long cpu_free = 0; // When the interrupt running now returns
+    unsigned long long next_change = CHANGE_US * 1000ull;
+    next_byte = next_change;
+    bytes_left = FRAME_BYTES;
+    unsigned int changes_made = 0;
+
+    while (sim_ns < DURATION_US * 1000ull) {
+        // Next event: a NAJ byte, the main loop applying a complete frame, or the timer
+        unsigned long long at = (bytes_left > 0) ? next_byte : next_byte + NAJ_BYTE_NS;
+        int timer_first = armtimer_running && armtimer_fire_ns <= at;
+        if (timer_first) at = armtimer_fire_ns;
+        if (at < cpu_free) at = cpu_free;
+
+        if (timer_first) {
+            sim_ns = at + IRQ_ENTRY_NS + TIMER_HANDLER_NS;
+            armtimer_running = 0;
+            timer_handler(0, NULL);
+            cpu_free = sim_ns;
+        } else if (bytes_left > 0) {
+            sim_ns = at;
+            cpu_free = at + IRQ_ENTRY_NS + NAJ_ISR_NS;
+            next_byte += NAJ_BYTE_NS;
+            bytes_left--;
+        } else {
+            // The main loop has the frame - the change runs with interrupts disabled
+            sim_ns = at;
+            unsigned int m = changes_made % NUM_MOTORS;
+            periods[m] = changes[changes_made % NUM_CHANGES];
+            sched_set_slot(m, 0, periods[m] << SCHED_FRAC_BITS);
+            last_step_ns[m] = -1;
+            changes_made++;
+            cpu_free = at + SET_NS;
+
+            next_change += CHANGE_US * 1000ull;
+            next_byte = next_change;
+            bytes_left = FRAME_BYTES;
+        }
+    }
+}
+
+int main(void) {
+    printf("%u motors, a note change every %u ms, %u s simulated\n", NUM_MOTORS, CHANGE_US / 1000, DURATION_US / 1000000);
+
+    run_busy_loop();
+    print_histogram("busy-poll loop");
+
+    run_scheduler();
+    print_histogram("heap scheduler");
+    expect(histogram.missed == 0, "scheduler missed steps");
+    double bias = histogram.total_error_ns / 1000.0 / histogram.steps;
+    expect(bias > -0.5 && bias < 0.5, "scheduler's intervals are biased (pitch drifts)");
+
+    printf(failures ? "%d failures\n" : "all passed\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,150 @@
+// Host-side test for the graphics board's scrolling note ring (see `graphics/scroll.h`)
+//
+// Usage: ./scrolltest
+// Runs the ring over an in-memory buffer the size of the visualizer's screen for a few thousand
+// frames - enough to wrap it many times - scrolling by a few rows a frame, now and then by more than
+// the whole screen, and drawing each new row and the strip the way `graphics.c` does
+// The strip is copied in from a sprite wider than the window, clipped at both sides
+// After every frame the window is copied out (the software path) and checked pixel for pixel
+// against the picture it should show, the two copies in the buffer are checked to match, and guard
+// rows around the buffer are checked to be untouched
+// Reports the pixels written per frame next to a full repaint of the screen
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../graphics/scroll.h"
+
+// The visualizer's screen: 92 by 100 cells of 10 pixels, under a keyboard 40 pixels tall
+#define WIDTH 920
+#define HEIGHT 1000
+#define STRIP 40
+#define ROW 10
+#define PITCH (WIDTH + 16) // Rows padded, as the firmware may pad them
+
+#define GUARD 4 // Rows either side of the buffer that must never be written
+#define GUARD_COLOR 0xDEADBEEF
+#define BLACK 0xFF000000
+
+#define FRAMES 2000
+#define JUMP_EVERY 500 // Frames between jumps of more than the screen
+
+static unsigned int buffer[(2 * HEIGHT + 2 * GUARD) * PITCH];
+static unsigned int screen[HEIGHT * WIDTH];
+static struct scroll_t scroll;
+static unsigned long written;
+static int failures;
+
+static unsigned int note_color(unsigned int row, unsigned int x) {
+    return 0xFF000000 | ((row * 2654435761u) ^ (x / ROW * 40503u)) >> 8;
+}
+
+static unsigned int strip_color(unsigned int frame, unsigned int x) {
+    return 0xFF000000 | (frame * 97 + x / ROW) << 4;
+}
+
+static void fill(int x, int y, int w, int h, unsigned int color) {
+    scroll_fill(&scroll, x, y, w, h, color);
+    written += 2 * (unsigned long) w * h;
+}
+
+// The strip is copied in from a sprite, as `graphics.c` copies the keyboard - one cell wider than the
+// window at each side, so it is clipped both ways
+#define SPRITE_WIDTH (WIDTH + 2 * ROW)
+static unsigned int strip_pixels[STRIP * SPRITE_WIDTH];
+
+static void draw_strip(unsigned int frame) {
+    for (unsigned int i = 0; i < STRIP * SPRITE_WIDTH; i++) {
+        strip_pixels[i] = strip_color(frame, i % SPRITE_WIDTH - ROW);
+    }
+    scroll_blit(&scroll, -ROW, 0, SPRITE_WIDTH, STRIP, strip_pixels, SPRITE_WIDTH);
+    written += 2 * WIDTH * STRIP;
+}
+
+static void expect(int ok, const char *what, unsigned int frame) {
+    if (!ok && failures++ < 10) printf("FAIL: %s at frame %u\n", what, frame);
+}
+
+// Check the window, the two copies and the guard rows after frame `frame`, with `drawn` note rows
+// drawn so far (the newest under the strip)
+static void check(unsigned int frame, unsigned int drawn) {
+    scroll_copy(&scroll, screen, WIDTH * sizeof(unsigned int));
+
+    int picture_ok = 1;
+    for (unsigned int y = 0; y < HEIGHT && picture_ok; y++) {
+        for (unsigned int x = 0; x < WIDTH; x++) {
+            unsigned int expected;
+            if (y < STRIP) {
+                expected = strip_color(frame, x);
+            } else if (y - STRIP < drawn) {
+                expected = note_color(drawn - 1 - (y - STRIP), x);
+            } else {
+                expected = BLACK;
+            }
+            if (screen[y * WIDTH + x] != expected) {
+                picture_ok = 0;
+                break;
+            }
+        }
+    }
+    expect(picture_ok, "window shows the wrong picture", frame);
+
+    unsigned int *base = buffer + GUARD * PITCH;
+    int twins_ok = 1;
+    for (unsigned int i = 0; i < HEIGHT * PITCH && twins_ok; i++) {
+        if (i % PITCH < WIDTH && base[i] != base[i + HEIGHT * PITCH]) twins_ok = 0;
+    }
+    expect(twins_ok, "the two copies differ", frame);
+
+    int guard_ok = 1;
+    for (unsigned int i = 0; i < GUARD * PITCH; i++) {
+        if (buffer[i] != GUARD_COLOR || base[2 * HEIGHT * PITCH + i] != GUARD_COLOR) guard_ok = 0;
+    }
+    expect(guard_ok, "guard rows written", frame);
+    expect(scroll.top < HEIGHT, "window outside the buffer", frame);
+}
+
+int main(void) {
+    for (unsigned int i = 0; i < sizeof(buffer) / sizeof(buffer[0]); i++) buffer[i] = GUARD_COLOR;
+
+    scroll_init(&scroll, buffer + GUARD * PITCH, PITCH * sizeof(unsigned int), WIDTH, HEIGHT, STRIP, 1);
+    fill(0, 0, WIDTH, HEIGHT, BLACK);
+
+    // Clipping: nothing outside the window may be touched
+    fill(-50, -50, 100, 100, BLACK);
+    fill(WIDTH - 10, HEIGHT - 10, 100, 100, BLACK);
+    fill(0, HEIGHT, WIDTH, 10, 0x12345678);
+    fill(WIDTH, 0, 10, HEIGHT, 0x12345678);
+    draw_strip(0);
+    check(0, 0);
+
+    unsigned long drawing = 0;
+    unsigned int drawn = 0;
+    srand(107);
+    for (unsigned int frame = 1; frame <= FRAMES; frame++) {
+        // Mostly one row a frame, sometimes none or a few, and now and then more than the screen
+        unsigned int rows = ROW * (rand() % 8 == 0 ? rand() % 4 : 1);
+        if (frame % JUMP_EVERY == 0) rows = HEIGHT + 3 * ROW;
+
+        written = 0;
+        scroll_advance(&scroll, rows);
+        unsigned int visible = (rows < HEIGHT - STRIP) ? rows : HEIGHT - STRIP;
+        for (unsigned int i = 0; i < visible; i++) {
+            // Row `i` under the strip is note row `drawn + rows - 1 - i`, drawn a cell at a time
+            for (unsigned int x = 0; x < WIDTH; x += ROW) {
+                fill(x, STRIP + i, ROW, 1, note_color(drawn + rows - 1 - i, x));
+            }
+        }
+        drawn += rows;
+        draw_strip(frame);
+        if (frame % JUMP_EVERY) drawing += written;
+
+        check(frame, drawn);
+    }
+
+    printf("%u frames, %u rows scrolled, ring wrapped %u times\n", FRAMES, drawn, drawn / HEIGHT);
+    printf("pixels written per frame: %lu (both copies), against %u for repainting the screen\n",
+           drawing / (FRAMES - FRAMES / JUMP_EVERY), WIDTH * HEIGHT);
+    printf(failures ? "%d failures\n" : "all passed\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,262 @@
+// Host-side player for the controller's Standard MIDI File reader (see `controller/smf.h`)
+//
+// Usage:
+//     ./smfplay song.mid     play the file into a virtual motor sink and print the timeline
+//     ./smfplay --check      play a generated reference file and check every event time
+//
+// The virtual sink gives each note-on the first free motor, like the controller's live mode,
+// and reports how many notes found no motor
+// The check builds a format 1 file with two tracks, tempo changes mid-song, running status,
+// SysEx and other meta events, and a stray data byte after a SysEx that must not play, and compares
+// the reader's times against times worked out independently in floating point - the SysEx
+// messages (routing selects) must come out too, with their payload
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../controller/smf.h"
+
+#define NUM_MOTORS 8
+
+static void sink_event(const struct midi_event_t *event, unsigned int time, int verbose, unsigned int *drops) {
+    static unsigned char motors[NUM_MOTORS] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    int on = (event->action == MIDI_NOTE_ON && event->velocity > 0);
+    int off = (event->action == MIDI_NOTE_OFF || (event->action == MIDI_NOTE_ON && event->velocity == 0));
+    if (!on && !off) return;
+
+    int motor = -1;
+    for (int m = 0; m < NUM_MOTORS && motor < 0; m++) {
+        if (on && motors[m] == 0xFF) motor = m;
+        if (off && motors[m] == event->key) motor = m;
+    }
+
+    if (motor < 0) {
+        if (on) (*drops)++;
+        return;
+    }
+    motors[motor] = on ? event->key : 0xFF;
+    if (verbose) printf("%10.3f s  motor %d  %s %3d  (channel %d)\n", time / 1e6, motor, on ? "on " : "off", event->key, event->channel);
+}
+
+static int play_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+
+    static unsigned char data[1 << 22];
+    unsigned int len = fread(data, 1, sizeof(data), f);
+    fclose(f);
+
+    struct smf_t smf;
+    if (!smf_open(&smf, data, len)) {
+        fprintf(stderr, "smfplay: %s is not a format 0/1 MIDI file\n", path);
+        return 1;
+    }
+
+    struct midi_event_t event;
+    unsigned int time, last = 0, events = 0, drops = 0;
+    while (smf_next(&smf, &event, &time)) {
+        if (time < last) {
+            fprintf(stderr, "smfplay: event at %u us is earlier than the one before (%u us)\n", time, last);
+            return 1;
+        }
+        last = time;
+        events++;
+        sink_event(&event, time, 1, &drops);
+    }
+
+    printf("%u events, %.3f s, %u notes found no free motor\n", events, last / 1e6, drops);
+    return 0;
+}
+
+// Builder for the reference file
+static unsigned char ref[1024];
+static unsigned int ref_len;
+
+static void put(unsigned char byte) { ref[ref_len++] = byte; }
+static void put32(unsigned int v) { put(v >> 24); put(v >> 16); put(v >> 8); put(v); }
+
+static void put_vlq(unsigned int v) {
+    unsigned char bytes[4];
+    int n = 0;
+    do {
+        bytes[n++] = v & 0x7F;
+        v >>= 7;
+    } while (v);
+    while (n > 1) put(bytes[--n] | 0x80);
+    put(bytes[0]);
+}
+
+// Expected events, filled in as the file is built
+struct expected_t {
+    unsigned int tick;
+    unsigned char key;
+    double time;
+    int sysex;      // A SysEx with the payload 7D 02, rather than a note on `key`
+};
+
+static struct expected_t expected[64];
+static int num_expected;
+
+#define DIVISION 480
+
+// Tempo map of the reference file: (tick, microseconds per quarter)
+static const unsigned int tempo_map[][2] = {{0, 500000}, {960, 400000}, {1500, 652174}, {3000, 333333}};
+#define NUM_TEMPOS (sizeof(tempo_map) / sizeof(tempo_map[0]))
+
+static double reference_time(unsigned int tick) {
+    double time = 0;
+    for (unsigned int i = 0; i < NUM_TEMPOS; i++) {
+        unsigned int from = tempo_map[i][0];
+        unsigned int to = (i + 1 < NUM_TEMPOS) ? tempo_map[i + 1][0] : 0xFFFFFFFF;
+        if (tick <= from) break;
+        unsigned int until = (tick < to) ? tick : to;
+        time += (double)(until - from) * tempo_map[i][1] / DIVISION;
+    }
+    return time;
+}
+
+static void build_reference(void) {
+    ref_len = 0;
+    num_expected = 0;
+
+    memcpy(ref, "MThd", 4);
+    ref_len = 4;
+    put32(6);
+    put(0); put(1);   // Format 1
+    put(0); put(2);   // Two tracks
+    put(DIVISION >> 8); put(DIVISION & 0xFF);
+
+    // Track 1: tempo map, a track name and a note every 250 ticks on channel 0 using running status
+    memcpy(ref + ref_len, "MTrk", 4);
+    ref_len += 4;
+    unsigned int len_at = ref_len;
+    put32(0);
+
+    put(0); put(0xFF); put(0x03); put(4); put('L'); put('e'); put('a'); put('d');
+    unsigned int tick = 0, next_tempo = 0, next_note = 0;
+    int first_note = 1;
+    unsigned char key = 60;
+    while (next_note <= 4000) {
+        if (next_tempo < NUM_TEMPOS && tempo_map[next_tempo][0] <= next_note) {
+            unsigned int t = tempo_map[next_tempo][0];
+            put_vlq(t - tick);
+            tick = t;
+            put(0xFF); put(0x51); put(3);
+            put(tempo_map[next_tempo][1] >> 16); put(tempo_map[next_tempo][1] >> 8); put(tempo_map[next_tempo][1]);
+            next_tempo++;
+            first_note = 1; // A meta event cancels running status
+            continue;
+        }
+
+        put_vlq(next_note - tick);
+        tick = next_note;
+        if (first_note) put(0x90);
+        first_note = 0;
+        put(key); put(100);
+        expected[num_expected++] = (struct expected_t){tick, key, 0, 0};
+        key++;
+        next_note += 250;
+    }
+    put(0); put(0xFF); put(0x2F); put(0);
+    unsigned int len = ref_len - len_at - 4;
+    ref[len_at] = len >> 24; ref[len_at + 1] = len >> 16; ref[len_at + 2] = len >> 8; ref[len_at + 3] = len;
+
+    // Track 2: notes on odd ticks on channel 1, with a SysEx in between
+    memcpy(ref + ref_len, "MTrk", 4);
+    ref_len += 4;
+    len_at = ref_len;
+    put32(0);
+
+    tick = 0;
+    for (unsigned int t = 1; t < 4000; t += 777) {
+        put_vlq(t - tick);
+        tick = t;
+        put(0x91); put(30 + t % 50); put(90);
+        expected[num_expected++] = (struct expected_t){tick, 30 + t % 50, 0, 0};
+
+        put(3); tick += 3;
+        put(0xF0); put(3); put(0x7D); put(0x02); put(0xF7);
+        expected[num_expected++] = (struct expected_t){tick, 2, 0, 1};
+    }
+    // A data byte straight after the SysEx has no running status to use - the reader must give up on
+    // the track here rather than play it as a note on channel 1
+    put(0); put(0x7E); put(0x50);
+    put(0); put(0xFF); put(0x2F); put(0);
+    len = ref_len - len_at - 4;
+    ref[len_at] = len >> 24; ref[len_at + 1] = len >> 16; ref[len_at + 2] = len >> 8; ref[len_at + 3] = len;
+
+    for (int i = 0; i < num_expected; i++) {
+        expected[i].time = reference_time(expected[i].tick);
+    }
+}
+
+static int check(void) {
+    build_reference();
+
+    struct smf_t smf;
+    if (!smf_open(&smf, ref, ref_len)) {
+        printf("FAIL: reference file rejected\n");
+        return 1;
+    }
+
+    int seen[64] = {0};
+    int errors = 0, events = 0;
+    double worst = 0;
+    unsigned int last = 0;
+    struct midi_event_t event;
+    unsigned int time;
+
+    while (smf_next(&smf, &event, &time)) {
+        events++;
+        if (time < last) {
+            printf("FAIL: key %d at %u us comes after an event at %u us\n", event.key, time, last);
+            errors++;
+        }
+        last = time;
+
+        int sysex = event.action == MIDI_SYSTEM && event.channel == 0;
+        if (sysex && (event.key != 2 || smf.sysex[0] != 0x7D || smf.sysex[1] != 0x02)) {
+            printf("FAIL: SysEx at %u us has the wrong payload\n", time);
+            errors++;
+        }
+
+        int match = -1;
+        for (int i = 0; i < num_expected && match < 0; i++) {
+            if (!seen[i] && expected[i].sysex == sysex && expected[i].key == event.key) match = i;
+        }
+        if (match < 0) {
+            printf("FAIL: unexpected key %d at %u us\n", event.key, time);
+            errors++;
+            continue;
+        }
+        seen[match] = 1;
+
+        double error = time - expected[match].time;
+        if (error < 0) error = -error;
+        if (error > worst) worst = error;
+        if (error > 1.0) {
+            printf("FAIL: key %d at %u us, expected %.1f us\n", event.key, time, expected[match].time);
+            errors++;
+        }
+    }
+
+    if (events != num_expected) {
+        printf("FAIL: %d events, expected %d\n", events, num_expected);
+        errors++;
+    }
+
+    printf("%s: %d events, worst timing error %.2f us\n", errors ? "FAIL" : "PASS", events, worst);
+    return errors != 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "--check") == 0) return check();
+    if (argc == 2) return play_file(argv[1]);
+
+    fprintf(stderr, "usage: %s song.mid | --check\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,128 @@
+// Host-side benchmark for the live mode voice allocator (see `controller/voices.h`)
+//
+// Usage: ./voicebench [events]
+// Replays a generated chord-heavy note stream (overlapping chords, sustained bass notes and
+// repeated keys) through every stealing policy, plus the old linear scan for comparison,
+// and reports how many notes were dropped or stole a motor and how long each event took
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../controller/voices.h"
+
+#define NUM_MOTORS 8
+#define MAX_EVENTS 1000000
+
+struct event_t {
+    unsigned char on;
+    unsigned char key;
+    unsigned char velocity;
+};
+
+static struct event_t events[MAX_EVENTS];
+
+// Chords of 3-6 notes around a wandering root, each released a few chords later,
+// with a held bass note every so often and the occasional key pressed twice
+static int generate(int count) {
+    int n = 0;
+    int root = 60;
+    unsigned char held[16][8];
+    int held_size[16] = {0};
+
+    srand(107);
+    for (int chord = 0; n + 32 < count; chord++) {
+        int slot = chord % 16;
+
+        // Release the chord started a few chords ago
+        for (int i = 0; i < held_size[slot]; i++) {
+            events[n++] = (struct event_t){0, held[slot][i], 0};
+        }
+        held_size[slot] = 0;
+
+        root += rand() % 7 - 3;
+        if (root < 40 || root > 90) root = 64;
+
+        int size = 3 + rand() % 4;
+        for (int i = 0; i < size; i++) {
+            unsigned char key = root + 3 * i + rand() % 2;
+            events[n++] = (struct event_t){1, key, 40 + rand() % 80};
+            held[slot][held_size[slot]++] = key;
+        }
+        if (rand() % 4 == 0) events[n++] = (struct event_t){1, root, 100}; // Retrigger
+        if (chord % 8 == 0) {
+            // Bass note that only lasts until the next few chords are released
+            unsigned char bass = root - 24;
+            events[n++] = (struct event_t){1, bass, 110};
+            held[(slot + 3) % 16][held_size[(slot + 3) % 16]++] = bass;
+        }
+    }
+    return n;
+}
+
+// The allocator the controller used before: first free motor on note-on, first match on note-off
+static void run_linear(int count) {
+    unsigned char motors[NUM_MOTORS];
+    for (int i = 0; i < NUM_MOTORS; i++) motors[i] = VOICES_NONE;
+
+    unsigned int notes = 0, drops = 0, duplicates = 0;
+    clock_t start = clock();
+    for (int e = 0; e < count; e++) {
+        if (events[e].on) {
+            notes++;
+            int placed = 0;
+            for (int i = 0; i < NUM_MOTORS; i++) {
+                if (motors[i] == events[e].key) duplicates++;
+            }
+            for (int i = 0; i < NUM_MOTORS; i++) {
+                if (motors[i] == VOICES_NONE) {
+                    motors[i] = events[e].key;
+                    placed = 1;
+                    break;
+                }
+            }
+            if (!placed) drops++;
+        } else {
+            for (int i = 0; i < NUM_MOTORS; i++) {
+                if (motors[i] == events[e].key) {
+                    motors[i] = VOICES_NONE;
+                    break;
+                }
+            }
+        }
+    }
+    double ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / count;
+
+    printf("%-10s notes %7u  drops %7u  steals %7u  retriggers %7u  (%u keys on two motors)  %6.1f ns/event\n",
+           "linear", notes, drops, 0u, 0u, duplicates, ns);
+}
+
+static void run_policy(const char *name, unsigned int policy, int count) {
+    struct voices_t voices;
+    voices_init(&voices, NUM_MOTORS, NUM_MOTORS, policy);
+
+    clock_t start = clock();
+    for (int e = 0; e < count; e++) {
+        unsigned char stolen;
+        if (events[e].on) voices_note_on(&voices, events[e].key, events[e].velocity, &stolen);
+        else voices_note_off(&voices, events[e].key);
+    }
+    double ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / count;
+
+    printf("%-10s notes %7u  drops %7u  steals %7u  retriggers %7u  %6.1f ns/event\n",
+           name, voices.notes, voices.drops, voices.steals, voices.retriggers, ns);
+}
+
+int main(int argc, char *argv[]) {
+    int count = (argc > 1) ? atoi(argv[1]) : 200000;
+    if (count > MAX_EVENTS) count = MAX_EVENTS;
+    count = generate(count);
+
+    printf("%d events, %d motors\n", count, NUM_MOTORS);
+    run_linear(count);
+    run_policy("none", VOICES_STEAL_NONE, count);
+    run_policy("oldest", VOICES_STEAL_OLDEST, count);
+    run_policy("quietest", VOICES_STEAL_QUIETEST, count);
+    run_policy("closest", VOICES_STEAL_CLOSEST, count);
+    return 0;
+}